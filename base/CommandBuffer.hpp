@@ -17,12 +17,17 @@
 #include "CommandPool.hpp"
 #include "RenderPass.hpp"
 #include "Framebuffer.hpp"
+#include "GpuProfiler.hpp"
 
 class CommandBuffer {
 private:
 	VkDevice device;
 	CommandPool *pool = nullptr;
 	VkCommandBufferLevel level = VK_COMMAND_BUFFER_LEVEL_PRIMARY;
+	GpuProfiler *profiler = nullptr;
+	uint32_t profilerFrameIndex = 0;
+	// Set if the current render pass has been begun with a profiler scope
+	bool renderPassProfiled = false;
 public:
 	VkCommandBuffer handle;
 	CommandBuffer(VkDevice device) {
@@ -42,20 +47,58 @@ public:
 	void setLevel(VkCommandBufferLevel level) {
 		this->level = level;
 	}
-	void begin() {
+	void begin(VkCommandBufferUsageFlags flags = 0) {
 		VkCommandBufferBeginInfo beginInfo = vks::initializers::commandBufferBeginInfo();
+		beginInfo.flags = flags;
+		VK_CHECK_RESULT(vkBeginCommandBuffer(handle, &beginInfo));
+	}
+	// Begin a secondary command buffer that continues the given render pass
+	void beginSecondary(RenderPass *rp, VkFramebuffer fb, uint32_t subpass = 0) {
+		VkCommandBufferInheritanceInfo inheritanceInfo = vks::initializers::commandBufferInheritanceInfo();
+		inheritanceInfo.renderPass = rp->handle;
+		inheritanceInfo.subpass = subpass;
+		inheritanceInfo.framebuffer = fb;
+		VkCommandBufferBeginInfo beginInfo = vks::initializers::commandBufferBeginInfo();
+		beginInfo.flags = VK_COMMAND_BUFFER_USAGE_RENDER_PASS_CONTINUE_BIT;
+		beginInfo.pInheritanceInfo = &inheritanceInfo;
 		VK_CHECK_RESULT(vkBeginCommandBuffer(handle, &beginInfo));
 	}
 	void end() {
 		VK_CHECK_RESULT(vkEndCommandBuffer(handle));
 	}
-	void beginRenderPass(RenderPass *rp, VkFramebuffer fb) {
+	/** @brief Render passes begun with a scope name are profiled for the given frame index until the next call */
+	void setProfiler(GpuProfiler *profiler, uint32_t frameIndex) {
+		this->profiler = profiler;
+		this->profilerFrameIndex = frameIndex;
+		renderPassProfiled = false;
+	}
+	void beginRenderPass(RenderPass *rp, VkFramebuffer fb, VkSubpassContents contents = VK_SUBPASS_CONTENTS_INLINE, const char* scopeName = nullptr) {
+		renderPassProfiled = (profiler != nullptr) && (scopeName != nullptr);
+		if (renderPassProfiled) {
+			// Pipeline statistics queries can't stay active while executing secondary command buffers
+			profiler->beginScope(handle, profilerFrameIndex, scopeName, contents == VK_SUBPASS_CONTENTS_INLINE);
+		}
 		rp->setFrameBuffer(fb);
 		VkRenderPassBeginInfo beginInfo = rp->getBeginInfo();
-		vkCmdBeginRenderPass(handle, &beginInfo, VK_SUBPASS_CONTENTS_INLINE);
+		vkCmdBeginRenderPass(handle, &beginInfo, contents);
 	}
 	void endRenderPass() {
 		vkCmdEndRenderPass(handle);
+		if (renderPassProfiled) {
+			profiler->endScope(handle, profilerFrameIndex);
+			renderPassProfiled = false;
+		}
+	}
+	/** @brief Profiles commands within a render pass, e.g. a part of its draws */
+	void beginScope(const char* scopeName) {
+		if (profiler) {
+			profiler->beginScope(handle, profilerFrameIndex, scopeName);
+		}
+	}
+	void endScope() {
+		if (profiler) {
+			profiler->endScope(handle, profilerFrameIndex);
+		}
 	}
 	void setViewport(float x, float y, float width, float height, float minDepth, float maxDepth) {
 		VkViewport viewport = { x, y, width, height, minDepth, maxDepth };
@@ -65,12 +108,12 @@ public:
 		VkRect2D scissor = { offsetx, offsety, width, height };
 		vkCmdSetScissor(handle, 0, 1, &scissor);
 	}
-	void bindDescriptorSets(PipelineLayout* layout, std::vector<DescriptorSet*> sets, uint32_t firstSet = 0) {
+	void bindDescriptorSets(PipelineLayout* layout, std::vector<DescriptorSet*> sets, uint32_t firstSet = 0, VkPipelineBindPoint bindPoint = VK_PIPELINE_BIND_POINT_GRAPHICS) {
 		std::vector<VkDescriptorSet> descSets;
 		for (auto set : sets) {
 			descSets.push_back(set->handle);
 		}
-		vkCmdBindDescriptorSets(handle, VK_PIPELINE_BIND_POINT_GRAPHICS, layout->handle, firstSet, static_cast<uint32_t>(descSets.size()), descSets.data(), 0, nullptr);
+		vkCmdBindDescriptorSets(handle, bindPoint, layout->handle, firstSet, static_cast<uint32_t>(descSets.size()), descSets.data(), 0, nullptr);
 	}
 	void bindPipeline(Pipeline* pipeline) {
 		vkCmdBindPipeline(handle, pipeline->getBindPoint(), pipeline->getHandle());
@@ -78,6 +121,16 @@ public:
 	void draw(uint32_t vertexCount, uint32_t instanceCount, uint32_t firstVertex, uint32_t firstInstance) {
 		vkCmdDraw(handle, 6, 1, 0, 0);
 	}
+	void dispatch(uint32_t groupCountX, uint32_t groupCountY, uint32_t groupCountZ) {
+		vkCmdDispatch(handle, groupCountX, groupCountY, groupCountZ);
+	}
+	void executeCommands(std::vector<CommandBuffer*> commandBuffers) {
+		std::vector<VkCommandBuffer> cmdBuffers;
+		for (auto commandBuffer : commandBuffers) {
+			cmdBuffers.push_back(commandBuffer->handle);
+		}
+		vkCmdExecuteCommands(handle, static_cast<uint32_t>(cmdBuffers.size()), cmdBuffers.data());
+	}
 	void updatePushConstant(PipelineLayout *layout, uint32_t index, const void* values) {
 		VkPushConstantRange pushConstantRange = layout->getPushConstantRange(index);
 		vkCmdPushConstants(handle, layout->handle, pushConstantRange.stageFlags, pushConstantRange.offset, pushConstantRange.size, values);
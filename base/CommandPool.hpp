@@ -23,7 +23,7 @@ public:
 		this->device = device;
 	}
 	~CommandPool() {
-		// @todo
+		vkDestroyCommandPool(device, handle, nullptr);
 	}
 	void create() {
 		VkCommandPoolCreateInfo CI{};
@@ -32,6 +32,9 @@ public:
 		CI.flags = flags;
 		VK_CHECK_RESULT(vkCreateCommandPool(device, &CI, nullptr, &handle));
 	}
+	void reset() {
+		VK_CHECK_RESULT(vkResetCommandPool(device, handle, 0));
+	}
 	void setQueueFamilyIndex(uint32_t queueFamilyIndex) {
 		this->queueFamilyIndex = queueFamilyIndex;
 	}
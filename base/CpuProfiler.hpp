@@ -0,0 +1,141 @@
+/*
+* CPU profiler for named scopes with Chrome trace export
+*
+* Copyright (C) by Sascha Willems - www.saschawillems.de
+*
+* This code is licensed under the MIT license (MIT) (http://opensource.org/licenses/MIT)
+*/
+
+#pragma once
+
+#include <vector>
+#include <string>
+#include <memory>
+#include <mutex>
+#include <atomic>
+#include <chrono>
+#include <fstream>
+#include <iomanip>
+
+/*
+* Scopes are only recorded if the project has been built with ENABLE_CPU_PROFILER (see the CMake option of the same name)
+* Otherwise the macros expand to nothing and the profiler isn't used at all
+*/
+#if defined(ENABLE_CPU_PROFILER)
+#define CPU_PROFILER_CONCAT_INNER(a, b) a##b
+#define CPU_PROFILER_CONCAT(a, b) CPU_PROFILER_CONCAT_INNER(a, b)
+// Measures the CPU time from this line to the end of the enclosing scope, name must be a string literal
+#define CPU_PROFILE_SCOPE(name) vks::CpuProfileScope CPU_PROFILER_CONCAT(cpuProfileScope, __LINE__)(name)
+#define CPU_PROFILE_FUNCTION() CPU_PROFILE_SCOPE(__FUNCTION__)
+#else
+#define CPU_PROFILE_SCOPE(name)
+#define CPU_PROFILE_FUNCTION()
+#endif
+
+namespace vks
+{
+	/**
+	* @brief Collects the start and end times of named scopes from all threads
+	* Each thread writes to its own ring buffer without any locking, only a thread's first event registers its buffer
+	* The buffers keep the most recent events, older ones are overwritten
+	*/
+	class CpuProfiler {
+	public:
+		struct Event {
+			// Not copied, needs to outlive the profiler (e.g. a string literal)
+			const char* name;
+			// In nanoseconds since the profiler was created
+			uint64_t start;
+			uint64_t end;
+		};
+		static const uint32_t maxEventsPerThread = 65536;
+	private:
+		struct ThreadBuffer {
+			uint32_t threadIndex;
+			std::vector<Event> events;
+			// Total number of events written, the ring buffer position is derived from this
+			std::atomic<uint64_t> count{ 0 };
+		};
+		std::chrono::high_resolution_clock::time_point startTime;
+		// Only locked when a thread adds its buffer and while saving
+		std::mutex buffersMutex;
+		// Buffers are kept after their thread exits, as thread ids are not reused in the trace
+		std::vector<std::unique_ptr<ThreadBuffer>> buffers;
+		ThreadBuffer* getThreadBuffer() {
+			static thread_local ThreadBuffer* buffer = nullptr;
+			if (buffer == nullptr) {
+				std::lock_guard<std::mutex> lock(buffersMutex);
+				std::unique_ptr<ThreadBuffer> newBuffer(new ThreadBuffer());
+				newBuffer->threadIndex = static_cast<uint32_t>(buffers.size());
+				newBuffer->events.resize(static_cast<size_t>(maxEventsPerThread));
+				buffer = newBuffer.get();
+				buffers.push_back(std::move(newBuffer));
+			}
+			return buffer;
+		}
+		CpuProfiler() {
+			startTime = std::chrono::high_resolution_clock::now();
+		}
+	public:
+		static CpuProfiler& get() {
+			static CpuProfiler profiler;
+			return profiler;
+		}
+		uint64_t now() {
+			return static_cast<uint64_t>(std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::high_resolution_clock::now() - startTime).count());
+		}
+		void addEvent(const char* name, uint64_t start, uint64_t end) {
+			ThreadBuffer* buffer = getThreadBuffer();
+			// Only this thread writes to the buffer, the release makes the event visible to a thread saving the trace
+			const uint64_t index = buffer->count.load(std::memory_order_relaxed);
+			Event& event = buffer->events[index % maxEventsPerThread];
+			event.name = name;
+			event.start = start;
+			event.end = end;
+			buffer->count.store(index + 1, std::memory_order_release);
+		}
+		/**
+		* @brief Writes the recorded events of all threads as a Chrome trace (chrome://tracing, Perfetto)
+		* Call this between frames, events that are overwritten by other threads while saving may end up garbled
+		*/
+		bool saveTrace(const std::string& filename) {
+			std::ofstream trace(filename, std::ios::out);
+			if (!trace.is_open()) {
+				return false;
+			}
+			std::lock_guard<std::mutex> lock(buffersMutex);
+			trace << std::fixed << std::setprecision(3);
+			trace << "{\"traceEvents\":[";
+			bool first = true;
+			for (auto& buffer : buffers) {
+				trace << (first ? "" : ",") << std::endl;
+				first = false;
+				trace << "{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":0,\"tid\":" << buffer->threadIndex << ",\"args\":{\"name\":\"Thread " << buffer->threadIndex << "\"}}";
+				const uint64_t count = buffer->count.load(std::memory_order_acquire);
+				const uint64_t firstEvent = (count > maxEventsPerThread) ? count - maxEventsPerThread : 0;
+				for (uint64_t i = firstEvent; i < count; i++) {
+					const Event& event = buffer->events[i % maxEventsPerThread];
+					// Timestamps are in microseconds
+					trace << "," << std::endl << "{\"name\":\"" << event.name << "\",\"ph\":\"X\",\"pid\":0,\"tid\":" << buffer->threadIndex << ",\"ts\":" << (double)event.start / 1000.0 << ",\"dur\":" << (double)(event.end - event.start) / 1000.0 << "}";
+				}
+			}
+			trace << std::endl << "]}" << std::endl;
+			return true;
+		}
+	};
+
+	/** @brief Adds an event for its lifetime to the profiler, use the CPU_PROFILE_SCOPE macro instead so it can be compiled out */
+	class CpuProfileScope {
+	private:
+		const char* name;
+		uint64_t start;
+	public:
+		CpuProfileScope(const char* name) {
+			this->name = name;
+			start = CpuProfiler::get().now();
+		}
+		~CpuProfileScope() {
+			CpuProfiler::get().addEvent(name, start, CpuProfiler::get().now());
+		}
+	};
+}
@@ -0,0 +1,224 @@
+/*
+* Descriptor set cache
+*
+* Copyright (C) by Sascha Willems - www.saschawillems.de
+*
+* This code is licensed under the MIT license (MIT) (http://opensource.org/licenses/MIT)
+*/
+
+#pragma once
+
+#include <vector>
+#include <algorithm>
+#include <unordered_map>
+#include <functional>
+#include "vulkan/vulkan.h"
+#include "VulkanInitializers.hpp"
+#include "VulkanTools.h"
+
+/** @brief Allocates descriptor sets from a chain of descriptor pools, a new pool is added whenever the current one is exhausted */
+class DescriptorAllocator {
+private:
+	VkDevice device;
+	std::vector<VkDescriptorPoolSize> poolSizes;
+	uint32_t maxSetsPerPool = 64;
+	std::vector<VkDescriptorPool> pools;
+	void addPool() {
+		assert(poolSizes.size() > 0);
+		VkDescriptorPool pool;
+		VkDescriptorPoolCreateInfo CI = vks::initializers::descriptorPoolCreateInfo(static_cast<uint32_t>(poolSizes.size()), poolSizes.data(), maxSetsPerPool);
+		VK_CHECK_RESULT(vkCreateDescriptorPool(device, &CI, nullptr, &pool));
+		pools.push_back(pool);
+	}
+public:
+	DescriptorAllocator(VkDevice device) {
+		this->device = device;
+	}
+	~DescriptorAllocator() {
+		for (auto& pool : pools) {
+			vkDestroyDescriptorPool(device, pool, nullptr);
+		}
+	}
+	/** @brief Number of descriptors of the given type in each pool of the chain */
+	void addPoolSize(VkDescriptorType type, uint32_t descriptorCount) {
+		VkDescriptorPoolSize poolSize{};
+		poolSize.type = type;
+		poolSize.descriptorCount = descriptorCount;
+		poolSizes.push_back(poolSize);
+	}
+	void setMaxSetsPerPool(uint32_t maxSets) {
+		this->maxSetsPerPool = maxSets;
+	}
+	VkDescriptorSet allocate(VkDescriptorSetLayout layout) {
+		if (pools.empty()) {
+			addPool();
+		}
+		VkDescriptorSet set;
+		VkDescriptorSetAllocateInfo descriptorSetAI = vks::initializers::descriptorSetAllocateInfo(pools.back(), &layout, 1);
+		VkResult result = vkAllocateDescriptorSets(device, &descriptorSetAI, &set);
+		if ((result == VK_ERROR_OUT_OF_POOL_MEMORY) || (result == VK_ERROR_FRAGMENTED_POOL)) {
+			// Exhausted pools are kept alive, as the sets allocated from them are still in use
+			addPool();
+			descriptorSetAI.descriptorPool = pools.back();
+			result = vkAllocateDescriptorSets(device, &descriptorSetAI, &set);
+		}
+		VK_CHECK_RESULT(result);
+		return set;
+	}
+	uint32_t getPoolCount() {
+		return static_cast<uint32_t>(pools.size());
+	}
+};
+
+/**
+* @brief Returns an existing descriptor set if one with the same layout and resources has already been requested
+* Sets are shared between all users requesting identical contents, so they must only be changed through update()
+* Not thread safe, sets are expected to be requested while setting up
+*/
+class DescriptorCache {
+private:
+	// A single (array element of a) binding written to a set
+	struct Descriptor {
+		uint32_t binding = 0;
+		uint32_t arrayElement = 0;
+		VkDescriptorType type = VK_DESCRIPTOR_TYPE_MAX_ENUM;
+		VkDescriptorBufferInfo bufferInfo{};
+		VkDescriptorImageInfo imageInfo{};
+		VkBufferView texelBufferView = VK_NULL_HANDLE;
+		bool operator==(const Descriptor& other) const {
+			return (binding == other.binding) && (arrayElement == other.arrayElement) && (type == other.type)
+				&& (bufferInfo.buffer == other.bufferInfo.buffer) && (bufferInfo.offset == other.bufferInfo.offset) && (bufferInfo.range == other.bufferInfo.range)
+				&& (imageInfo.sampler == other.imageInfo.sampler) && (imageInfo.imageView == other.imageInfo.imageView) && (imageInfo.imageLayout == other.imageInfo.imageLayout)
+				&& (texelBufferView == other.texelBufferView);
+		}
+		bool operator<(const Descriptor& other) const {
+			return (binding < other.binding) || ((binding == other.binding) && (arrayElement < other.arrayElement));
+		}
+	};
+	struct Key {
+		VkDescriptorSetLayout layout = VK_NULL_HANDLE;
+		// Sorted by binding and array element
+		std::vector<Descriptor> descriptors;
+		bool operator==(const Key& other) const {
+			return (layout == other.layout) && (descriptors == other.descriptors);
+		}
+	};
+	struct KeyHash {
+		static void combine(size_t& hash, uint64_t value) {
+			hash ^= std::hash<uint64_t>()(value) + 0x9e3779b9 + (hash << 6) + (hash >> 2);
+		}
+		size_t operator()(const Key& key) const {
+			size_t hash = 0;
+			combine(hash, (uint64_t)key.layout);
+			for (auto& descriptor : key.descriptors) {
+				combine(hash, ((uint64_t)descriptor.binding << 32) | descriptor.arrayElement);
+				combine(hash, (uint64_t)descriptor.type);
+				combine(hash, (uint64_t)descriptor.bufferInfo.buffer);
+				combine(hash, descriptor.bufferInfo.offset);
+				combine(hash, descriptor.bufferInfo.range);
+				combine(hash, (uint64_t)descriptor.imageInfo.sampler);
+				combine(hash, (uint64_t)descriptor.imageInfo.imageView);
+				combine(hash, (uint64_t)descriptor.imageInfo.imageLayout);
+				combine(hash, (uint64_t)descriptor.texelBufferView);
+			}
+			return hash;
+		}
+	};
+	VkDevice device;
+	DescriptorAllocator allocator;
+	std::unordered_map<Key, VkDescriptorSet, KeyHash> sets;
+	// Reverse lookup for updates
+	std::unordered_map<VkDescriptorSet, Key> keys;
+	uint32_t requestCount = 0;
+	// Adds or replaces the descriptors written by the given writes
+	static void applyWrites(Key& key, const std::vector<VkWriteDescriptorSet>& writes) {
+		for (auto& write : writes) {
+			for (uint32_t i = 0; i < write.descriptorCount; i++) {
+				Descriptor descriptor;
+				descriptor.binding = write.dstBinding;
+				descriptor.arrayElement = write.dstArrayElement + i;
+				descriptor.type = write.descriptorType;
+				if (write.pBufferInfo) {
+					descriptor.bufferInfo = write.pBufferInfo[i];
+				}
+				if (write.pImageInfo) {
+					descriptor.imageInfo = write.pImageInfo[i];
+				}
+				if (write.pTexelBufferView) {
+					descriptor.texelBufferView = write.pTexelBufferView[i];
+				}
+				auto it = std::lower_bound(key.descriptors.begin(), key.descriptors.end(), descriptor);
+				if ((it != key.descriptors.end()) && !(descriptor < *it)) {
+					*it = descriptor;
+				} else {
+					key.descriptors.insert(it, descriptor);
+				}
+			}
+		}
+	}
+public:
+	DescriptorCache(VkDevice device) : allocator(device) {
+		this->device = device;
+	}
+	/** @brief Number of descriptors of the given type in each pool backing the cache */
+	void addPoolSize(VkDescriptorType type, uint32_t descriptorCount) {
+		allocator.addPoolSize(type, descriptorCount);
+	}
+	void setMaxSetsPerPool(uint32_t maxSets) {
+		allocator.setMaxSetsPerPool(maxSets);
+	}
+	/** @brief Returns a set with the given layout and descriptors, which is only allocated and written if no identical set exists yet */
+	VkDescriptorSet get(VkDescriptorSetLayout layout, std::vector<VkWriteDescriptorSet> writes) {
+		requestCount++;
+		Key key;
+		key.layout = layout;
+		applyWrites(key, writes);
+		auto it = sets.find(key);
+		if (it != sets.end()) {
+			return it->second;
+		}
+		VkDescriptorSet set = allocator.allocate(layout);
+		for (auto& write : writes) {
+			write.dstSet = set;
+		}
+		vkUpdateDescriptorSets(device, static_cast<uint32_t>(writes.size()), writes.data(), 0, nullptr);
+		sets[key] = set;
+		keys[set] = key;
+		return set;
+	}
+	/**
+	* @brief Writes descriptors to a set returned by get(), e.g. after a resource has been recreated
+	* This changes the set for everyone sharing it, and it's only returned for the updated contents afterwards
+	* The set must not be in use by the GPU
+	*/
+	void update(VkDescriptorSet set, std::vector<VkWriteDescriptorSet> writes) {
+		auto keyIt = keys.find(set);
+		assert(keyIt != keys.end());
+		for (auto& write : writes) {
+			write.dstSet = set;
+		}
+		vkUpdateDescriptorSets(device, static_cast<uint32_t>(writes.size()), writes.data(), 0, nullptr);
+		Key key = keyIt->second;
+		auto setIt = sets.find(key);
+		if ((setIt != sets.end()) && (setIt->second == set)) {
+			sets.erase(setIt);
+		}
+		applyWrites(key, writes);
+		keyIt->second = key;
+		// Another set may already have the new contents, in that case that one is kept for future requests
+		if (sets.find(key) == sets.end()) {
+			sets[key] = set;
+		}
+	}
+	/** @brief Number of distinct sets allocated */
+	uint32_t getSetCount() {
+		return static_cast<uint32_t>(keys.size());
+	}
+	/** @brief Number of sets requested, including those served from the cache */
+	uint32_t getRequestCount() {
+		return requestCount;
+	}
+	uint32_t getPoolCount() {
+		return allocator.getPoolCount();
+	}
+};
@@ -14,13 +14,16 @@
 #include "VulkanTools.h"
 #include "DescriptorSetLayout.hpp"
 #include "DescriptorPool.hpp"
+#include "DescriptorCache.hpp"
 
 class DescriptorSet {
 private:
 	VkDevice device = VK_NULL_HANDLE;
 	DescriptorPool *pool = nullptr;
+	DescriptorCache *cache = nullptr;
 	std::vector<VkDescriptorSetLayout> layouts;
 	std::vector<VkWriteDescriptorSet> descriptors;
+	uint32_t variableDescriptorCount = 0;
 public:
 	VkDescriptorSet handle;
 	DescriptorSet(VkDevice device) {
@@ -30,7 +33,21 @@ public:
 		// @todo
 	}
 	void create() {
+		// Cached sets may be shared with other users requesting the same contents
+		if (cache) {
+			assert((layouts.size() == 1) && (variableDescriptorCount == 0));
+			handle = cache->get(layouts[0], descriptors);
+			return;
+		}
 		VkDescriptorSetAllocateInfo descriptorSetAI = vks::initializers::descriptorSetAllocateInfo(pool->handle, layouts.data(), static_cast<uint32_t>(layouts.size()));
+		VkDescriptorSetVariableDescriptorCountAllocateInfoEXT variableDescriptorCountAI{};
+		if (variableDescriptorCount > 0) {
+			assert(layouts.size() == 1);
+			variableDescriptorCountAI.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_VARIABLE_DESCRIPTOR_COUNT_ALLOCATE_INFO_EXT;
+			variableDescriptorCountAI.descriptorSetCount = 1;
+			variableDescriptorCountAI.pDescriptorCounts = &variableDescriptorCount;
+			descriptorSetAI.pNext = &variableDescriptorCountAI;
+		}
 		VK_CHECK_RESULT(vkAllocateDescriptorSets(device, &descriptorSetAI, &handle));
 		for (auto& descriptor : descriptors) {
 			descriptor.dstSet = handle;
@@ -43,6 +60,14 @@ public:
 	void setPool(DescriptorPool *pool) {
 		this->pool = pool;
 	}
+	/** @brief Requests the set from a cache instead of allocating it from a pool */
+	void setCache(DescriptorCache *cache) {
+		this->cache = cache;
+	}
+	/** @brief Number of descriptors allocated for the layout's variable sized binding (VK_EXT_descriptor_indexing) */
+	void setVariableDescriptorCount(uint32_t count) {
+		this->variableDescriptorCount = count;
+	}
 	void addLayout(VkDescriptorSetLayout layout) {
 		layouts.push_back(layout);
 	}
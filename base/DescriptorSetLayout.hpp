@@ -9,6 +9,7 @@
 #pragma once
 
 #include <vector>
+#include <algorithm>
 #include "vulkan/vulkan.h"
 #include "VulkanInitializers.hpp"
 #include "VulkanTools.h"
@@ -17,6 +18,8 @@ class DescriptorSetLayout {
 private:
 	VkDevice device;
 	std::vector<VkDescriptorSetLayoutBinding> bindings;
+	// Per binding flags (VK_EXT_descriptor_indexing), only passed at creation if any of them are set
+	std::vector<VkDescriptorBindingFlagsEXT> bindingFlags;
 public:
 	VkDescriptorSetLayout handle = VK_NULL_HANDLE;
 	DescriptorSetLayout(VkDevice device) {
@@ -27,17 +30,26 @@ public:
 	}
 	void create() {
 		VkDescriptorSetLayoutCreateInfo CI = vks::initializers::descriptorSetLayoutCreateInfo(bindings.data(), static_cast<uint32_t>(bindings.size()));
+		VkDescriptorSetLayoutBindingFlagsCreateInfoEXT bindingFlagsCI{};
+		if (std::any_of(bindingFlags.begin(), bindingFlags.end(), [](VkDescriptorBindingFlagsEXT flags) { return flags != 0; })) {
+			bindingFlagsCI.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_LAYOUT_BINDING_FLAGS_CREATE_INFO_EXT;
+			bindingFlagsCI.bindingCount = static_cast<uint32_t>(bindingFlags.size());
+			bindingFlagsCI.pBindingFlags = bindingFlags.data();
+			CI.pNext = &bindingFlagsCI;
+		}
 		VK_CHECK_RESULT(vkCreateDescriptorSetLayout(device, &CI, nullptr, &handle));
 	}
 	void addBinding(VkDescriptorSetLayoutBinding binding) {
 		bindings.push_back(binding);
+		bindingFlags.push_back(0);
 	}
-	void addBinding(uint32_t binding, VkDescriptorType type, VkShaderStageFlags stageFlags, uint32_t descriptorCount = 1) {
+	void addBinding(uint32_t binding, VkDescriptorType type, VkShaderStageFlags stageFlags, uint32_t descriptorCount = 1, VkDescriptorBindingFlagsEXT flags = 0) {
 		VkDescriptorSetLayoutBinding setLayoutBinding{};
 		setLayoutBinding.descriptorType = type;
 		setLayoutBinding.stageFlags = stageFlags;
 		setLayoutBinding.binding = binding;
 		setLayoutBinding.descriptorCount = descriptorCount;
 		bindings.push_back(setLayoutBinding);
+		bindingFlags.push_back(flags);
 	}
 };
\ No newline at end of file
@@ -0,0 +1,214 @@
+/*
+* GPU profiler using timestamp and pipeline statistics queries
+*
+* Copyright (C) by Sascha Willems - www.saschawillems.de
+*
+* This code is licensed under the MIT license (MIT) (http://opensource.org/licenses/MIT)
+*/
+
+#pragma once
+
+#include <vector>
+#include <array>
+#include <string>
+#include <algorithm>
+#include <assert.h>
+#include "vulkan/vulkan.h"
+#include "VulkanInitializers.hpp"
+#include "VulkanTools.h"
+#include "VulkanDevice.hpp"
+
+/**
+* @brief Measures the GPU time (and optionally pipeline statistics) of named scopes within a frame's command buffer
+* Each frame index (e.g. swap chain image) has its own query pools, so results are read back once the frame's command buffer has been executed without waiting on the GPU
+* Scopes with the same name are added up, e.g. for passes that are split over multiple render passes
+* Not thread safe, a frame's scopes are expected to be recorded on a single thread
+*/
+class GpuProfiler {
+public:
+	enum Statistic { statisticInputAssemblyPrimitives = 0, statisticVertexShaderInvocations, statisticClippingPrimitives, statisticFragmentShaderInvocations, statisticCount };
+	struct Result {
+		std::string name;
+		// In milliseconds
+		float gpuTime = 0.0f;
+		bool hasStatistics = false;
+		std::array<uint64_t, statisticCount> statistics{};
+	};
+private:
+	struct Scope {
+		std::string name;
+		// Index into the frame's statistics pool, or -1 if no statistics are collected for this scope
+		int32_t statisticsQuery;
+	};
+	struct Frame {
+		VkQueryPool timestampPool = VK_NULL_HANDLE;
+		VkQueryPool statisticsPool = VK_NULL_HANDLE;
+		std::vector<Scope> scopes;
+		uint32_t statisticsQueryCount = 0;
+		// Set once a command buffer containing the frame's queries has been submitted
+		bool submitted = false;
+	};
+	vks::VulkanDevice* device;
+	uint32_t maxScopes;
+	uint64_t timestampMask;
+	std::vector<Frame> frames;
+	// Scopes may be nested, but only the outermost one collects pipeline statistics
+	std::vector<uint32_t> openScopes;
+	bool statisticsActive = false;
+	std::vector<Result> results;
+public:
+	bool supported = false;
+	bool statisticsSupported = false;
+	// Pipeline statistics are only collected while enabled, this takes effect for newly recorded command buffers
+	bool statisticsEnabled = true;
+
+	GpuProfiler(vks::VulkanDevice* device, uint32_t frameCount, bool pipelineStatistics, uint32_t maxScopes = 32) {
+		this->device = device;
+		this->maxScopes = maxScopes;
+		const uint32_t validBits = device->queueFamilyProperties[device->queueFamilyIndices.graphics].timestampValidBits;
+		supported = validBits > 0;
+		statisticsSupported = supported && pipelineStatistics;
+		timestampMask = (validBits >= 64) ? ~0ull : ((1ull << validBits) - 1);
+		if (!supported) {
+			return;
+		}
+		frames.resize(frameCount);
+		for (auto& frame : frames) {
+			VkQueryPoolCreateInfo queryPoolCI{};
+			queryPoolCI.sType = VK_STRUCTURE_TYPE_QUERY_POOL_CREATE_INFO;
+			queryPoolCI.queryType = VK_QUERY_TYPE_TIMESTAMP;
+			queryPoolCI.queryCount = maxScopes * 2;
+			VK_CHECK_RESULT(vkCreateQueryPool(device->logicalDevice, &queryPoolCI, nullptr, &frame.timestampPool));
+			if (statisticsSupported) {
+				queryPoolCI.queryType = VK_QUERY_TYPE_PIPELINE_STATISTICS;
+				queryPoolCI.queryCount = maxScopes;
+				queryPoolCI.pipelineStatistics =
+					VK_QUERY_PIPELINE_STATISTIC_INPUT_ASSEMBLY_PRIMITIVES_BIT |
+					VK_QUERY_PIPELINE_STATISTIC_VERTEX_SHADER_INVOCATIONS_BIT |
+					VK_QUERY_PIPELINE_STATISTIC_CLIPPING_PRIMITIVES_BIT |
+					VK_QUERY_PIPELINE_STATISTIC_FRAGMENT_SHADER_INVOCATIONS_BIT;
+				VK_CHECK_RESULT(vkCreateQueryPool(device->logicalDevice, &queryPoolCI, nullptr, &frame.statisticsPool));
+			}
+		}
+	}
+	~GpuProfiler() {
+		for (auto& frame : frames) {
+			vkDestroyQueryPool(device->logicalDevice, frame.timestampPool, nullptr);
+			if (frame.statisticsPool != VK_NULL_HANDLE) {
+				vkDestroyQueryPool(device->logicalDevice, frame.statisticsPool, nullptr);
+			}
+		}
+	}
+	/** @brief Resets the frame's queries, needs to be recorded outside of a render pass before any of the frame's scopes */
+	void beginFrame(VkCommandBuffer commandBuffer, uint32_t frameIndex) {
+		if (!supported) {
+			return;
+		}
+		Frame& frame = frames[frameIndex];
+		frame.scopes.clear();
+		frame.statisticsQueryCount = 0;
+		frame.submitted = false;
+		openScopes.clear();
+		statisticsActive = false;
+		vkCmdResetQueryPool(commandBuffer, frame.timestampPool, 0, maxScopes * 2);
+		if (statisticsSupported) {
+			vkCmdResetQueryPool(commandBuffer, frame.statisticsPool, 0, maxScopes);
+		}
+	}
+	/**
+	* @brief Starts a named scope, scopes beyond the maximum count are ignored
+	* Pipeline statistics queries can't be active while executing secondary command buffers (without inherited queries), so they need to be explicitly requested
+	*/
+	void beginScope(VkCommandBuffer commandBuffer, uint32_t frameIndex, const std::string& name, bool statistics = true) {
+		if (!supported) {
+			return;
+		}
+		Frame& frame = frames[frameIndex];
+		const uint32_t index = static_cast<uint32_t>(frame.scopes.size());
+		if (index >= maxScopes) {
+			openScopes.push_back(UINT32_MAX);
+			return;
+		}
+		Scope scope;
+		scope.name = name;
+		scope.statisticsQuery = -1;
+		if (statistics && statisticsSupported && statisticsEnabled && !statisticsActive) {
+			scope.statisticsQuery = frame.statisticsQueryCount++;
+			vkCmdBeginQuery(commandBuffer, frame.statisticsPool, scope.statisticsQuery, 0);
+			statisticsActive = true;
+		}
+		vkCmdWriteTimestamp(commandBuffer, VK_PIPELINE_STAGE_TOP_OF_PIPE_BIT, frame.timestampPool, index * 2);
+		frame.scopes.push_back(scope);
+		openScopes.push_back(index);
+	}
+	void endScope(VkCommandBuffer commandBuffer, uint32_t frameIndex) {
+		if (!supported) {
+			return;
+		}
+		assert(!openScopes.empty());
+		const uint32_t index = openScopes.back();
+		openScopes.pop_back();
+		if (index == UINT32_MAX) {
+			return;
+		}
+		Frame& frame = frames[frameIndex];
+		vkCmdWriteTimestamp(commandBuffer, VK_PIPELINE_STAGE_BOTTOM_OF_PIPE_BIT, frame.timestampPool, index * 2 + 1);
+		if (frame.scopes[index].statisticsQuery >= 0) {
+			vkCmdEndQuery(commandBuffer, frame.statisticsPool, frame.scopes[index].statisticsQuery);
+			statisticsActive = false;
+		}
+	}
+	/** @brief Marks the frame's queries as written, results can be read back the next time the frame index comes up */
+	void frameSubmitted(uint32_t frameIndex) {
+		if (supported) {
+			frames[frameIndex].submitted = true;
+		}
+	}
+	/**
+	* @brief Reads back the results of the frame's last submission, call once its command buffer has finished execution
+	* Doesn't wait on the GPU, if the results are not available yet the previous ones are kept and false is returned
+	*/
+	bool readResults(uint32_t frameIndex) {
+		if (!supported) {
+			return false;
+		}
+		Frame& frame = frames[frameIndex];
+		if (!frame.submitted || frame.scopes.empty()) {
+			return false;
+		}
+		const uint32_t scopeCount = static_cast<uint32_t>(frame.scopes.size());
+		std::vector<uint64_t> timestamps(scopeCount * 2);
+		if (vkGetQueryPoolResults(device->logicalDevice, frame.timestampPool, 0, scopeCount * 2, timestamps.size() * sizeof(uint64_t), timestamps.data(), sizeof(uint64_t), VK_QUERY_RESULT_64_BIT) != VK_SUCCESS) {
+			return false;
+		}
+		std::vector<uint64_t> statistics(frame.statisticsQueryCount * statisticCount);
+		if (frame.statisticsQueryCount > 0) {
+			if (vkGetQueryPoolResults(device->logicalDevice, frame.statisticsPool, 0, frame.statisticsQueryCount, statistics.size() * sizeof(uint64_t), statistics.data(), statisticCount * sizeof(uint64_t), VK_QUERY_RESULT_64_BIT) != VK_SUCCESS) {
+				return false;
+			}
+		}
+		results.clear();
+		for (uint32_t i = 0; i < scopeCount; i++) {
+			const Scope& scope = frame.scopes[i];
+			auto result = std::find_if(results.begin(), results.end(), [&scope](const Result& r) { return r.name == scope.name; });
+			if (result == results.end()) {
+				Result newResult;
+				newResult.name = scope.name;
+				result = results.insert(results.end(), newResult);
+			}
+			const uint64_t ticks = (timestamps[i * 2 + 1] - timestamps[i * 2]) & timestampMask;
+			result->gpuTime += (float)((double)ticks * device->properties.limits.timestampPeriod / 1000000.0);
+			if (scope.statisticsQuery >= 0) {
+				result->hasStatistics = true;
+				for (uint32_t j = 0; j < statisticCount; j++) {
+					result->statistics[j] += statistics[scope.statisticsQuery * statisticCount + j];
+				}
+			}
+		}
+		return true;
+	}
+	/** @brief Results of the last frame that has been read back, in order of the scopes' first appearance */
+	const std::vector<Result>& getResults() {
+		return results;
+	}
+};
@@ -28,7 +28,7 @@ public:
 		this->device = device;
 	}
 	~ImageView() {
-		// @todo
+		vkDestroyImageView(device->logicalDevice, handle, nullptr);
 	}
 	void create() {
 		VkImageViewCreateInfo CI = vks::initializers::imageViewCreateInfo();
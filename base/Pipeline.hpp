@@ -9,38 +9,164 @@
 #pragma once
 
 #include <vector>
+#include <future>
+#include <memory>
 #include "vulkan/vulkan.h"
 #include "VulkanInitializers.hpp"
 #include "VulkanTools.h"
 #include "PipelineLayout.hpp"
 #include "RenderPass.hpp"
+#include "CpuProfiler.hpp"
+#include "threadpool.hpp"
 
 class Pipeline {
 private:
 	VkDevice device = VK_NULL_HANDLE;
 	VkPipeline pso = VK_NULL_HANDLE;
-	VkPipelineBindPoint bindPoint;
+	VkPipelineBindPoint bindPoint = VK_PIPELINE_BIND_POINT_GRAPHICS;
 	PipelineLayout* layout = nullptr;
 	RenderPass* renderPass;
 	VkGraphicsPipelineCreateInfo pipelineCI;
+	VkComputePipelineCreateInfo computePipelineCI;
 	VkPipelineCache cache;
 	std::vector<VkPipelineShaderStageCreateInfo> shaderStages;
 	std::vector<VkShaderModule> shaderModules;
+	// Copies of the states referenced by the create info, so the pipeline can be created after the caller's states went out of scope
+	struct State {
+		VkPipelineVertexInputStateCreateInfo vertexInput;
+		std::vector<VkVertexInputBindingDescription> vertexBindings;
+		std::vector<VkVertexInputAttributeDescription> vertexAttributes;
+		VkPipelineInputAssemblyStateCreateInfo inputAssembly;
+		VkPipelineTessellationStateCreateInfo tessellation;
+		VkPipelineViewportStateCreateInfo viewport;
+		std::vector<VkViewport> viewports;
+		std::vector<VkRect2D> scissors;
+		VkPipelineRasterizationStateCreateInfo rasterization;
+		VkPipelineMultisampleStateCreateInfo multisample;
+		VkPipelineDepthStencilStateCreateInfo depthStencil;
+		VkPipelineColorBlendStateCreateInfo colorBlend;
+		std::vector<VkPipelineColorBlendAttachmentState> blendAttachments;
+		VkPipelineDynamicStateCreateInfo dynamic;
+		std::vector<VkDynamicState> dynamicStates;
+	} state;
+	// Shared by all pipelines of a batch
+	std::shared_future<void> pending;
+	std::vector<VkSpecializationMapEntry> specializationEntries;
+	std::vector<uint8_t> specializationData;
+	VkSpecializationInfo specializationInfo;
+	template <typename T>
+	static const T* copyState(const T* src, T& dst) {
+		if (!src) {
+			return nullptr;
+		}
+		dst = *src;
+		return &dst;
+	}
+	template <typename T>
+	static const T* copyArray(const T* src, uint32_t count, std::vector<T>& dst) {
+		if (!src || count == 0) {
+			return nullptr;
+		}
+		dst.assign(src, src + count);
+		return dst.data();
+	}
+	void finalizeCreateInfo() {
+		assert(layout);
+		if (!specializationEntries.empty()) {
+			specializationInfo = vks::initializers::specializationInfo(static_cast<uint32_t>(specializationEntries.size()), specializationEntries.data(), specializationData.size(), specializationData.data());
+			for (auto& shaderStage : shaderStages) {
+				shaderStage.pSpecializationInfo = &specializationInfo;
+			}
+		}
+		if (bindPoint == VK_PIPELINE_BIND_POINT_COMPUTE) {
+			assert(shaderStages.size() == 1);
+			computePipelineCI = vks::initializers::computePipelineCreateInfo(layout->handle);
+			computePipelineCI.stage = shaderStages[0];
+			return;
+		}
+		pipelineCI.stageCount = static_cast<uint32_t>(shaderStages.size());
+		pipelineCI.pStages = shaderStages.data();
+		pipelineCI.layout = layout->handle;
+		pipelineCI.renderPass = renderPass->handle;
+	}
+	void createHandle() {
+		CPU_PROFILE_SCOPE("Create pipeline");
+		if (bindPoint == VK_PIPELINE_BIND_POINT_COMPUTE) {
+			VK_CHECK_RESULT(vkCreateComputePipelines(device, cache, 1, &computePipelineCI, nullptr, &pso));
+		} else {
+			VK_CHECK_RESULT(vkCreateGraphicsPipelines(device, cache, 1, &pipelineCI, nullptr, &pso));
+		}
+	}
+	static void finalizeBatch(const std::vector<Pipeline*>& pipelines) {
+		for (auto& pipeline : pipelines) {
+			assert((pipeline->device == pipelines[0]->device) && (pipeline->cache == pipelines[0]->cache) && (pipeline->bindPoint == VK_PIPELINE_BIND_POINT_GRAPHICS));
+			pipeline->finalizeCreateInfo();
+		}
+	}
+	static void createBatchHandles(const std::vector<Pipeline*>& pipelines) {
+		CPU_PROFILE_SCOPE("Create pipeline batch");
+		std::vector<VkGraphicsPipelineCreateInfo> createInfos;
+		for (auto& pipeline : pipelines) {
+			createInfos.push_back(pipeline->pipelineCI);
+		}
+		std::vector<VkPipeline> handles(pipelines.size());
+		VK_CHECK_RESULT(vkCreateGraphicsPipelines(pipelines[0]->device, pipelines[0]->cache, static_cast<uint32_t>(createInfos.size()), createInfos.data(), nullptr, handles.data()));
+		for (size_t i = 0; i < pipelines.size(); i++) {
+			pipelines[i]->pso = handles[i];
+		}
+	}
 public:
 	Pipeline(VkDevice device) {
 		this->device = device;
 	}
 	~Pipeline() {
 		// @todo: destroy shader modules
+		wait();
 		vkDestroyPipeline(device, pso, nullptr);
 	}
 	void create() {
-		assert(layout);
-		pipelineCI.stageCount = static_cast<uint32_t>(shaderStages.size());
-		pipelineCI.pStages = shaderStages.data();
-		pipelineCI.layout = layout->handle;
-		pipelineCI.renderPass = renderPass->handle;
-		VK_CHECK_RESULT(vkCreateGraphicsPipelines(device, cache, 1, &pipelineCI, nullptr, &pso));
+		finalizeCreateInfo();
+		createHandle();
+	}
+	/** @brief Creates the pipeline on one of the pool's threads, call wait() before using the pipeline */
+	void createAsync(vks::ThreadPool& threadPool) {
+		finalizeCreateInfo();
+		std::shared_ptr<std::promise<void>> created = std::make_shared<std::promise<void>>();
+		pending = created->get_future().share();
+		threadPool.addJob([this, created] {
+			createHandle();
+			created->set_value();
+		});
+	}
+	/** @brief Creates several graphics pipelines sharing the same device and cache with a single call */
+	static void createBatch(const std::vector<Pipeline*>& pipelines) {
+		if (pipelines.empty()) {
+			return;
+		}
+		finalizeBatch(pipelines);
+		createBatchHandles(pipelines);
+	}
+	/** @brief Creates several graphics pipelines with a single call on one of the pool's threads, call wait() before using any of them */
+	static void createBatchAsync(const std::vector<Pipeline*>& pipelines, vks::ThreadPool& threadPool) {
+		if (pipelines.empty()) {
+			return;
+		}
+		finalizeBatch(pipelines);
+		std::shared_ptr<std::promise<void>> created = std::make_shared<std::promise<void>>();
+		std::shared_future<void> pending = created->get_future().share();
+		for (auto& pipeline : pipelines) {
+			pipeline->pending = pending;
+		}
+		threadPool.addJob([pipelines, created] {
+			createBatchHandles(pipelines);
+			created->set_value();
+		});
+	}
+	/** @brief Blocks until a pipeline started with createAsync() or createBatchAsync() has been created */
+	void wait() {
+		if (pending.valid()) {
+			pending.get();
+		}
 	}
 	void addShader(std::string filename) {
 		size_t extpos = filename.find('.');
@@ -50,6 +176,8 @@ public:
 		VkShaderStageFlagBits shaderStage = VK_SHADER_STAGE_FLAG_BITS_MAX_ENUM;
 		if (ext == "vert") { shaderStage = VK_SHADER_STAGE_VERTEX_BIT; }
 		if (ext == "frag") { shaderStage = VK_SHADER_STAGE_FRAGMENT_BIT; }
+		// A compute shader makes this a compute pipeline, which doesn't need a create info or render pass
+		if (ext == "comp") { shaderStage = VK_SHADER_STAGE_COMPUTE_BIT; bindPoint = VK_PIPELINE_BIND_POINT_COMPUTE; }
 		assert(shaderStage != VK_SHADER_STAGE_FLAG_BITS_MAX_ENUM);
 
 		VkPipelineShaderStageCreateInfo shaderStageCI{};
@@ -74,6 +202,35 @@ public:
 	void setCreateInfo(VkGraphicsPipelineCreateInfo pipelineCI) {
 		this->pipelineCI = pipelineCI;
 		this->bindPoint = VK_PIPELINE_BIND_POINT_GRAPHICS;
+		// Deep copy all referenced states (pNext chains of the states are not copied)
+		if (copyState(pipelineCI.pVertexInputState, state.vertexInput)) {
+			state.vertexInput.pVertexBindingDescriptions = copyArray(state.vertexInput.pVertexBindingDescriptions, state.vertexInput.vertexBindingDescriptionCount, state.vertexBindings);
+			state.vertexInput.pVertexAttributeDescriptions = copyArray(state.vertexInput.pVertexAttributeDescriptions, state.vertexInput.vertexAttributeDescriptionCount, state.vertexAttributes);
+			this->pipelineCI.pVertexInputState = &state.vertexInput;
+		}
+		this->pipelineCI.pInputAssemblyState = copyState(pipelineCI.pInputAssemblyState, state.inputAssembly);
+		this->pipelineCI.pTessellationState = copyState(pipelineCI.pTessellationState, state.tessellation);
+		if (copyState(pipelineCI.pViewportState, state.viewport)) {
+			state.viewport.pViewports = copyArray(state.viewport.pViewports, state.viewport.viewportCount, state.viewports);
+			state.viewport.pScissors = copyArray(state.viewport.pScissors, state.viewport.scissorCount, state.scissors);
+			this->pipelineCI.pViewportState = &state.viewport;
+		}
+		this->pipelineCI.pRasterizationState = copyState(pipelineCI.pRasterizationState, state.rasterization);
+		this->pipelineCI.pMultisampleState = copyState(pipelineCI.pMultisampleState, state.multisample);
+		this->pipelineCI.pDepthStencilState = copyState(pipelineCI.pDepthStencilState, state.depthStencil);
+		if (copyState(pipelineCI.pColorBlendState, state.colorBlend)) {
+			state.colorBlend.pAttachments = copyArray(state.colorBlend.pAttachments, state.colorBlend.attachmentCount, state.blendAttachments);
+			this->pipelineCI.pColorBlendState = &state.colorBlend;
+		}
+		if (copyState(pipelineCI.pDynamicState, state.dynamic)) {
+			state.dynamic.pDynamicStates = copyArray(state.dynamic.pDynamicStates, state.dynamic.dynamicStateCount, state.dynamicStates);
+			this->pipelineCI.pDynamicState = &state.dynamic;
+		}
+	}
+	/** @brief Sets specialization constants for all shader stages, stages that don't declare a constant ignore it */
+	void setSpecializationConstants(const std::vector<VkSpecializationMapEntry>& entries, const void* data, size_t size) {
+		specializationEntries = entries;
+		specializationData.assign((const uint8_t*)data, (const uint8_t*)data + size);
 	}
 	void setCache(VkPipelineCache cache) {
 		this->cache = cache;
@@ -23,6 +23,8 @@ private:
 	std::vector<VkSubpassDependency> subpassDependencies;
 	std::vector<VkSubpassDescription> subpassDescriptions;
 	std::vector<VkClearValue> clearValues;
+	uint32_t viewMask = 0;
+	uint32_t correlationMask = 0;
 public:
 	VkRenderPass handle;
 	RenderPass(VkDevice device) {
@@ -40,6 +42,17 @@ public:
 		CI.pSubpasses = subpassDescriptions.data();
 		CI.dependencyCount = static_cast<uint32_t>(subpassDependencies.size());
 		CI.pDependencies = subpassDependencies.data();
+		// With multiview, all subpasses render to the views selected by the view mask
+		VkRenderPassMultiviewCreateInfo multiviewCI{};
+		std::vector<uint32_t> viewMasks(subpassDescriptions.size(), viewMask);
+		if (viewMask != 0) {
+			multiviewCI.sType = VK_STRUCTURE_TYPE_RENDER_PASS_MULTIVIEW_CREATE_INFO;
+			multiviewCI.subpassCount = static_cast<uint32_t>(viewMasks.size());
+			multiviewCI.pViewMasks = viewMasks.data();
+			multiviewCI.correlationMaskCount = 1;
+			multiviewCI.pCorrelationMasks = &correlationMask;
+			CI.pNext = &multiviewCI;
+		}
 		VK_CHECK_RESULT(vkCreateRenderPass(device, &CI, nullptr, &handle));
 	}
 	VkRenderPassBeginInfo getBeginInfo() {
@@ -80,6 +93,11 @@ public:
 	void addSubpassDependency(VkSubpassDependency dependency) {
 		subpassDependencies.push_back(dependency);
 	}
+	/** @brief Renders every subpass to all views set in viewMask (requires the multiview feature), views in correlationMask may be rendered concurrently */
+	void setMultiviewMasks(uint32_t viewMask, uint32_t correlationMask) {
+		this->viewMask = viewMask;
+		this->correlationMask = correlationMask;
+	}
 	void addSubpassDescription(VkSubpassDescription description) {
 		subpassDescriptions.push_back(description);
 	}
@@ -14,6 +14,7 @@
 
 #include "vulkan/vulkan.h"
 #include "VulkanTools.h"
+#include "VulkanMemoryAllocator.hpp"
 
 namespace vks
 {	
@@ -26,6 +27,9 @@ namespace vks
 		VkDevice device;
 		VkBuffer buffer = VK_NULL_HANDLE;
 		VkDeviceMemory memory = VK_NULL_HANDLE;
+		/** @brief Range of the memory block backing this buffer, if the buffer was created using an allocator */
+		vks::Allocation allocation;
+		vks::MemoryAllocator* allocator = nullptr;
 		VkDescriptorBufferInfo descriptor;
 		VkDeviceSize size = 0;
 		VkDeviceSize alignment = 0;
@@ -46,6 +50,13 @@ namespace vks
 		*/
 		VkResult map(VkDeviceSize size = VK_WHOLE_SIZE, VkDeviceSize offset = 0)
 		{
+			if (allocator)
+			{
+				// Memory blocks of the allocator are persistently mapped
+				assert(allocation.mapped);
+				mapped = static_cast<uint8_t*>(allocation.mapped) + offset;
+				return VK_SUCCESS;
+			}
 			return vkMapMemory(device, memory, offset, size, 0, &mapped);
 		}
 
@@ -58,7 +69,10 @@ namespace vks
 		{
 			if (mapped)
 			{
-				vkUnmapMemory(device, memory);
+				if (!allocator)
+				{
+					vkUnmapMemory(device, memory);
+				}
 				mapped = nullptr;
 			}
 		}
@@ -72,7 +86,22 @@ namespace vks
 		*/
 		VkResult bind(VkDeviceSize offset = 0)
 		{
-			return vkBindBufferMemory(device, buffer, memory, offset);
+			return vkBindBufferMemory(device, buffer, memory, allocation.offset + offset);
+		}
+
+		/**
+		* Get the range of the device memory object for a range of this buffer
+		*
+		* @note With an allocator the buffer only covers a part of the memory block, so the range must not extend past the allocation
+		*/
+		VkMappedMemoryRange getMappedRange(VkDeviceSize size, VkDeviceSize offset)
+		{
+			VkMappedMemoryRange mappedRange = {};
+			mappedRange.sType = VK_STRUCTURE_TYPE_MAPPED_MEMORY_RANGE;
+			mappedRange.memory = memory;
+			mappedRange.offset = allocation.offset + offset;
+			mappedRange.size = ((size == VK_WHOLE_SIZE) && allocator) ? allocation.size - offset : size;
+			return mappedRange;
 		}
 
 		/**
@@ -114,11 +143,7 @@ namespace vks
 		*/
 		VkResult flush(VkDeviceSize size = VK_WHOLE_SIZE, VkDeviceSize offset = 0)
 		{
-			VkMappedMemoryRange mappedRange = {};
-			mappedRange.sType = VK_STRUCTURE_TYPE_MAPPED_MEMORY_RANGE;
-			mappedRange.memory = memory;
-			mappedRange.offset = offset;
-			mappedRange.size = size;
+			VkMappedMemoryRange mappedRange = getMappedRange(size, offset);
 			return vkFlushMappedMemoryRanges(device, 1, &mappedRange);
 		}
 
@@ -134,11 +159,7 @@ namespace vks
 		*/
 		VkResult invalidate(VkDeviceSize size = VK_WHOLE_SIZE, VkDeviceSize offset = 0)
 		{
-			VkMappedMemoryRange mappedRange = {};
-			mappedRange.sType = VK_STRUCTURE_TYPE_MAPPED_MEMORY_RANGE;
-			mappedRange.memory = memory;
-			mappedRange.offset = offset;
-			mappedRange.size = size;
+			VkMappedMemoryRange mappedRange = getMappedRange(size, offset);
 			return vkInvalidateMappedMemoryRanges(device, 1, &mappedRange);
 		}
 
@@ -151,7 +172,11 @@ namespace vks
 			{
 				vkDestroyBuffer(device, buffer, nullptr);
 			}
-			if (memory)
+			if (allocator)
+			{
+				allocator->free(allocation);
+			}
+			else if (memory)
 			{
 				vkFreeMemory(device, memory, nullptr);
 			}
@@ -25,24 +25,28 @@ VkResult VulkanExampleBase::createInstance(bool enableValidation)
 	appInfo.pEngineName = name.c_str();
 	appInfo.apiVersion = apiVersion;
 
-	std::vector<const char*> instanceExtensions = { VK_KHR_SURFACE_EXTENSION_NAME };
+	std::vector<const char*> instanceExtensions;
 
-	// Enable surface extensions depending on os
+	// Surface extensions are only required for presenting to a window, headless mode renders to offscreen images
+	if (!settings.headless) {
+		instanceExtensions.push_back(VK_KHR_SURFACE_EXTENSION_NAME);
+		// Enable surface extensions depending on os
 #if defined(_WIN32)
-	instanceExtensions.push_back(VK_KHR_WIN32_SURFACE_EXTENSION_NAME);
+		instanceExtensions.push_back(VK_KHR_WIN32_SURFACE_EXTENSION_NAME);
 #elif defined(VK_USE_PLATFORM_ANDROID_KHR)
-	instanceExtensions.push_back(VK_KHR_ANDROID_SURFACE_EXTENSION_NAME);
+		instanceExtensions.push_back(VK_KHR_ANDROID_SURFACE_EXTENSION_NAME);
 #elif defined(_DIRECT2DISPLAY)
-	instanceExtensions.push_back(VK_KHR_DISPLAY_EXTENSION_NAME);
+		instanceExtensions.push_back(VK_KHR_DISPLAY_EXTENSION_NAME);
 #elif defined(VK_USE_PLATFORM_WAYLAND_KHR)
-	instanceExtensions.push_back(VK_KHR_WAYLAND_SURFACE_EXTENSION_NAME);
+		instanceExtensions.push_back(VK_KHR_WAYLAND_SURFACE_EXTENSION_NAME);
 #elif defined(VK_USE_PLATFORM_XCB_KHR)
-	instanceExtensions.push_back(VK_KHR_XCB_SURFACE_EXTENSION_NAME);
+		instanceExtensions.push_back(VK_KHR_XCB_SURFACE_EXTENSION_NAME);
 #elif defined(VK_USE_PLATFORM_IOS_MVK)
-	instanceExtensions.push_back(VK_MVK_IOS_SURFACE_EXTENSION_NAME);
+		instanceExtensions.push_back(VK_MVK_IOS_SURFACE_EXTENSION_NAME);
 #elif defined(VK_USE_PLATFORM_MACOS_MVK)
-	instanceExtensions.push_back(VK_MVK_MACOS_SURFACE_EXTENSION_NAME);
+		instanceExtensions.push_back(VK_MVK_MACOS_SURFACE_EXTENSION_NAME);
 #endif
+	}
 
 	if (enabledInstanceExtensions.size() > 0) {
 		for (auto enabledExtension : enabledInstanceExtensions) {
@@ -54,12 +58,12 @@ VkResult VulkanExampleBase::createInstance(bool enableValidation)
 	instanceCreateInfo.sType = VK_STRUCTURE_TYPE_INSTANCE_CREATE_INFO;
 	instanceCreateInfo.pNext = NULL;
 	instanceCreateInfo.pApplicationInfo = &appInfo;
+	if (settings.validation)
+	{
+		instanceExtensions.push_back(VK_EXT_DEBUG_UTILS_EXTENSION_NAME);
+	}
 	if (instanceExtensions.size() > 0)
 	{
-		if (settings.validation)
-		{
-			instanceExtensions.push_back(VK_EXT_DEBUG_UTILS_EXTENSION_NAME);
-		}
 		instanceCreateInfo.enabledExtensionCount = (uint32_t)instanceExtensions.size();
 		instanceCreateInfo.ppEnabledExtensionNames = instanceExtensions.data();
 	}
@@ -123,6 +127,21 @@ void VulkanExampleBase::createCommandBuffers()
 		commandBuffer->setPool(commandPool);
 		commandBuffer->create();
 	}
+	if (settings.dynamicCommandBuffers) {
+		// Command buffers recorded every frame are allocated from a transient pool per frame in flight
+		// Instead of freeing or resetting single command buffers, the whole pool is reset once the frame's fence has been signaled
+		frameCommandPools.resize(settings.framesInFlight);
+		frameCommandBuffers.resize(settings.framesInFlight);
+		for (uint32_t i = 0; i < settings.framesInFlight; i++) {
+			frameCommandPools[i] = new CommandPool(device);
+			frameCommandPools[i]->setFlags(VK_COMMAND_POOL_CREATE_TRANSIENT_BIT);
+			frameCommandPools[i]->setQueueFamilyIndex(vulkanDevice->queueFamilyIndices.graphics);
+			frameCommandPools[i]->create();
+			frameCommandBuffers[i] = new CommandBuffer(device);
+			frameCommandBuffers[i]->setPool(frameCommandPools[i]);
+			frameCommandBuffers[i]->create();
+		}
+	}
 }
 
 void VulkanExampleBase::destroyCommandBuffers()
@@ -130,6 +149,14 @@ void VulkanExampleBase::destroyCommandBuffers()
 	for (auto& commandBuffer : commandBuffers) {
 		delete(commandBuffer);
 	}
+	for (auto& commandBuffer : frameCommandBuffers) {
+		delete(commandBuffer);
+	}
+	for (auto& commandPool : frameCommandPools) {
+		delete(commandPool);
+	}
+	frameCommandBuffers.clear();
+	frameCommandPools.clear();
 }
 
 // @todo: remove
@@ -181,13 +208,74 @@ void VulkanExampleBase::flushCommandBuffer(VkCommandBuffer commandBuffer, VkQueu
 
 void VulkanExampleBase::createPipelineCache()
 {
+	std::vector<char> cacheData;
+	if (settings.persistentPipelineCache) {
+		std::ifstream is(pipelineCacheFilename, std::ios::binary | std::ios::ate);
+		if (is.is_open()) {
+			const std::streamoff size = is.tellg();
+			if (size > 0) {
+				cacheData.resize((size_t)size);
+				is.seekg(0, std::ios::beg);
+				is.read(cacheData.data(), size);
+			}
+			is.close();
+		}
+		if (!cacheData.empty() && !isPipelineCacheCompatible(cacheData)) {
+			std::cout << "Pipeline cache \"" << pipelineCacheFilename << "\" was created by a different device or driver and will be ignored" << std::endl;
+			cacheData.clear();
+		}
+	}
+
 	VkPipelineCacheCreateInfo pipelineCacheCreateInfo = {};
 	pipelineCacheCreateInfo.sType = VK_STRUCTURE_TYPE_PIPELINE_CACHE_CREATE_INFO;
+	pipelineCacheCreateInfo.initialDataSize = cacheData.size();
+	pipelineCacheCreateInfo.pInitialData = cacheData.empty() ? nullptr : cacheData.data();
 	VK_CHECK_RESULT(vkCreatePipelineCache(device, &pipelineCacheCreateInfo, nullptr, &pipelineCache));
 }
 
+bool VulkanExampleBase::isPipelineCacheCompatible(const std::vector<char>& cacheData)
+{
+	// The cache starts with a VkPipelineCacheHeaderVersionOne header (see the spec's vkGetPipelineCacheData)
+	const size_t headerSize = 16 + VK_UUID_SIZE;
+	if (cacheData.size() < headerSize) {
+		return false;
+	}
+	uint32_t header[4];
+	memcpy(header, cacheData.data(), sizeof(header));
+	if ((header[0] < headerSize) || (header[1] != VK_PIPELINE_CACHE_HEADER_VERSION_ONE)) {
+		return false;
+	}
+	if ((header[2] != vulkanDevice->properties.vendorID) || (header[3] != vulkanDevice->properties.deviceID)) {
+		return false;
+	}
+	return memcmp(cacheData.data() + sizeof(header), vulkanDevice->properties.pipelineCacheUUID, VK_UUID_SIZE) == 0;
+}
+
+void VulkanExampleBase::savePipelineCache()
+{
+	size_t size = 0;
+	VK_CHECK_RESULT(vkGetPipelineCacheData(device, pipelineCache, &size, nullptr));
+	if (size == 0) {
+		return;
+	}
+	std::vector<char> cacheData(size);
+	VK_CHECK_RESULT(vkGetPipelineCacheData(device, pipelineCache, &size, cacheData.data()));
+	// Write to a temporary file first so an interrupted write can't leave a truncated cache behind
+	const std::string tempFilename = pipelineCacheFilename + ".tmp";
+	std::ofstream os(tempFilename, std::ios::binary | std::ios::trunc);
+	if (!os.is_open()) {
+		std::cerr << "Could not write pipeline cache to \"" << pipelineCacheFilename << "\"" << std::endl;
+		return;
+	}
+	os.write(cacheData.data(), size);
+	os.close();
+	std::remove(pipelineCacheFilename.c_str());
+	std::rename(tempFilename.c_str(), pipelineCacheFilename.c_str());
+}
+
 void VulkanExampleBase::prepare()
 {
+	CPU_PROFILE_SCOPE("Prepare base");
 	if (vulkanDevice->enableDebugMarkers) {
 		vks::debugmarker::setup(device);
 	}
@@ -210,6 +298,7 @@ void VulkanExampleBase::prepare()
 		};
 		UIOverlay.prepareResources();
 		UIOverlay.preparePipeline(pipelineCache, renderPass->handle);
+		UIOverlay.buffers.resize(swapChain.imageCount);
 	}
 }
 
@@ -231,6 +320,7 @@ VkPipelineShaderStageCreateInfo VulkanExampleBase::loadShader(std::string fileNa
 
 void VulkanExampleBase::renderFrame()
 {
+	CPU_PROFILE_SCOPE("Frame");
 	auto tStart = std::chrono::high_resolution_clock::now();
 	if (viewUpdated)
 	{
@@ -277,11 +367,14 @@ void VulkanExampleBase::renderFrame()
 void VulkanExampleBase::renderLoop()
 {
 	if (benchmark.active) {
-		benchmark.run([=] { render(); }, vulkanDevice->properties);
+		benchmark.run([=] { render(); }, vulkanDevice->properties, [=](const vks::BenchmarkScenario::Keyframe& keyframe, float timestep) { applyBenchmarkKeyframe(keyframe, timestep); });
 		vkDeviceWaitIdle(device);
 		if (benchmark.filename != "") {
 			benchmark.saveResults();
 		}
+		if ((benchmark.baselineFilename != "") && !benchmark.compareToBaseline()) {
+			exitCode = 1;
+		}
 		return;
 	}
 
@@ -565,6 +658,7 @@ void VulkanExampleBase::renderLoop()
 
 void VulkanExampleBase::updateOverlay()
 {
+	CPU_PROFILE_SCOPE("Update overlay");
 	if (!settings.overlay)
 		return;
 
@@ -591,6 +685,11 @@ void VulkanExampleBase::updateOverlay()
 	ImGui::PushStyleVar(ImGuiStyleVar_ItemSpacing, ImVec2(0.0f, 5.0f * UIOverlay.scale));
 #endif
 	ImGui::PushItemWidth(110.0f * UIOverlay.scale);
+#if defined(ENABLE_CPU_PROFILER)
+	if (ImGui::Button("Save CPU trace")) {
+		vks::CpuProfiler::get().saveTrace(cpuTraceFilename != "" ? cpuTraceFilename : "cputrace.json");
+	}
+#endif
 	OnUpdateUIOverlay(&UIOverlay);
 	ImGui::PopItemWidth();
 #if defined(VK_USE_PLATFORM_ANDROID_KHR)
@@ -601,8 +700,11 @@ void VulkanExampleBase::updateOverlay()
 	ImGui::PopStyleVar();
 	ImGui::Render();
 
-	if (UIOverlay.update() || UIOverlay.updated) {
-		buildCommandBuffers();
+	// Vertex and index data is uploaded in prepareFrame, once the buffers for the next frame are no longer in use
+	if (UIOverlay.updated) {
+		if (!settings.dynamicCommandBuffers) {
+			buildCommandBuffers();
+		}
 		UIOverlay.updated = false;
 	}
 
@@ -613,7 +715,7 @@ void VulkanExampleBase::updateOverlay()
 #endif
 }
 
-void VulkanExampleBase::drawUI(const VkCommandBuffer commandBuffer)
+void VulkanExampleBase::drawUI(const VkCommandBuffer commandBuffer, uint32_t frameIndex)
 {
 	if (settings.overlay) {
 		const VkViewport viewport = vks::initializers::viewport((float)width, (float)height, 0.0f, 1.0f);
@@ -621,36 +723,82 @@ void VulkanExampleBase::drawUI(const VkCommandBuffer commandBuffer)
 		vkCmdSetViewport(commandBuffer, 0, 1, &viewport);
 		vkCmdSetScissor(commandBuffer, 0, 1, &scissor);
 
-		UIOverlay.draw(commandBuffer);
+		UIOverlay.draw(commandBuffer, frameIndex);
 	}
 }
 
-void VulkanExampleBase::prepareFrame()
+bool VulkanExampleBase::prepareFrame()
 {
-	// Acquire the next image from the swap chain
-	VkResult result = swapChain.acquireNextImage(semaphores.presentComplete, &currentBuffer);
-	// Recreate the swapchain if it's no longer compatible with the surface (OUT_OF_DATE) or no longer optimal for presentation (SUBOPTIMAL)
-	if ((result == VK_ERROR_OUT_OF_DATE_KHR) || (result == VK_SUBOPTIMAL_KHR)) {
-		windowResize();
+	// Wait until the GPU has finished the last submission of this frame in flight, so its semaphores and fence can be reused
+	{
+		CPU_PROFILE_SCOPE("Wait for frame fence");
+		VK_CHECK_RESULT(vkWaitForFences(device, 1, &waitFences[currentFrame], VK_TRUE, UINT64_MAX));
+	}
+	if (settings.dynamicCommandBuffers) {
+		// The GPU is done with this frame's command buffer, so it can be recorded again
+		frameCommandPools[currentFrame]->reset();
+	}
+	if (settings.headless) {
+		// Without a presentation engine the offscreen images are used in a round-robin fashion
+		currentBuffer = (currentBuffer + 1) % swapChain.imageCount;
 	}
 	else {
-		VK_CHECK_RESULT(result);
+		// Acquire the next image from the swap chain
+		CPU_PROFILE_SCOPE("Acquire swap chain image");
+		VkResult result = swapChain.acquireNextImage(semaphores.presentComplete[currentFrame], &currentBuffer);
+		// Recreate the swapchain if it's no longer compatible with the surface (OUT_OF_DATE)
+		// No image has been acquired then, so the frame is skipped and its fence is left signaled for the next attempt
+		if (result == VK_ERROR_OUT_OF_DATE_KHR) {
+			windowResize();
+			return false;
+		}
+		// A SUBOPTIMAL image has still been acquired (and its semaphore will be signaled), so it's rendered and presented and the swap chain is recreated after presentation
+		if (result != VK_SUBOPTIMAL_KHR) {
+			VK_CHECK_RESULT(result);
+		}
 	}
+	// The acquired image (and the per-image resources like command buffers and uniform buffers) may still be used by an earlier frame in flight
+	if (imagesInFlight[currentBuffer] != VK_NULL_HANDLE) {
+		VK_CHECK_RESULT(vkWaitForFences(device, 1, &imagesInFlight[currentBuffer], VK_TRUE, UINT64_MAX));
+	}
+	imagesInFlight[currentBuffer] = waitFences[currentFrame];
+	// The fence is signaled again by the submission of this frame
+	VK_CHECK_RESULT(vkResetFences(device, 1, &waitFences[currentFrame]));
+	submitInfo.pWaitSemaphores = &semaphores.presentComplete[currentFrame];
+	// Presentation waits on this, so it's tied to the image and not to the frame in flight
+	submitInfo.pSignalSemaphores = &semaphores.renderComplete[currentBuffer];
+	// Upload the UI overlay's vertex data for this image
+	// Only this image's command buffer draws from these buffers and it's no longer in use, so it can be recorded again without waiting for the device
+	// Command buffers that are recorded every frame pick up changed buffers and counts anyway
+	if (settings.overlay && UIOverlay.update(currentBuffer) && !settings.dynamicCommandBuffers) {
+		buildCommandBuffer(currentBuffer);
+	}
+	return true;
 }
 
 void VulkanExampleBase::submitFrame()
 {
-	VkResult result = swapChain.queuePresent(queue, currentBuffer, semaphores.renderComplete);
-	if (!((result == VK_SUCCESS) || (result == VK_SUBOPTIMAL_KHR))) {
-		if (result == VK_ERROR_OUT_OF_DATE_KHR) {
-			// Swap chain is no longer compatible with the surface and needs to be recreated
+	if (settings.headless) {
+		// Nothing to present, the frame's fence is all that's needed to synchronize with the GPU
+		currentFrame = (currentFrame + 1) % settings.framesInFlight;
+		return;
+	}
+	VkResult result;
+	{
+		CPU_PROFILE_SCOPE("Present");
+		result = swapChain.queuePresent(queue, currentBuffer, semaphores.renderComplete[currentBuffer]);
+	}
+	// No need to wait for the queue to become idle, the next frame in flight is synchronized by its own fence
+	currentFrame = (currentFrame + 1) % settings.framesInFlight;
+	if (result != VK_SUCCESS) {
+		if ((result == VK_ERROR_OUT_OF_DATE_KHR) || (result == VK_SUBOPTIMAL_KHR)) {
+			// Swap chain is no longer compatible with the surface (or no longer optimal for it) and needs to be recreated
 			windowResize();
 			return;
 		} else {
 			VK_CHECK_RESULT(result);
 		}
 	}
-	VK_CHECK_RESULT(vkQueueWaitIdle(queue));
 }
 
 VulkanExampleBase::VulkanExampleBase(bool enableValidation)
@@ -699,6 +847,13 @@ VulkanExampleBase::VulkanExampleBase(bool enableValidation)
 			benchmark.active = true;
 			vks::tools::errorModeSilent = true;
 		}
+		// Headless rendering without a window or swap chain
+		// As there is no window to drive the render loop, this implies benchmark mode
+		if ((args[i] == std::string("-hl")) || (args[i] == std::string("--headless"))) {
+			settings.headless = true;
+			benchmark.active = true;
+			vks::tools::errorModeSilent = true;
+		}
 		// Warmup time (in seconds)
 		if ((args[i] == std::string("-bw")) || (args[i] == std::string("--benchwarmup"))) {
 			if (args.size() > i + 1) {
@@ -732,10 +887,71 @@ VulkanExampleBase::VulkanExampleBase(bool enableValidation)
 				}
 			}
 		}
+		// Scripted camera path for the benchmark (replaces the run duration)
+		if ((args[i] == std::string("-bs")) || (args[i] == std::string("--benchscenario"))) {
+			if (args.size() > i + 1) {
+				if (args[i + 1][0] == '-') {
+					std::cerr << "Filename for benchmark scenario must not start with a hyphen!" << std::endl;
+				} else if (!benchmark.scenario.loadFromFile(args[i + 1])) {
+					std::cerr << "Benchmark scenario could not be loaded, using the run duration instead" << std::endl;
+				}
+			}
+		}
+		// Compare the benchmark results against a previous run's results (JSON)
+		if ((args[i] == std::string("-bb")) || (args[i] == std::string("--benchbaseline"))) {
+			if (args.size() > i + 1) {
+				if (args[i + 1][0] == '-') {
+					std::cerr << "Filename for benchmark baseline must not start with a hyphen!" << std::endl;
+				} else {
+					benchmark.baselineFilename = args[i + 1];
+				}
+			}
+		}
+		// Relative slowdown (in percent) compared to the baseline that counts as a regression
+		if ((args[i] == std::string("-bth")) || (args[i] == std::string("--benchthreshold"))) {
+			if (args.size() > i + 1) {
+				double num = strtod(args[i + 1], &numConvPtr);
+				if (numConvPtr != args[i + 1]) {
+					benchmark.regressionThreshold = num;
+				}
+				else {
+					std::cerr << "Benchmark regression threshold must be specified as a number!" << std::endl;
+				}
+			}
+		}
+		// Save a trace of the CPU profiler's scopes on exit
+		if ((args[i] == std::string("-cpt")) || (args[i] == std::string("--cputrace"))) {
+			if (args.size() > i + 1) {
+				if (args[i + 1][0] == '-') {
+					std::cerr << "Filename for CPU trace must not start with a hyphen!" << std::endl;
+				} else {
+					cpuTraceFilename = args[i + 1];
+				}
+			}
+		}
 		// Output frame times to benchmark result file
 		if ((args[i] == std::string("-bt")) || (args[i] == std::string("--benchframetimes"))) {
 			benchmark.outputFrameTimes = true;
 		}
+		// Record command buffers every frame
+		if ((args[i] == std::string("-dcb")) || (args[i] == std::string("--dynamiccommandbuffers"))) {
+			settings.dynamicCommandBuffers = true;
+		}
+		// Don't load or store the pipeline cache from/to disk
+		if ((args[i] == std::string("-npc")) || (args[i] == std::string("--nopipelinecache"))) {
+			settings.persistentPipelineCache = false;
+		}
+		// Number of frames in flight
+		if ((args[i] == std::string("-fif")) || (args[i] == std::string("--framesinflight"))) {
+			if (args.size() > i + 1) {
+				uint32_t num = strtol(args[i + 1], &numConvPtr, 10);
+				if ((numConvPtr != args[i + 1]) && (num > 0)) {
+					settings.framesInFlight = num;
+				} else {
+					std::cerr << "Number of frames in flight must be specified as a number greater than zero!" << std::endl;
+				}
+			}
+		}
 	}
 	
 #if defined(VK_USE_PLATFORM_ANDROID_KHR)
@@ -745,9 +961,13 @@ VulkanExampleBase::VulkanExampleBase(bool enableValidation)
 #elif defined(_DIRECT2DISPLAY)
 
 #elif defined(VK_USE_PLATFORM_WAYLAND_KHR)
-	initWaylandConnection();
+	if (!settings.headless) {
+		initWaylandConnection();
+	}
 #elif defined(VK_USE_PLATFORM_XCB_KHR)
-	initxcbConnection();
+	if (!settings.headless) {
+		initxcbConnection();
+	}
 #endif
 
 #if defined(_WIN32)
@@ -763,8 +983,20 @@ VulkanExampleBase::VulkanExampleBase(bool enableValidation)
 
 VulkanExampleBase::~VulkanExampleBase()
 {
+#if defined(ENABLE_CPU_PROFILER)
+	if (cpuTraceFilename != "") {
+		vks::CpuProfiler::get().saveTrace(cpuTraceFilename);
+	}
+#endif
 	// Clean up Vulkan resources
-	swapChain.cleanup();
+	if (settings.headless) {
+		for (auto& target : headlessTargets) {
+			delete target.view;
+			delete target.image;
+		}
+	} else {
+		swapChain.cleanup();
+	}
 	destroyCommandBuffers();
 	vkDestroyRenderPass(device, renderPass->handle, nullptr);
 	for (uint32_t i = 0; i < frameBuffers.size(); i++)
@@ -780,10 +1012,18 @@ VulkanExampleBase::~VulkanExampleBase()
 	vkDestroyImage(device, depthStencil.image, nullptr);
 	vkFreeMemory(device, depthStencil.mem, nullptr);
 
+	// The cache was created from the data loaded at startup, so it now holds both the old and all newly created pipelines
+	if (settings.persistentPipelineCache) {
+		savePipelineCache();
+	}
 	vkDestroyPipelineCache(device, pipelineCache, nullptr);
 
-	vkDestroySemaphore(device, semaphores.presentComplete, nullptr);
-	vkDestroySemaphore(device, semaphores.renderComplete, nullptr);
+	for (auto& semaphore : semaphores.presentComplete) {
+		vkDestroySemaphore(device, semaphore, nullptr);
+	}
+	for (auto& semaphore : semaphores.renderComplete) {
+		vkDestroySemaphore(device, semaphore, nullptr);
+	}
 	for (auto& fence : waitFences) {
 		vkDestroyFence(device, fence, nullptr);
 	}
@@ -804,23 +1044,27 @@ VulkanExampleBase::~VulkanExampleBase()
 #if defined(_DIRECT2DISPLAY)
 
 #elif defined(VK_USE_PLATFORM_WAYLAND_KHR)
-	xdg_toplevel_destroy(xdg_toplevel);
-	xdg_surface_destroy(xdg_surface);
-	wl_surface_destroy(surface);
-	if (keyboard)
-		wl_keyboard_destroy(keyboard);
-	if (pointer)
-		wl_pointer_destroy(pointer);
-	wl_seat_destroy(seat);
-	xdg_wm_base_destroy(shell);
-	wl_compositor_destroy(compositor);
-	wl_registry_destroy(registry);
-	wl_display_disconnect(display);
+	if (!settings.headless) {
+		xdg_toplevel_destroy(xdg_toplevel);
+		xdg_surface_destroy(xdg_surface);
+		wl_surface_destroy(surface);
+		if (keyboard)
+			wl_keyboard_destroy(keyboard);
+		if (pointer)
+			wl_pointer_destroy(pointer);
+		wl_seat_destroy(seat);
+		xdg_wm_base_destroy(shell);
+		wl_compositor_destroy(compositor);
+		wl_registry_destroy(registry);
+		wl_display_disconnect(display);
+	}
 #elif defined(VK_USE_PLATFORM_ANDROID_KHR)
 	// todo : android cleanup (if required)
 #elif defined(VK_USE_PLATFORM_XCB_KHR)
-	xcb_destroy_window(connection, window);
-	xcb_disconnect(connection);
+	if (!settings.headless) {
+		xcb_destroy_window(connection, window);
+		xcb_disconnect(connection);
+	}
 #endif
 }
 
@@ -932,7 +1176,8 @@ bool VulkanExampleBase::initVulkan()
 	// This is handled by a separate class that gets a logical device representation
 	// and encapsulates functions related to a device
 	vulkanDevice = new vks::VulkanDevice(physicalDevice);
-	VkResult res = vulkanDevice->createLogicalDevice(enabledFeatures, enabledDeviceExtensions, deviceCreatepNextChain);
+	// The swap chain extension is not required (and may not be available) when rendering headless
+	VkResult res = vulkanDevice->createLogicalDevice(enabledFeatures, enabledDeviceExtensions, deviceCreatepNextChain, !settings.headless);
 	if (res != VK_SUCCESS) {
 		vks::tools::exitFatal("Could not create Vulkan device: \n" + vks::tools::errorString(res), res);
 		return false;
@@ -946,26 +1191,18 @@ bool VulkanExampleBase::initVulkan()
 	VkBool32 validDepthFormat = vks::tools::getSupportedDepthFormat(physicalDevice, &depthFormat);
 	assert(validDepthFormat);
 
-	swapChain.connect(instance, physicalDevice, device);
-
-	// Create synchronization objects
-	VkSemaphoreCreateInfo semaphoreCreateInfo = vks::initializers::semaphoreCreateInfo();
-	// Create a semaphore used to synchronize image presentation
-	// Ensures that the image is displayed before we start submitting new commands to the queu
-	VK_CHECK_RESULT(vkCreateSemaphore(device, &semaphoreCreateInfo, nullptr, &semaphores.presentComplete));
-	// Create a semaphore used to synchronize command submission
-	// Ensures that the image is not presented until all commands have been sumbitted and executed
-	VK_CHECK_RESULT(vkCreateSemaphore(device, &semaphoreCreateInfo, nullptr, &semaphores.renderComplete));
+	if (!settings.headless) {
+		swapChain.connect(instance, physicalDevice, device);
+	}
 
 	// Set up submit info structure
-	// Semaphores will stay the same during application lifetime
+	// Semaphores are set per frame in flight by prepareFrame
 	// Command buffer submission info is set by each example
+	// In headless mode there is no presentation engine to synchronize with, so no semaphores are used
 	submitInfo = vks::initializers::submitInfo();
 	submitInfo.pWaitDstStageMask = &submitPipelineStages;
-	submitInfo.waitSemaphoreCount = 1;
-	submitInfo.pWaitSemaphores = &semaphores.presentComplete;
-	submitInfo.signalSemaphoreCount = 1;
-	submitInfo.pSignalSemaphores = &semaphores.renderComplete;
+	submitInfo.waitSemaphoreCount = settings.headless ? 0 : 1;
+	submitInfo.signalSemaphoreCount = settings.headless ? 0 : 1;
 
 #if defined(VK_USE_PLATFORM_ANDROID_KHR)
 	// Get Android device name and manufacturer (to display along GPU name)
@@ -1986,23 +2223,58 @@ void VulkanExampleBase::keyPressed(uint32_t) {}
 
 void VulkanExampleBase::mouseMoved(double x, double y, bool & handled) {}
 
+void VulkanExampleBase::applyBenchmarkKeyframe(const vks::BenchmarkScenario::Keyframe& keyframe, float timestep)
+{
+	camera.setPosition(keyframe.position);
+	camera.setRotation(keyframe.rotation);
+	timer = keyframe.timer;
+	frameTimer = timestep;
+}
+
 void VulkanExampleBase::buildCommandBuffers() {}
 
+void VulkanExampleBase::buildCommandBuffer(uint32_t bufferIndex)
+{
+	buildCommandBuffers();
+}
+
 void VulkanExampleBase::createSynchronizationPrimitives()
 {
-	// Wait fences to sync command buffer access
+	// Semaphores and fences are created per frame in flight, so the CPU can record and submit the next frame while the GPU is still busy
+	VkSemaphoreCreateInfo semaphoreCreateInfo = vks::initializers::semaphoreCreateInfo();
+	semaphores.presentComplete.resize(settings.framesInFlight);
+	for (uint32_t i = 0; i < settings.framesInFlight; i++) {
+		// Ensures that the image is displayed before we start submitting new commands to the queue
+		VK_CHECK_RESULT(vkCreateSemaphore(device, &semaphoreCreateInfo, nullptr, &semaphores.presentComplete[i]));
+	}
+	createRenderCompleteSemaphores();
+	// Wait fences to sync command buffer access (created signaled, so the first wait on each of them doesn't block)
 	VkFenceCreateInfo fenceCreateInfo = vks::initializers::fenceCreateInfo(VK_FENCE_CREATE_SIGNALED_BIT);
-	waitFences.resize(commandBuffers.size());
+	waitFences.resize(settings.framesInFlight);
 	for (auto& fence : waitFences) {
 		VK_CHECK_RESULT(vkCreateFence(device, &fenceCreateInfo, nullptr, &fence));
 	}
+	imagesInFlight.assign(swapChain.imageCount, VK_NULL_HANDLE);
+}
+
+void VulkanExampleBase::createRenderCompleteSemaphores()
+{
+	for (auto& semaphore : semaphores.renderComplete) {
+		vkDestroySemaphore(device, semaphore, nullptr);
+	}
+	// Ensures that the image is not presented until all commands have been sumbitted and executed
+	VkSemaphoreCreateInfo semaphoreCreateInfo = vks::initializers::semaphoreCreateInfo();
+	semaphores.renderComplete.resize(swapChain.imageCount);
+	for (auto& semaphore : semaphores.renderComplete) {
+		VK_CHECK_RESULT(vkCreateSemaphore(device, &semaphoreCreateInfo, nullptr, &semaphore));
+	}
 }
 
 void VulkanExampleBase::createCommandPool()
 {
 	commandPool = new CommandPool(device);
 	commandPool->setFlags(VK_COMMAND_POOL_CREATE_RESET_COMMAND_BUFFER_BIT);
-	commandPool->setQueueFamilyIndex(swapChain.queueNodeIndex);
+	commandPool->setQueueFamilyIndex(settings.headless ? vulkanDevice->queueFamilyIndices.graphics : swapChain.queueNodeIndex);
 	commandPool->create();
 }
 
@@ -2017,7 +2289,7 @@ void VulkanExampleBase::setupDepthStencil()
 	imageCI.arrayLayers = 1;
 	imageCI.samples = VK_SAMPLE_COUNT_1_BIT;
 	imageCI.tiling = VK_IMAGE_TILING_OPTIMAL;
-	imageCI.usage = VK_IMAGE_USAGE_DEPTH_STENCIL_ATTACHMENT_BIT | VK_IMAGE_USAGE_TRANSFER_SRC_BIT;
+	imageCI.usage = depthStencil.usage;
 
 	VK_CHECK_RESULT(vkCreateImage(device, &imageCI, nullptr, &depthStencil.image));
 	VkMemoryRequirements memReqs{};
@@ -2102,7 +2374,7 @@ void VulkanExampleBase::setupRenderPass()
 		VK_ATTACHMENT_LOAD_OP_DONT_CARE,
 		VK_ATTACHMENT_STORE_OP_DONT_CARE,
 		VK_IMAGE_LAYOUT_UNDEFINED,
-		VK_IMAGE_LAYOUT_PRESENT_SRC_KHR
+		settings.headless ? VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL : VK_IMAGE_LAYOUT_PRESENT_SRC_KHR
 	});
 	// Depth attachment
 	renderPass->addAttachmentDescription({
@@ -2135,6 +2407,16 @@ void VulkanExampleBase::setupRenderPass()
 		VK_ACCESS_MEMORY_READ_BIT,
 		VK_DEPENDENCY_BY_REGION_BIT,
 	});
+	// The depth attachment is shared by all frames in flight, so depth writes of the previous frame need to be finished
+	renderPass->addSubpassDependency({
+		VK_SUBPASS_EXTERNAL,
+		0,
+		VK_PIPELINE_STAGE_EARLY_FRAGMENT_TESTS_BIT | VK_PIPELINE_STAGE_LATE_FRAGMENT_TESTS_BIT,
+		VK_PIPELINE_STAGE_EARLY_FRAGMENT_TESTS_BIT | VK_PIPELINE_STAGE_LATE_FRAGMENT_TESTS_BIT,
+		VK_ACCESS_DEPTH_STENCIL_ATTACHMENT_WRITE_BIT,
+		VK_ACCESS_DEPTH_STENCIL_ATTACHMENT_READ_BIT | VK_ACCESS_DEPTH_STENCIL_ATTACHMENT_WRITE_BIT,
+		0,
+	});
 	renderPass->setColorClearValue(0, { 0.0f, 0.0f, 0.0f, 0.0f });
 	renderPass->setDepthStencilClearValue(1, 1.0f, 0.0f);
 	renderPass->create();
@@ -2160,6 +2442,9 @@ void VulkanExampleBase::windowResize()
 	width = destWidth;
 	height = destHeight;
 	setupSwapChain();
+	if (semaphores.renderComplete.size() != swapChain.imageCount) {
+		createRenderCompleteSemaphores();
+	}
 
 	// Recreate the frame buffers
 	vkDestroyImageView(device, depthStencil.view, nullptr);
@@ -2174,6 +2459,7 @@ void VulkanExampleBase::windowResize()
 	if ((width > 0.0f) && (height > 0.0f)) {
 		if (settings.overlay) {
 			UIOverlay.resize(width, height);
+			UIOverlay.buffers.resize(swapChain.imageCount);
 		}
 	}
 
@@ -2181,16 +2467,18 @@ void VulkanExampleBase::windowResize()
 	// references to the recreated frame buffer
 	destroyCommandBuffers();
 	createCommandBuffers();
-	buildCommandBuffers();
-
-	vkDeviceWaitIdle(device);
+	imagesInFlight.assign(swapChain.imageCount, VK_NULL_HANDLE);
 
 	if ((width > 0.0f) && (height > 0.0f)) {
 		camera.updateAspectRatio((float)width / (float)height);
 	}
 
-	// Notify derived class
+	// Notify derived class before recording, as the command buffers may refer to resources it recreates
 	windowResized();
+	buildCommandBuffers();
+
+	vkDeviceWaitIdle(device);
+
 	viewChanged();
 
 	prepared = true;
@@ -2241,6 +2529,9 @@ void VulkanExampleBase::windowResized()
 
 void VulkanExampleBase::initSwapchain()
 {
+	if (settings.headless) {
+		return;
+	}
 #if defined(_WIN32)
 	swapChain.initSurface(windowInstance, window);
 #elif defined(VK_USE_PLATFORM_ANDROID_KHR)	
@@ -2258,7 +2549,46 @@ void VulkanExampleBase::initSwapchain()
 
 void VulkanExampleBase::setupSwapChain()
 {
+	if (settings.headless) {
+		setupHeadlessTargets();
+		return;
+	}
 	swapChain.create(&width, &height, settings.vsync);
 }
 
+void VulkanExampleBase::setupHeadlessTargets()
+{
+	for (auto& target : headlessTargets) {
+		delete target.view;
+		delete target.image;
+	}
+	// One image per frame in flight, these take the place of the swap chain images
+	swapChain.colorFormat = VK_FORMAT_B8G8R8A8_UNORM;
+	// Transfer source allows reading back the rendered images
+	swapChain.imageUsage = VK_IMAGE_USAGE_COLOR_ATTACHMENT_BIT | VK_IMAGE_USAGE_TRANSFER_SRC_BIT;
+	swapChain.imageCount = settings.framesInFlight;
+	swapChain.images.resize(swapChain.imageCount);
+	swapChain.buffers.resize(swapChain.imageCount);
+	headlessTargets.resize(swapChain.imageCount);
+	for (uint32_t i = 0; i < swapChain.imageCount; i++) {
+		HeadlessTarget& target = headlessTargets[i];
+		target.image = new Image(vulkanDevice);
+		target.image->setType(VK_IMAGE_TYPE_2D);
+		target.image->setFormat(swapChain.colorFormat);
+		target.image->setExtent({ width, height, 1 });
+		target.image->setTiling(VK_IMAGE_TILING_OPTIMAL);
+		target.image->setUsage(swapChain.imageUsage);
+		target.image->create();
+		target.view = new ImageView(vulkanDevice);
+		target.view->setType(VK_IMAGE_VIEW_TYPE_2D);
+		target.view->setFormat(swapChain.colorFormat);
+		target.view->setSubResourceRange({ VK_IMAGE_ASPECT_COLOR_BIT, 0, 1, 0, 1 });
+		target.view->setImage(target.image);
+		target.view->create();
+		swapChain.images[i] = target.image->handle;
+		swapChain.buffers[i].image = target.image->handle;
+		swapChain.buffers[i].view = target.view->handle;
+	}
+}
+
 void VulkanExampleBase::OnUpdateUIOverlay(vks::UIOverlay *overlay) {}
\ No newline at end of file
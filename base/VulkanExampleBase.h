@@ -53,10 +53,13 @@
 #include "VulkanSwapChain.hpp"
 #include "camera.hpp"
 #include "benchmark.hpp"
+#include "CpuProfiler.hpp"
 
 #include "CommandBuffer.hpp"
 #include "CommandPool.hpp"
 #include "RenderPass.hpp"
+#include "Image.hpp"
+#include "ImageView.hpp"
 
 class VulkanExampleBase
 {
@@ -106,6 +109,9 @@ protected:
 	VkSubmitInfo submitInfo;
 	CommandPool* commandPool;
 	std::vector<CommandBuffer*> commandBuffers;
+	// Transient command pools and command buffers per frame in flight, used when command buffers are recorded every frame
+	std::vector<CommandPool*> frameCommandPools;
+	std::vector<CommandBuffer*> frameCommandBuffers;
 	RenderPass* renderPass;
 	// List of available frame buffers (same as number of swap chain images)
 	std::vector<VkFramebuffer>frameBuffers;
@@ -116,16 +122,29 @@ protected:
 	std::vector<VkShaderModule> shaderModules;
 	// Pipeline cache object
 	VkPipelineCache pipelineCache;
+	// File the pipeline cache is persisted to between runs
+	std::string pipelineCacheFilename = "pipelinecache.bin";
 	// Wraps the swap chain to present images (framebuffers) to the windowing system
 	VulkanSwapChain swapChain;
+	// Offscreen color images that take the place of the swap chain images in headless mode
+	struct HeadlessTarget {
+		Image* image;
+		ImageView* view;
+	};
+	std::vector<HeadlessTarget> headlessTargets;
 	// Synchronization semaphores
 	struct {
-		// Swap chain image presentation
-		VkSemaphore presentComplete;
-		// Command buffer submission and execution
-		VkSemaphore renderComplete;
+		// Swap chain image presentation (one per frame in flight)
+		std::vector<VkSemaphore> presentComplete;
+		// Command buffer submission and execution (one per swap chain image, as the presentation engine may still wait on it after the frame's fence has been signaled)
+		std::vector<VkSemaphore> renderComplete;
 	} semaphores;
+	// Fences signaled once the GPU has finished a frame in flight
 	std::vector<VkFence> waitFences;
+	// Fence of the frame that is currently using a swap chain image (not owned)
+	std::vector<VkFence> imagesInFlight;
+	// Index of the current frame in flight
+	uint32_t currentFrame = 0;
 public: 
 	bool prepared = false;
 	uint32_t width = 1280;
@@ -139,6 +158,10 @@ public:
 	const std::string getAssetPath();
 
 	vks::Benchmark benchmark;
+	// Returned by the example's main function, non-zero if a benchmark regressed compared to its baseline
+	int exitCode = 0;
+	// CPU profiler trace (Chrome trace format) written on exit, only used if built with ENABLE_CPU_PROFILER
+	std::string cpuTraceFilename = "";
 
 	/** @brief Encapsulated physical and logical vulkan device */
 	vks::VulkanDevice *vulkanDevice;
@@ -153,6 +176,14 @@ public:
 		bool vsync = false;
 		/** @brief Enable UI overlay */
 		bool overlay = false;
+		/** @brief Number of frames the CPU may record and submit ahead of the GPU */
+		uint32_t framesInFlight = 2;
+		/** @brief Render into offscreen images instead of a swap chain, no window or surface is created */
+		bool headless = false;
+		/** @brief Record the current frame's command buffer every frame instead of pre-recording the command buffers of all swap chain images */
+		bool dynamicCommandBuffers = false;
+		/** @brief Load the pipeline cache from disk at startup and write it back at exit */
+		bool persistentPipelineCache = true;
 	} settings;
 
 	VkClearColorValue defaultClearColor = { { 0.025f, 0.025f, 0.025f, 1.0f } };
@@ -189,6 +220,8 @@ public:
 		VkImage image;
 		VkDeviceMemory mem;
 		VkImageView view;
+		// Can be extended by derived classes before prepare(), e.g. to sample from the depth buffer
+		VkImageUsageFlags usage = VK_IMAGE_USAGE_DEPTH_STENCIL_ATTACHMENT_BIT | VK_IMAGE_USAGE_TRANSFER_SRC_BIT;
 	} depthStencil;
 
 	struct {
@@ -333,12 +366,19 @@ public:
 	// Called when the window has been resized
 	// Can be overriden in derived class to recreate or rebuild resources attached to the frame buffer / swapchain
 	virtual void windowResized();
+	/** @brief (Virtual) Called before each frame of a scripted benchmark, sets the camera and animation timer to the keyframe's values */
+	virtual void applyBenchmarkKeyframe(const vks::BenchmarkScenario::Keyframe& keyframe, float timestep);
 	// Pure virtual function to be overriden by the dervice class
 	// Called in case of an event where e.g. the framebuffer has to be rebuild and thus
 	// all command buffers that may reference this
 	virtual void buildCommandBuffers();
+	// Rebuilds the command buffer of a single swap chain image that is no longer in use by the GPU
+	// Called when only that image's command buffer is outdated (e.g. the UI overlay's draw counts changed), defaults to rebuilding all command buffers
+	virtual void buildCommandBuffer(uint32_t bufferIndex);
 
 	void createSynchronizationPrimitives();
+	// (Re)creates the per swap chain image semaphores, the image count may change when the swap chain is recreated
+	void createRenderCompleteSemaphores();
 
 	// Creates a new (graphics) command pool object storing command buffers
 	void createCommandPool();
@@ -358,6 +398,8 @@ public:
 	void initSwapchain();
 	// Create swap chain images
 	void setupSwapChain();
+	// Create the offscreen images used instead of swap chain images in headless mode
+	void setupHeadlessTargets();
 
 	// Create command buffers for drawing commands
 	void createCommandBuffers();
@@ -372,8 +414,12 @@ public:
 	// Note : Waits for the queue to become idle
 	void flushCommandBuffer(VkCommandBuffer commandBuffer, VkQueue queue, bool free);
 
-	// Create a cache pool for rendering pipelines
+	// Create a cache pool for rendering pipelines, initialized from disk if a compatible cache file exists
 	void createPipelineCache();
+	// Checks the header of serialized pipeline cache data against the current device and driver
+	bool isPipelineCacheCompatible(const std::vector<char>& cacheData);
+	// Write the pipeline cache to disk
+	void savePipelineCache();
 
 	// Prepare commonly used Vulkan functions
 	virtual void prepare();
@@ -388,14 +434,17 @@ public:
 	void renderFrame();
 
 	void updateOverlay();
-	void drawUI(const VkCommandBuffer commandBuffer);
+	void drawUI(const VkCommandBuffer commandBuffer, uint32_t frameIndex);
 
 	// Prepare the frame for workload submission
+	// - Waits until the GPU has finished with the current frame in flight
 	// - Acquires the next image from the swap chain 
 	// - Sets the default wait and signal semaphores
-	void prepareFrame();
+	// Returns false if no image could be acquired (e.g. the swap chain was out of date and has been recreated), nothing must be submitted for this frame then
+	bool prepareFrame();
 
 	// Submit the frames' workload 
+	// - Presents the current swap chain image and advances to the next frame in flight
 	void submitFrame();
 
 	/** @brief (Virtual) Called when the UI overlay is updating, can be used to add custom elements to the overlay */
@@ -420,11 +469,14 @@ int APIENTRY WinMain(HINSTANCE hInstance, HINSTANCE, LPSTR, int)									\
 	for (int32_t i = 0; i < __argc; i++) { VulkanExample::args.push_back(__argv[i]); };  			\
 	vulkanExample = new VulkanExample();															\
 	vulkanExample->initVulkan();																	\
-	vulkanExample->setupWindow(hInstance, WndProc);													\
+	if (!vulkanExample->settings.headless) {														\
+		vulkanExample->setupWindow(hInstance, WndProc);												\
+	}																								\
 	vulkanExample->prepare();																		\
 	vulkanExample->renderLoop();																	\
+	const int exitCode = vulkanExample->exitCode;													\
 	delete(vulkanExample);																			\
-	return 0;																						\
+	return exitCode;																				\
 }																									
 #elif defined(VK_USE_PLATFORM_ANDROID_KHR)
 // Android entry point
@@ -455,8 +507,9 @@ int main(const int argc, const char *argv[])													    \
 	vulkanExample->initVulkan();																	\
 	vulkanExample->prepare();																		\
 	vulkanExample->renderLoop();																	\
+	const int exitCode = vulkanExample->exitCode;													\
 	delete(vulkanExample);																			\
-	return 0;																						\
+	return exitCode;																				\
 }
 #elif defined(VK_USE_PLATFORM_WAYLAND_KHR)
 #define VULKAN_EXAMPLE_MAIN()																		\
@@ -466,11 +519,14 @@ int main(const int argc, const char *argv[])													    \
 	for (size_t i = 0; i < argc; i++) { VulkanExample::args.push_back(argv[i]); };  				\
 	vulkanExample = new VulkanExample();															\
 	vulkanExample->initVulkan();																	\
-	vulkanExample->setupWindow();					 												\
+	if (!vulkanExample->settings.headless) {														\
+		vulkanExample->setupWindow();																\
+	}																								\
 	vulkanExample->prepare();																		\
 	vulkanExample->renderLoop();																	\
+	const int exitCode = vulkanExample->exitCode;													\
 	delete(vulkanExample);																			\
-	return 0;																						\
+	return exitCode;																				\
 }
 #elif defined(VK_USE_PLATFORM_XCB_KHR)
 #define VULKAN_EXAMPLE_MAIN()																		\
@@ -487,11 +543,14 @@ int main(const int argc, const char *argv[])													    \
 	for (size_t i = 0; i < argc; i++) { VulkanExample::args.push_back(argv[i]); };  				\
 	vulkanExample = new VulkanExample();															\
 	vulkanExample->initVulkan();																	\
-	vulkanExample->setupWindow();					 												\
+	if (!vulkanExample->settings.headless) {														\
+		vulkanExample->setupWindow();																\
+	}																								\
 	vulkanExample->prepare();																		\
 	vulkanExample->renderLoop();																	\
+	const int exitCode = vulkanExample->exitCode;													\
 	delete(vulkanExample);																			\
-	return 0;																						\
+	return exitCode;																				\
 }
 #elif (defined(VK_USE_PLATFORM_IOS_MVK) || defined(VK_USE_PLATFORM_MACOS_MVK))
 #define VULKAN_EXAMPLE_MAIN()
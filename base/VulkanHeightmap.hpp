@@ -8,10 +8,28 @@
 
 #include <glm/glm.hpp>
 #include <glm/glm.hpp>
+#include <vector>
+#include <algorithm>
+#include <cfloat>
+#include <cmath>
+#include <cassert>
+#include <thread>
+#include <chrono>
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#include <emmintrin.h>
+#define HEIGHTMAP_SSE2
+#elif defined(__ARM_NEON) || defined(__ARM_NEON__)
+#include <arm_neon.h>
+#define HEIGHTMAP_NEON
+#endif
 
 #include "vulkan/vulkan.h"
 #include "VulkanDevice.hpp"
 #include "VulkanBuffer.hpp"
+#include "VulkanInitializers.hpp"
+#include "frustum.hpp"
+#include "CpuProfiler.hpp"
+#include "threadpool.hpp"
 #include <ktx.h>
 #include <ktxvulkan.h>
 
@@ -20,17 +38,48 @@ namespace vks
 	class HeightMap
 	{
 	private:
-		uint16_t *heightdata;
+		uint16_t *heightdata = nullptr;
 		uint32_t dim;
 		uint32_t scale;
 
 		vks::VulkanDevice *device = nullptr;
 		VkQueue copyQueue = VK_NULL_HANDLE;
+		// Kept alive between generations, so regenerating at runtime doesn't pay for spawning threads
+		vks::ThreadPool threadPool;
 	public:
 		enum Topology { topologyTriangles, topologyQuads };
+		// Compact vertices only store the height and normal, the vertex shader derives x/z and the uv from the vertex index
+		enum VertexFormat { vertexFormatDefault, vertexFormatCompact };
 
 		float heightScale = 4.0f;
 		float uvScale = 1.0f;
+		// Number of quads along the edge of a quadtree node, regardless of its level
+		uint32_t nodeResolution = 32;
+		// Nodes closer to the viewer than lodDistance times their size are replaced by their children
+		float lodDistance = 1.5f;
+		// Depth of the skirts hiding cracks between nodes of different detail, relative to the height scale
+		float skirtDepth = 0.25f;
+
+		struct Node {
+			// World space bounds, including the skirts
+			glm::vec3 min = glm::vec3(FLT_MAX);
+			glm::vec3 max = glm::vec3(-FLT_MAX);
+			uint32_t firstIndex = 0;
+			uint32_t indexCount = 0;
+			uint32_t level = 0;
+			// Children are stored contiguously
+			uint32_t firstChild = 0;
+			uint32_t childCount = 0;
+		};
+		// Quadtree of the terrain, nodes[0] is the root
+		std::vector<Node> nodes;
+
+		// Result of a culled draw, nodes outside a frustum are counted once for the whole subtree
+		struct CullingStatistics {
+			uint32_t drawnNodes = 0;
+			uint32_t culledNodes = 0;
+			uint32_t drawnIndices = 0;
+		};
 
 		vks::Buffer vertexBuffer;
 		vks::Buffer indexBuffer;
@@ -43,6 +92,28 @@ namespace vks
 			glm::vec4 pad1;
 		};
 
+		struct CompactVertex {
+			// Unnormalized height
+			uint16_t height;
+			// Octahedral encoded normal
+			int16_t normal[2];
+			// Keeps vertices 4 byte aligned
+			uint16_t pad;
+		};
+
+		// Grid parameters the vertex shader needs to reconstruct compact vertices, passed as specialization constants
+		struct CompactVertexParameters {
+			uint32_t patchSize;
+			float scaleX;
+			float scaleZ;
+			float heightScale;
+			float skirtOffset;
+			float uvScale;
+		};
+
+		VertexFormat vertexFormat = vertexFormatDefault;
+		// Time spent on generating the grid vertices in milliseconds
+		double generationTime = 0.0;
 		size_t vertexBufferSize = 0;
 		size_t indexBufferSize = 0;
 		uint32_t indexCount = 0;
@@ -60,6 +131,229 @@ namespace vks
 			delete[] heightdata;
 		}
 
+		// Generates the indices and bounds of a node covering size x size quads of the grid, starting at x0, y0
+		void generateNode(Node& node, uint32_t x0, uint32_t y0, uint32_t size, uint32_t patchsize, Topology topology, const std::vector<Vertex>& vertices, std::vector<uint32_t>& indices)
+		{
+			const uint32_t quads = patchsize - 1;
+			const uint32_t x1 = std::min(x0 + size, quads);
+			const uint32_t y1 = std::min(y0 + size, quads);
+			const uint32_t step = size / nodeResolution;
+			const uint32_t skirtOffset = patchsize * patchsize;
+
+			// Grid coordinates sampled by this node, the last row and column are clamped to the grid
+			std::vector<uint32_t> xs, ys;
+			for (uint32_t x = x0; x < x1; x += step) {
+				xs.push_back(x);
+			}
+			xs.push_back(x1);
+			for (uint32_t y = y0; y < y1; y += step) {
+				ys.push_back(y);
+			}
+			ys.push_back(y1);
+
+			node.firstIndex = static_cast<uint32_t>(indices.size());
+			auto addQuad = [&](uint32_t a, uint32_t b, uint32_t c, uint32_t d) {
+				if (topology == topologyTriangles) {
+					indices.insert(indices.end(), { a, b, c, c, d, a });
+				} else {
+					indices.insert(indices.end(), { a, b, c, d });
+				}
+			};
+			for (size_t y = 0; y < ys.size() - 1; y++) {
+				for (size_t x = 0; x < xs.size() - 1; x++) {
+					addQuad(xs[x] + ys[y] * patchsize, xs[x] + ys[y + 1] * patchsize, xs[x + 1] + ys[y + 1] * patchsize, xs[x + 1] + ys[y] * patchsize);
+				}
+			}
+			// Skirts along all four edges
+			for (size_t x = 0; x < xs.size() - 1; x++) {
+				for (uint32_t y : { y0, y1 }) {
+					const uint32_t a = xs[x] + y * patchsize;
+					const uint32_t b = xs[x + 1] + y * patchsize;
+					addQuad(a, a + skirtOffset, b + skirtOffset, b);
+				}
+			}
+			for (size_t y = 0; y < ys.size() - 1; y++) {
+				for (uint32_t x : { x0, x1 }) {
+					const uint32_t a = x + ys[y] * patchsize;
+					const uint32_t b = x + ys[y + 1] * patchsize;
+					addQuad(a, a + skirtOffset, b + skirtOffset, b);
+				}
+			}
+			node.indexCount = static_cast<uint32_t>(indices.size()) - node.firstIndex;
+
+			// Bounds include all grid vertices of the area, not only the sampled ones, so they stay conservative for every level
+			for (uint32_t y = y0; y <= y1; y++) {
+				for (uint32_t x = x0; x <= x1; x++) {
+					node.min = glm::min(node.min, vertices[x + y * patchsize].pos);
+					node.max = glm::max(node.max, vertices[x + y * patchsize].pos);
+				}
+			}
+			// The skirts extend the bounds along positive y
+			node.max.y += vertices[skirtOffset].pos.y - vertices[0].pos.y;
+		}
+
+		static std::vector<VkVertexInputBindingDescription> getVertexInputBindings(VertexFormat vertexFormat)
+		{
+			const uint32_t stride = (vertexFormat == vertexFormatCompact) ? sizeof(CompactVertex) : sizeof(Vertex);
+			return { vks::initializers::vertexInputBindingDescription(0, stride, VK_VERTEX_INPUT_RATE_VERTEX) };
+		}
+
+		static std::vector<VkVertexInputAttributeDescription> getVertexInputAttributes(VertexFormat vertexFormat)
+		{
+			if (vertexFormat == vertexFormatCompact) {
+				return {
+					vks::initializers::vertexInputAttributeDescription(0, 0, VK_FORMAT_R16_UNORM, offsetof(CompactVertex, height)),
+					vks::initializers::vertexInputAttributeDescription(0, 1, VK_FORMAT_R16G16_SNORM, offsetof(CompactVertex, normal)),
+				};
+			}
+			return {
+				vks::initializers::vertexInputAttributeDescription(0, 0, VK_FORMAT_R32G32B32_SFLOAT, offsetof(Vertex, pos)),
+				vks::initializers::vertexInputAttributeDescription(0, 1, VK_FORMAT_R32G32B32_SFLOAT, offsetof(Vertex, normal)),
+				vks::initializers::vertexInputAttributeDescription(0, 2, VK_FORMAT_R32G32_SFLOAT, offsetof(Vertex, uv)),
+			};
+		}
+
+		/** @brief Returns the parameters for compact vertices of a grid with the given size and scale, matches the constant ids of the compact terrain shaders */
+		CompactVertexParameters getCompactVertexParameters(uint32_t patchsize, glm::vec3 scale)
+		{
+			CompactVertexParameters parameters;
+			parameters.patchSize = patchsize;
+			parameters.scaleX = scale.x;
+			parameters.scaleZ = scale.z;
+			parameters.heightScale = heightScale * scale.y;
+			parameters.skirtOffset = skirtDepth * heightScale * scale.y;
+			parameters.uvScale = uvScale;
+			return parameters;
+		}
+
+		static std::vector<VkSpecializationMapEntry> getCompactVertexSpecializationEntries()
+		{
+			return {
+				vks::initializers::specializationMapEntry(0, offsetof(CompactVertexParameters, patchSize), sizeof(uint32_t)),
+				vks::initializers::specializationMapEntry(1, offsetof(CompactVertexParameters, scaleX), sizeof(float)),
+				vks::initializers::specializationMapEntry(2, offsetof(CompactVertexParameters, scaleZ), sizeof(float)),
+				vks::initializers::specializationMapEntry(3, offsetof(CompactVertexParameters, heightScale), sizeof(float)),
+				vks::initializers::specializationMapEntry(4, offsetof(CompactVertexParameters, skirtOffset), sizeof(float)),
+				vks::initializers::specializationMapEntry(5, offsetof(CompactVertexParameters, uvScale), sizeof(float)),
+			};
+		}
+
+		// Maps a unit vector onto the octahedron and unfolds the lower half onto the corners of the [-1..1] square, quantized to 16 bit snorm
+		static void encodeOctahedral(glm::vec3 n, int16_t* encoded)
+		{
+			n /= (std::abs(n.x) + std::abs(n.y) + std::abs(n.z));
+			glm::vec2 p = glm::vec2(n.x, n.y);
+			if (n.z < 0.0f) {
+				p.x = (1.0f - std::abs(n.y)) * (n.x >= 0.0f ? 1.0f : -1.0f);
+				p.y = (1.0f - std::abs(n.x)) * (n.y >= 0.0f ? 1.0f : -1.0f);
+			}
+			encoded[0] = static_cast<int16_t>(std::round(glm::clamp(p.x, -1.0f, 1.0f) * 32767.0f));
+			encoded[1] = static_cast<int16_t>(std::round(glm::clamp(p.y, -1.0f, 1.0f) * 32767.0f));
+		}
+
+	private:
+		// Grid parameters shared by the vertex generation kernels
+		struct GridInfo {
+			const float* heights;
+			uint32_t patchsize;
+			glm::vec3 scale;
+			float uvScale;
+		};
+
+		// Writes everything but position and normal, and stores the vertex for the given central differences (dx, dy)
+		static void writeVertex(const GridInfo& grid, uint32_t x, uint32_t y, float height, float dx, float dy, Vertex& vertex)
+		{
+			vertex.pos = glm::vec3(((float)x * 2.0f + 1.0f - (float)grid.patchsize) * grid.scale.x, -height * grid.scale.y + 1.0f, ((float)y * 2.0f + 1.0f - (float)grid.patchsize) * grid.scale.z);
+			vertex.uv = glm::vec2((float)x / grid.patchsize, (float)y / grid.patchsize) * grid.uvScale;
+			// normalize(cross(vec3(1, 0, dx), vec3(0, 1, dy)))
+			const float invLength = 1.0f / std::sqrt(dx * dx + dy * dy + 1.0f);
+			vertex.normal = glm::vec3(-dx * invLength, -dy * invLength, invLength);
+		}
+
+		/** @brief Scalar reference for the vertex generation of the grid rows [y0, y1) */
+		static void generateRowsScalar(const GridInfo& grid, uint32_t y0, uint32_t y1, Vertex* vertices)
+		{
+			const uint32_t n = grid.patchsize;
+			for (uint32_t y = y0; y < y1; y++) {
+				const float* row = grid.heights + y * n;
+				const float* rowUp = grid.heights + (y > 0 ? y - 1 : y) * n;
+				const float* rowDown = grid.heights + (y < n - 1 ? y + 1 : y) * n;
+				// One sided differences at the borders are doubled to match the central differences
+				const float dyScale = (y == 0 || y == n - 1) ? 2.0f : 1.0f;
+				for (uint32_t x = 0; x < n; x++) {
+					float dx = row[x < n - 1 ? x + 1 : x] - row[x > 0 ? x - 1 : x];
+					if (x == 0 || x == n - 1) {
+						dx *= 2.0f;
+					}
+					writeVertex(grid, x, y, row[x], dx, (rowDown[x] - rowUp[x]) * dyScale, vertices[x + y * n]);
+				}
+			}
+		}
+
+		/** @brief Vectorized vertex generation of the grid rows [y0, y1), processes four interior vertices at once and falls back to the scalar path for the borders */
+		static void generateRows(const GridInfo& grid, uint32_t y0, uint32_t y1, Vertex* vertices)
+		{
+#if defined(HEIGHTMAP_SSE2) || defined(HEIGHTMAP_NEON)
+			const uint32_t n = grid.patchsize;
+			if (n < 6) {
+				generateRowsScalar(grid, y0, y1, vertices);
+				return;
+			}
+			for (uint32_t y = y0; y < y1; y++) {
+				const float* row = grid.heights + y * n;
+				const float* rowUp = grid.heights + (y > 0 ? y - 1 : y) * n;
+				const float* rowDown = grid.heights + (y < n - 1 ? y + 1 : y) * n;
+				const float dyScale = (y == 0 || y == n - 1) ? 2.0f : 1.0f;
+				const float posZ = ((float)y * 2.0f + 1.0f - (float)n) * grid.scale.z;
+				const float uvY = (float)y / n * grid.uvScale;
+				float nx[4], ny[4], nz[4], posY[4];
+				uint32_t x = 1;
+				for (; x + 4 <= n - 1; x += 4) {
+#if defined(HEIGHTMAP_SSE2)
+					const __m128 dx = _mm_sub_ps(_mm_loadu_ps(row + x + 1), _mm_loadu_ps(row + x - 1));
+					const __m128 dy = _mm_mul_ps(_mm_sub_ps(_mm_loadu_ps(rowDown + x), _mm_loadu_ps(rowUp + x)), _mm_set1_ps(dyScale));
+					const __m128 one = _mm_set1_ps(1.0f);
+					const __m128 invLength = _mm_div_ps(one, _mm_sqrt_ps(_mm_add_ps(_mm_add_ps(_mm_mul_ps(dx, dx), _mm_mul_ps(dy, dy)), one)));
+					const __m128 zero = _mm_setzero_ps();
+					_mm_storeu_ps(nx, _mm_sub_ps(zero, _mm_mul_ps(dx, invLength)));
+					_mm_storeu_ps(ny, _mm_sub_ps(zero, _mm_mul_ps(dy, invLength)));
+					_mm_storeu_ps(nz, invLength);
+					_mm_storeu_ps(posY, _mm_sub_ps(one, _mm_mul_ps(_mm_loadu_ps(row + x), _mm_set1_ps(grid.scale.y))));
+#else
+					const float32x4_t dx = vsubq_f32(vld1q_f32(row + x + 1), vld1q_f32(row + x - 1));
+					const float32x4_t dy = vmulq_n_f32(vsubq_f32(vld1q_f32(rowDown + x), vld1q_f32(rowUp + x)), dyScale);
+					const float32x4_t lengthSq = vaddq_f32(vaddq_f32(vmulq_f32(dx, dx), vmulq_f32(dy, dy)), vdupq_n_f32(1.0f));
+					// Reciprocal square root estimate refined by two Newton-Raphson steps
+					float32x4_t invLength = vrsqrteq_f32(lengthSq);
+					invLength = vmulq_f32(invLength, vrsqrtsq_f32(vmulq_f32(lengthSq, invLength), invLength));
+					invLength = vmulq_f32(invLength, vrsqrtsq_f32(vmulq_f32(lengthSq, invLength), invLength));
+					vst1q_f32(nx, vnegq_f32(vmulq_f32(dx, invLength)));
+					vst1q_f32(ny, vnegq_f32(vmulq_f32(dy, invLength)));
+					vst1q_f32(nz, invLength);
+					vst1q_f32(posY, vmlsq_n_f32(vdupq_n_f32(1.0f), vld1q_f32(row + x), grid.scale.y));
+#endif
+					for (uint32_t i = 0; i < 4; i++) {
+						Vertex& vertex = vertices[x + i + y * n];
+						vertex.pos = glm::vec3(((float)(x + i) * 2.0f + 1.0f - (float)n) * grid.scale.x, posY[i], posZ);
+						vertex.uv = glm::vec2((float)(x + i) / n * grid.uvScale, uvY);
+						vertex.normal = glm::vec3(nx[i], ny[i], nz[i]);
+					}
+				}
+				// Borders and the remainder that doesn't fill a full vector
+				const float dyFirst = (rowDown[0] - rowUp[0]) * dyScale;
+				writeVertex(grid, 0, y, row[0], (row[1] - row[0]) * 2.0f, dyFirst, vertices[y * n]);
+				for (; x < n - 1; x++) {
+					writeVertex(grid, x, y, row[x], row[x + 1] - row[x - 1], (rowDown[x] - rowUp[x]) * dyScale, vertices[x + y * n]);
+				}
+				const float dyLast = (rowDown[n - 1] - rowUp[n - 1]) * dyScale;
+				writeVertex(grid, n - 1, y, row[n - 1], (row[n - 1] - row[n - 2]) * 2.0f, dyLast, vertices[n - 1 + y * n]);
+			}
+#else
+			generateRowsScalar(grid, y0, y1, vertices);
+#endif
+		}
+
+	public:
 		float getHeight(uint32_t x, uint32_t y)
 		{
 			glm::ivec2 rpos = glm::ivec2(x, y) * glm::ivec2(scale);
@@ -70,11 +364,12 @@ namespace vks
 		}
 
 #if defined(__ANDROID__)
-		void loadFromFile(const std::string filename, uint32_t patchsize, glm::vec3 scale, Topology topology, AAssetManager* assetManager)
+		void loadFromFile(const std::string filename, uint32_t patchsize, glm::vec3 scale, Topology topology, AAssetManager* assetManager, VertexFormat vertexFormat = vertexFormatDefault)
 #else
-		void loadFromFile(const std::string filename, uint32_t patchsize, glm::vec3 scale, Topology topology)
+		void loadFromFile(const std::string filename, uint32_t patchsize, glm::vec3 scale, Topology topology, VertexFormat vertexFormat = vertexFormatDefault)
 #endif
 		{
+			CPU_PROFILE_SCOPE("Load height map");
 			assert(device);
 			assert(copyQueue != VK_NULL_HANDLE);
 
@@ -99,88 +394,149 @@ namespace vks
 			dim = ktxTexture->baseWidth;
 			heightdata = new uint16_t[dim * dim];
 			memcpy(heightdata, ktxImage, ktxSize);
-			this->scale = dim / patchsize;
 			ktxTexture_Destroy(ktxTexture);
 
+			generate(patchsize, scale, topology, vertexFormat);
+		}
+
+		/**
+		* Generates the terrain mesh and its quadtree from the loaded height data
+		* Can be called again at runtime to regenerate the terrain, the previous buffers are destroyed so they must no longer be in use by the GPU
+		*/
+		void generate(uint32_t patchsize, glm::vec3 scale, Topology topology, VertexFormat vertexFormat = vertexFormatDefault)
+		{
+			CPU_PROFILE_SCOPE("Generate terrain mesh");
+			assert(heightdata);
+
+			// Grids larger than the height map repeat source texels
+			this->scale = std::max(dim / patchsize, 1u);
+
 			// Generate vertices
-			Vertex * vertices = new Vertex[patchsize * patchsize * 4];
-
-			const float wx = 2.0f;
-			const float wy = 2.0f;
-
-			for (uint32_t x = 0; x < patchsize; x++) {
-				for (uint32_t y = 0; y < patchsize; y++) {
-					uint32_t index = (x + y * patchsize);
-					vertices[index].pos[0] = (x * wx + wx / 2.0f - (float)patchsize * wx / 2.0f) * scale.x;
-					vertices[index].pos[1] = -getHeight(x, y) * scale.y + 1.0f;
-					vertices[index].pos[2] = (y * wy + wy / 2.0f - (float)patchsize * wy / 2.0f) * scale.z;
-					vertices[index].uv = glm::vec2((float)x / patchsize, (float)y / patchsize) * uvScale;
-					// Normal
-					float dx = getHeight(x < patchsize - 1 ? x + 1 : x, y) - getHeight(x > 0 ? x - 1 : x, y);
-					if (x == 0 || x == patchsize - 1)
-						dx *= 2.0f;
-					float dy = getHeight(x, y < patchsize - 1 ? y + 1 : y) - getHeight(x, y > 0 ? y - 1 : y);
-					if (y == 0 || y == patchsize - 1)
-						dy *= 2.0f;
-					glm::vec3 A = glm::vec3(1.0f, 0.0f, dx);
-					glm::vec3 B = glm::vec3(0.0f, 1.0f, dy);
-					glm::vec3 normal = (glm::normalize(glm::cross(A, B)) + 1.0f) * 0.5f;
-					normal = (glm::normalize(glm::cross(A, B)));
-					vertices[x + y * patchsize].normal = glm::vec3(normal.x, normal.y, normal.z);
-				}
-			}
-
-			// Generate indices
-
-			const uint32_t w = (patchsize - 1);
-			uint32_t *indices;
-
-			switch (topology)
-			{
-			// Indices for triangles
-			case topologyTriangles:
-			{
-				indices = new uint32_t[w * w * 6];
-				for (uint32_t x = 0; x < w; x++) {
-					for (uint32_t y = 0; y < w; y++) {
-						uint32_t index = (x + y * w) * 6;
-						indices[index] = (x + y * patchsize);
-						indices[index + 1] = indices[index] + patchsize;
-						indices[index + 2] = indices[index + 1] + 1;
-						indices[index + 3] = indices[index + 1] + 1;
-						indices[index + 4] = indices[index] + 1;
-						indices[index + 5] = indices[index];
-					}
+			// The grid is followed by a copy of itself that's lowered by the skirt depth, the skirts of the quadtree nodes connect both
+			const uint32_t vertexCount = patchsize * patchsize;
+			std::vector<Vertex> vertices(vertexCount * 2);
+
+			auto tStart = std::chrono::high_resolution_clock::now();
+
+			// Sample the heights once up front, same as getHeight(x, y) but without the per vertex clamping and divisions
+			std::vector<uint32_t> sourceOffsets(patchsize);
+			for (uint32_t i = 0; i < patchsize; i++) {
+				sourceOffsets[i] = std::min(i * this->scale, dim - 1) / this->scale * this->scale;
+			}
+			std::vector<float> heights(vertexCount);
+			const float heightFactor = heightScale / 65535.0f;
+			for (uint32_t y = 0; y < patchsize; y++) {
+				const uint16_t* sourceRow = heightdata + sourceOffsets[y] * dim;
+				for (uint32_t x = 0; x < patchsize; x++) {
+					heights[x + y * patchsize] = sourceRow[sourceOffsets[x]] * heightFactor;
 				}
-				indexCount = (patchsize - 1) * (patchsize - 1) * 6;
-				indexBufferSize = (w * w * 6) * sizeof(uint32_t);
-				break;
-			}
-			// Indices for quad patches (tessellation)
-			case topologyQuads:
-			{
-				indices = new uint32_t[w * w * 4];
-				for (uint32_t x = 0; x < w; x++) {
-					for (uint32_t y = 0; y < w; y++) {
-						uint32_t index = (x + y * w) * 4;
-						indices[index] = (x + y * patchsize);
-						indices[index + 1] = indices[index] + patchsize;
-						indices[index + 2] = indices[index + 1] + 1;
-						indices[index + 3] = indices[index] + 1;
+			}
+
+			// Rows are distributed over the threads of the pool
+			const GridInfo grid = { heights.data(), patchsize, scale, uvScale };
+			const uint32_t threadCount = std::max(std::min(std::thread::hardware_concurrency(), patchsize / 64), 1u);
+			if (threadPool.threads.size() != threadCount) {
+				threadPool.setThreadCount(threadCount);
+			}
+			const uint32_t rowsPerThread = (patchsize + threadCount - 1) / threadCount;
+			Vertex* gridVertices = vertices.data();
+			for (uint32_t i = 0; i < threadCount; i++) {
+				const uint32_t y0 = std::min(i * rowsPerThread, patchsize);
+				const uint32_t y1 = std::min(y0 + rowsPerThread, patchsize);
+				threadPool.addJob([&grid, y0, y1, gridVertices] { generateRows(grid, y0, y1, gridVertices); });
+			}
+			threadPool.wait();
+
+			generationTime = std::chrono::duration<double, std::milli>(std::chrono::high_resolution_clock::now() - tStart).count();
+
+#if !defined(NDEBUG)
+			// Check the vectorized kernel against the scalar reference
+			std::vector<Vertex> reference(vertexCount);
+			generateRowsScalar(grid, 0, patchsize, reference.data());
+			for (uint32_t i = 0; i < vertexCount; i++) {
+				assert(glm::length(reference[i].pos - vertices[i].pos) < 1e-4f);
+				assert(glm::length(reference[i].normal - vertices[i].normal) < 1e-4f);
+				assert(glm::length(reference[i].uv - vertices[i].uv) < 1e-4f);
+			}
+#endif
+
+			// Height is negated, so skirts extend along positive y
+			const float skirtOffset = skirtDepth * heightScale * scale.y;
+			for (uint32_t i = 0; i < vertexCount; i++) {
+				vertices[vertexCount + i] = vertices[i];
+				vertices[vertexCount + i].pos.y += skirtOffset;
+			}
+
+			// Generate the quadtree
+			// Every node covers its area with nodeResolution x nodeResolution quads, so the step between sampled grid vertices doubles with each level towards the root
+			// Nodes are stored in breadth first order and each node's indices are stored in the same order, so siblings and all leaves occupy contiguous index ranges
+
+			const uint32_t quads = patchsize - 1;
+			uint32_t rootSize = nodeResolution;
+			while (rootSize < quads) {
+				rootSize *= 2;
+			}
+
+			std::vector<uint32_t> indices;
+			std::vector<glm::uvec3> nodeAreas;
+			nodes.clear();
+			nodes.push_back(Node());
+			nodeAreas.push_back(glm::uvec3(0, 0, rootSize));
+			for (size_t i = 0; i < nodes.size(); i++) {
+				const glm::uvec3 area = nodeAreas[i];
+				generateNode(nodes[i], area.x, area.y, area.z, patchsize, topology, vertices, indices);
+				if (area.z > nodeResolution) {
+					const uint32_t childSize = area.z / 2;
+					nodes[i].firstChild = static_cast<uint32_t>(nodes.size());
+					for (uint32_t y = 0; y < 2; y++) {
+						for (uint32_t x = 0; x < 2; x++) {
+							const glm::uvec3 childArea = glm::uvec3(area.x + x * childSize, area.y + y * childSize, childSize);
+							// Nodes of the padded power of two root may lie completely outside the grid
+							if ((childArea.x < quads) && (childArea.y < quads)) {
+								Node child;
+								child.level = nodes[i].level + 1;
+								nodes.push_back(child);
+								nodeAreas.push_back(childArea);
+								nodes[i].childCount++;
+							}
+						}
 					}
 				}
-				indexCount = (patchsize - 1) * (patchsize - 1) * 4;
-				indexBufferSize = (w * w * 4) * sizeof(uint32_t);
-				break;
-			}
 			}
 
+			indexCount = static_cast<uint32_t>(indices.size());
+			indexBufferSize = indices.size() * sizeof(uint32_t);
+
 			assert(indexBufferSize > 0);
 
-			vertexBufferSize = (patchsize * patchsize * 4) * sizeof(Vertex);
+			// The full vertices are still generated, as the quadtree's bounds are calculated from them
+			this->vertexFormat = vertexFormat;
+			std::vector<CompactVertex> compactVertices;
+			if (vertexFormat == vertexFormatCompact) {
+				compactVertices.resize(vertices.size());
+				for (uint32_t x = 0; x < patchsize; x++) {
+					for (uint32_t y = 0; y < patchsize; y++) {
+						const uint32_t index = (x + y * patchsize);
+						CompactVertex& vertex = compactVertices[index];
+						vertex.height = static_cast<uint16_t>(std::round(heights[index] / heightScale * 65535.0f));
+						encodeOctahedral(vertices[index].normal, vertex.normal);
+						vertex.pad = 0;
+						// Skirt vertices are identified by their index in the shader
+						compactVertices[vertexCount + index] = vertex;
+					}
+				}
+				vertexBufferSize = compactVertices.size() * sizeof(CompactVertex);
+			} else {
+				vertexBufferSize = vertices.size() * sizeof(Vertex);
+			}
 
 			// Generate Vulkan buffers
 
+			if (vertexBuffer.buffer != VK_NULL_HANDLE) {
+				vertexBuffer.destroy();
+				indexBuffer.destroy();
+			}
+
 			vks::Buffer vertexStaging, indexStaging;
 
 			// Create staging buffers
@@ -189,14 +545,14 @@ namespace vks
 				VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT,
 				&vertexStaging,
 				vertexBufferSize,
-				vertices);
+				(vertexFormat == vertexFormatCompact) ? (void*)compactVertices.data() : (void*)vertices.data());
 
 			device->createBuffer(
 				VK_BUFFER_USAGE_TRANSFER_SRC_BIT,
 				VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT,
 				&indexStaging,
 				indexBufferSize,
-				indices);
+				indices.data());
 
 			// Device local (target) buffer
 			device->createBuffer(
@@ -234,16 +590,105 @@ namespace vks
 
 			device->flushCommandBuffer(copyCmd, copyQueue, true);
 
-			vkDestroyBuffer(device->logicalDevice, vertexStaging.buffer, nullptr);
-			vkFreeMemory(device->logicalDevice, vertexStaging.memory, nullptr);
-			vkDestroyBuffer(device->logicalDevice, indexStaging.buffer, nullptr);
-			vkFreeMemory(device->logicalDevice, indexStaging.memory, nullptr);
+			vertexStaging.destroy();
+			indexStaging.destroy();
 		}
+		/** @brief Draws the whole terrain at full detail */
 		void draw(VkCommandBuffer cb) {
+			// Leaves are stored last, so they form a single index range
+			const Node& firstLeaf = *std::find_if(nodes.begin(), nodes.end(), [](const Node& node) { return node.childCount == 0; });
+			const VkDeviceSize offsets[1] = { 0 };
+			vkCmdBindVertexBuffers(cb, 0, 1, &vertexBuffer.buffer, offsets);
+			vkCmdBindIndexBuffer(cb, indexBuffer.buffer, 0, VK_INDEX_TYPE_UINT32);
+			vkCmdDrawIndexed(cb, indexCount - firstLeaf.firstIndex, 1, firstLeaf.firstIndex, 0, 0);
+		}
+
+		/**
+		* Draws the quadtree nodes that are visible in the given frustum, with the level of detail selected by the distance to the viewer
+		* Doesn't change any state of the height map, so this can be called from multiple threads at once
+		*
+		* @param cb Command buffer to record the draws to
+		* @param frustum Frustum of the view to cull against
+		* @param viewPos World space position used to select the level of detail
+		* @param mirror Set to true if the vertex shader mirrors the terrain at the water plane (y = 0)
+		* @param ignoreBackPlane Don't cull against the frustum's BACK plane (see Frustum::checkBox)
+		* @param statistics (Optional) Receives the number of drawn and culled nodes
+		*/
+		void draw(VkCommandBuffer cb, const vks::Frustum& frustum, const glm::vec3& viewPos, bool mirror = false, bool ignoreBackPlane = false, CullingStatistics* statistics = nullptr) const {
+			draw(cb, &frustum, 1, viewPos, mirror, ignoreBackPlane, statistics);
+		}
+
+		/**
+		* Same as above, but draws nodes visible in any of the given frusta, e.g. for rendering multiple views in a single pass
+		* Statistics are counted separately for each frustum, so statistics needs to point to frustumCount elements
+		*/
+		void draw(VkCommandBuffer cb, const vks::Frustum* frusta, uint32_t frustumCount, const glm::vec3& viewPos, bool mirror = false, bool ignoreBackPlane = false, CullingStatistics* statistics = nullptr) const {
+			assert(frustumCount <= 32);
+			if (statistics) {
+				for (uint32_t i = 0; i < frustumCount; i++) {
+					statistics[i] = CullingStatistics();
+				}
+			}
+			// Index ranges (first, count) to draw, adjacent ranges are merged into a single draw
+			std::vector<std::pair<uint32_t, uint32_t>> ranges;
+			// Nodes to visit along with a mask of the frusta their parent is visible in, as children can only be visible in those
+			std::vector<std::pair<uint32_t, uint32_t>> stack = { std::make_pair(0u, (frustumCount == 32) ? ~0u : (1u << frustumCount) - 1) };
+			while (!stack.empty()) {
+				const Node& node = nodes[stack.back().first];
+				const uint32_t parentMask = stack.back().second;
+				stack.pop_back();
+				glm::vec3 min = node.min;
+				glm::vec3 max = node.max;
+				if (mirror) {
+					min.y = -node.max.y;
+					max.y = -node.min.y;
+				}
+				uint32_t mask = 0;
+				for (uint32_t i = 0; i < frustumCount; i++) {
+					if (!(parentMask & (1u << i))) {
+						continue;
+					}
+					if (frusta[i].checkBox(min, max, ignoreBackPlane)) {
+						mask |= 1u << i;
+					} else if (statistics) {
+						statistics[i].culledNodes++;
+					}
+				}
+				if (mask == 0) {
+					continue;
+				}
+				const float size = std::max(max.x - min.x, max.z - min.z);
+				const float distance = glm::length(glm::max(glm::max(min - viewPos, viewPos - max), glm::vec3(0.0f)));
+				if ((node.childCount == 0) || (distance > size * lodDistance)) {
+					if (statistics) {
+						for (uint32_t i = 0; i < frustumCount; i++) {
+							if (mask & (1u << i)) {
+								statistics[i].drawnNodes++;
+								statistics[i].drawnIndices += node.indexCount;
+							}
+						}
+					}
+					if (!ranges.empty() && (ranges.back().first + ranges.back().second == node.firstIndex)) {
+						ranges.back().second += node.indexCount;
+					} else {
+						ranges.push_back(std::make_pair(node.firstIndex, node.indexCount));
+					}
+					continue;
+				}
+				// Children are pushed in reverse, so they're visited in the order they are stored
+				for (uint32_t i = node.childCount; i > 0; i--) {
+					stack.push_back(std::make_pair(node.firstChild + i - 1, mask));
+				}
+			}
+			if (ranges.empty()) {
+				return;
+			}
 			const VkDeviceSize offsets[1] = { 0 };
 			vkCmdBindVertexBuffers(cb, 0, 1, &vertexBuffer.buffer, offsets);
 			vkCmdBindIndexBuffer(cb, indexBuffer.buffer, 0, VK_INDEX_TYPE_UINT32);
-			vkCmdDrawIndexed(cb, indexCount, 1, 0, 0, 0);
+			for (auto& range : ranges) {
+				vkCmdDrawIndexed(cb, range.second, 1, range.first, 0, 0);
+			}
 		}
 	};
 }
@@ -0,0 +1,402 @@
+/*
+* Vulkan device memory allocator
+*
+* Sub-allocates buffers and images from larger device memory blocks
+*
+* Copyright (C) by Sascha Willems - www.saschawillems.de
+*
+* This code is licensed under the MIT license (MIT) (http://opensource.org/licenses/MIT)
+*/
+
+#pragma once
+
+#include <vector>
+#include <string>
+#include <mutex>
+#include <algorithm>
+#include <stdexcept>
+#include <assert.h>
+#include "vulkan/vulkan.h"
+#include "VulkanInitializers.hpp"
+#include "VulkanTools.h"
+
+namespace vks
+{
+	struct MemoryBlock;
+
+	/** @brief Range of a device memory block that backs a single resource */
+	struct Allocation
+	{
+		/** @brief Device memory block that contains this allocation */
+		VkDeviceMemory memory = VK_NULL_HANDLE;
+		/** @brief Byte offset of the allocation inside the memory block, required for binding, mapping and flushing */
+		VkDeviceSize offset = 0;
+		VkDeviceSize size = 0;
+		uint32_t memoryTypeIndex = 0;
+		/** @brief Host address of the allocation for host visible memory types (blocks are persistently mapped) */
+		void* mapped = nullptr;
+		MemoryBlock* block = nullptr;
+	};
+
+	/** @brief Usage statistics for a single memory heap */
+	struct HeapStatistics
+	{
+		VkDeviceSize heapSize = 0;
+		VkMemoryHeapFlags flags = 0;
+		/** @brief Size of all device memory blocks allocated from this heap */
+		VkDeviceSize blockBytes = 0;
+		/** @brief Size of all live allocations inside these blocks */
+		VkDeviceSize allocationBytes = 0;
+		uint32_t blockCount = 0;
+		uint32_t allocationCount = 0;
+	};
+
+	/** @brief A single device memory allocation that is split into ranges using a free list */
+	struct MemoryBlock
+	{
+		struct Range
+		{
+			VkDeviceSize offset;
+			VkDeviceSize size;
+			bool free;
+			/** @brief Set for buffers and linear images, used to keep bufferImageGranularity between linear and optimal resources */
+			bool linear;
+		};
+		VkDeviceMemory memory = VK_NULL_HANDLE;
+		VkDeviceSize size = 0;
+		uint32_t memoryTypeIndex = 0;
+		void* mapped = nullptr;
+		/** @brief Dedicated blocks contain a single large resource and are released once it's freed */
+		bool dedicated = false;
+		/** @brief Sorted by offset and covering the whole block, adjacent free ranges are always merged */
+		std::vector<Range> ranges;
+	};
+
+	/**
+	* @brief Sub-allocates resources from large device memory blocks per memory type
+	* @note Keeps the number of device memory allocations well below maxMemoryAllocationCount
+	*/
+	class MemoryAllocator
+	{
+	private:
+		VkDevice device;
+		VkPhysicalDeviceMemoryProperties memoryProperties;
+		VkDeviceSize bufferImageGranularity;
+		VkDeviceSize nonCoherentAtomSize;
+		/** @brief Blocks for each memory type */
+		std::vector<std::vector<MemoryBlock*>> blocks;
+		std::vector<HeapStatistics> heapStatistics;
+		std::mutex mutex;
+
+		static VkDeviceSize alignUp(VkDeviceSize value, VkDeviceSize alignment)
+		{
+			return (value + alignment - 1) / alignment * alignment;
+		}
+
+		// Resources of different linearity must not share a page of bufferImageGranularity size
+		bool onSamePage(VkDeviceSize endA, VkDeviceSize startB)
+		{
+			return (endA & ~(bufferImageGranularity - 1)) == (startB & ~(bufferImageGranularity - 1));
+		}
+
+		VkDeviceSize getPreferredBlockSize(uint32_t memoryTypeIndex)
+		{
+			const VkDeviceSize heapSize = memoryProperties.memoryHeaps[memoryProperties.memoryTypes[memoryTypeIndex].heapIndex].size;
+			// Small heaps (e.g. the host visible device local heap on some discrete GPUs) are split into smaller blocks
+			return (heapSize <= 1024ull * 1024 * 1024) ? alignUp(heapSize / 8, 1024 * 1024) : 256ull * 1024 * 1024;
+		}
+
+		uint32_t getMemoryType(uint32_t typeBits, VkMemoryPropertyFlags properties, VkDeviceSize size)
+		{
+			uint32_t firstMatch = VK_MAX_MEMORY_TYPES;
+			for (uint32_t i = 0; i < memoryProperties.memoryTypeCount; i++)
+			{
+				if (((typeBits & (1 << i)) == 0) || ((memoryProperties.memoryTypes[i].propertyFlags & properties) != properties))
+				{
+					continue;
+				}
+				// Prefer a memory type whose heap still has room for the allocation
+				const HeapStatistics& heap = heapStatistics[memoryProperties.memoryTypes[i].heapIndex];
+				if (heap.blockBytes + size <= heap.heapSize)
+				{
+					return i;
+				}
+				if (firstMatch == VK_MAX_MEMORY_TYPES)
+				{
+					firstMatch = i;
+				}
+			}
+			if (firstMatch == VK_MAX_MEMORY_TYPES)
+			{
+				throw std::runtime_error("Could not find a matching memory type");
+			}
+			return firstMatch;
+		}
+
+		MemoryBlock* createBlock(uint32_t memoryTypeIndex, VkDeviceSize size, bool dedicated)
+		{
+			MemoryBlock* block = new MemoryBlock();
+			block->memoryTypeIndex = memoryTypeIndex;
+			block->dedicated = dedicated;
+			VkMemoryAllocateInfo memAlloc = vks::initializers::memoryAllocateInfo();
+			memAlloc.memoryTypeIndex = memoryTypeIndex;
+			memAlloc.allocationSize = size;
+			VkResult result = vkAllocateMemory(device, &memAlloc, nullptr, &block->memory);
+			if (result != VK_SUCCESS)
+			{
+				delete block;
+				return nullptr;
+			}
+			block->size = size;
+			block->ranges.push_back({ 0, size, true, false });
+			// Host visible blocks stay mapped for their whole lifetime, as memory objects can only be mapped once
+			if (memoryProperties.memoryTypes[memoryTypeIndex].propertyFlags & VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT)
+			{
+				VK_CHECK_RESULT(vkMapMemory(device, block->memory, 0, VK_WHOLE_SIZE, 0, &block->mapped));
+			}
+			HeapStatistics& heap = heapStatistics[memoryProperties.memoryTypes[memoryTypeIndex].heapIndex];
+			heap.blockBytes += size;
+			heap.blockCount++;
+			blocks[memoryTypeIndex].push_back(block);
+			return block;
+		}
+
+		void destroyBlock(MemoryBlock* block)
+		{
+			HeapStatistics& heap = heapStatistics[memoryProperties.memoryTypes[block->memoryTypeIndex].heapIndex];
+			heap.blockBytes -= block->size;
+			heap.blockCount--;
+			if (block->mapped)
+			{
+				vkUnmapMemory(device, block->memory);
+			}
+			vkFreeMemory(device, block->memory, nullptr);
+			std::vector<MemoryBlock*>& typeBlocks = blocks[block->memoryTypeIndex];
+			typeBlocks.erase(std::find(typeBlocks.begin(), typeBlocks.end(), block));
+			delete block;
+		}
+
+		// First fit search through the block's free ranges
+		bool allocateFromBlock(MemoryBlock* block, VkDeviceSize size, VkDeviceSize alignment, bool linear, Allocation& allocation)
+		{
+			for (size_t i = 0; i < block->ranges.size(); i++)
+			{
+				const MemoryBlock::Range range = block->ranges[i];
+				if ((!range.free) || (range.size < size))
+				{
+					continue;
+				}
+				VkDeviceSize offset = alignUp(range.offset, alignment);
+				if ((bufferImageGranularity > 1) && (i > 0))
+				{
+					const MemoryBlock::Range& prev = block->ranges[i - 1];
+					if ((!prev.free) && (prev.linear != linear) && onSamePage(prev.offset + prev.size - 1, offset))
+					{
+						offset = alignUp(offset, bufferImageGranularity);
+					}
+				}
+				if (offset + size > range.offset + range.size)
+				{
+					continue;
+				}
+				if ((bufferImageGranularity > 1) && (i + 1 < block->ranges.size()))
+				{
+					const MemoryBlock::Range& next = block->ranges[i + 1];
+					if ((!next.free) && (next.linear != linear) && onSamePage(offset + size - 1, next.offset))
+					{
+						continue;
+					}
+				}
+				// Split the free range into leading padding, the allocation and the remainder
+				std::vector<MemoryBlock::Range> split;
+				if (offset > range.offset)
+				{
+					split.push_back({ range.offset, offset - range.offset, true, false });
+				}
+				split.push_back({ offset, size, false, linear });
+				if (offset + size < range.offset + range.size)
+				{
+					split.push_back({ offset + size, range.offset + range.size - (offset + size), true, false });
+				}
+				block->ranges.erase(block->ranges.begin() + i);
+				block->ranges.insert(block->ranges.begin() + i, split.begin(), split.end());
+
+				allocation.memory = block->memory;
+				allocation.offset = offset;
+				allocation.size = size;
+				allocation.memoryTypeIndex = block->memoryTypeIndex;
+				allocation.mapped = block->mapped ? static_cast<uint8_t*>(block->mapped) + offset : nullptr;
+				allocation.block = block;
+				return true;
+			}
+			return false;
+		}
+
+	public:
+		MemoryAllocator(VkPhysicalDevice physicalDevice, VkDevice device)
+		{
+			this->device = device;
+			VkPhysicalDeviceProperties properties;
+			vkGetPhysicalDeviceProperties(physicalDevice, &properties);
+			vkGetPhysicalDeviceMemoryProperties(physicalDevice, &memoryProperties);
+			bufferImageGranularity = properties.limits.bufferImageGranularity;
+			nonCoherentAtomSize = properties.limits.nonCoherentAtomSize;
+			blocks.resize(memoryProperties.memoryTypeCount);
+			heapStatistics.resize(memoryProperties.memoryHeapCount);
+			for (uint32_t i = 0; i < memoryProperties.memoryHeapCount; i++)
+			{
+				heapStatistics[i].heapSize = memoryProperties.memoryHeaps[i].size;
+				heapStatistics[i].flags = memoryProperties.memoryHeaps[i].flags;
+			}
+		}
+
+		~MemoryAllocator()
+		{
+			for (auto& typeBlocks : blocks)
+			{
+				while (!typeBlocks.empty())
+				{
+					destroyBlock(typeBlocks.back());
+				}
+			}
+		}
+
+		/**
+		* Allocate a range of device memory
+		*
+		* @param memReqs Memory requirements of the resource
+		* @param memoryPropertyFlags Memory properties the allocation's memory type needs to support
+		* @param linear True for buffers and linear tiled images, false for optimal tiled images
+		*
+		* @return The allocation, which needs to be freed with free()
+		*/
+		Allocation allocate(VkMemoryRequirements memReqs, VkMemoryPropertyFlags memoryPropertyFlags, bool linear)
+		{
+			std::lock_guard<std::mutex> lock(mutex);
+			const uint32_t memoryTypeIndex = getMemoryType(memReqs.memoryTypeBits, memoryPropertyFlags, memReqs.size);
+			VkDeviceSize size = memReqs.size;
+			VkDeviceSize alignment = memReqs.alignment;
+			// Mapped ranges of non-coherent memory are flushed in multiples of nonCoherentAtomSize
+			const VkMemoryPropertyFlags typeFlags = memoryProperties.memoryTypes[memoryTypeIndex].propertyFlags;
+			if ((typeFlags & VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT) && !(typeFlags & VK_MEMORY_PROPERTY_HOST_COHERENT_BIT))
+			{
+				alignment = std::max(alignment, nonCoherentAtomSize);
+				size = alignUp(size, nonCoherentAtomSize);
+			}
+
+			Allocation allocation{};
+			const VkDeviceSize blockSize = getPreferredBlockSize(memoryTypeIndex);
+			if (size > blockSize / 2)
+			{
+				// Large resources get a block of their own
+				MemoryBlock* block = createBlock(memoryTypeIndex, size, true);
+				if (!block)
+				{
+					vks::tools::exitFatal("Could not allocate " + std::to_string(size) + " bytes of device memory", VK_ERROR_OUT_OF_DEVICE_MEMORY);
+				}
+				allocateFromBlock(block, size, alignment, linear, allocation);
+			}
+			else
+			{
+				bool allocated = false;
+				for (auto block : blocks[memoryTypeIndex])
+				{
+					if ((!block->dedicated) && allocateFromBlock(block, size, alignment, linear, allocation))
+					{
+						allocated = true;
+						break;
+					}
+				}
+				if (!allocated)
+				{
+					// Retry with smaller blocks if the heap is running low
+					MemoryBlock* block = nullptr;
+					for (VkDeviceSize newBlockSize = blockSize; (!block) && (newBlockSize >= size); newBlockSize /= 2)
+					{
+						block = createBlock(memoryTypeIndex, newBlockSize, false);
+					}
+					if (!block)
+					{
+						vks::tools::exitFatal("Could not allocate " + std::to_string(size) + " bytes of device memory", VK_ERROR_OUT_OF_DEVICE_MEMORY);
+					}
+					allocateFromBlock(block, size, alignment, linear, allocation);
+				}
+			}
+
+			HeapStatistics& heap = heapStatistics[memoryProperties.memoryTypes[memoryTypeIndex].heapIndex];
+			heap.allocationBytes += allocation.size;
+			heap.allocationCount++;
+			return allocation;
+		}
+
+		/** @brief Allocate and bind memory for a buffer */
+		Allocation allocateBuffer(VkBuffer buffer, VkMemoryPropertyFlags memoryPropertyFlags)
+		{
+			VkMemoryRequirements memReqs;
+			vkGetBufferMemoryRequirements(device, buffer, &memReqs);
+			Allocation allocation = allocate(memReqs, memoryPropertyFlags, true);
+			VK_CHECK_RESULT(vkBindBufferMemory(device, buffer, allocation.memory, allocation.offset));
+			return allocation;
+		}
+
+		/** @brief Allocate and bind memory for an image */
+		Allocation allocateImage(VkImage image, VkMemoryPropertyFlags memoryPropertyFlags, VkImageTiling tiling = VK_IMAGE_TILING_OPTIMAL)
+		{
+			VkMemoryRequirements memReqs;
+			vkGetImageMemoryRequirements(device, image, &memReqs);
+			Allocation allocation = allocate(memReqs, memoryPropertyFlags, tiling == VK_IMAGE_TILING_LINEAR);
+			VK_CHECK_RESULT(vkBindImageMemory(device, image, allocation.memory, allocation.offset));
+			return allocation;
+		}
+
+		/** @brief Return an allocation's range to its block */
+		void free(Allocation& allocation)
+		{
+			if (!allocation.block)
+			{
+				return;
+			}
+			std::lock_guard<std::mutex> lock(mutex);
+			MemoryBlock* block = allocation.block;
+			HeapStatistics& heap = heapStatistics[memoryProperties.memoryTypes[block->memoryTypeIndex].heapIndex];
+			heap.allocationBytes -= allocation.size;
+			heap.allocationCount--;
+
+			auto range = std::find_if(block->ranges.begin(), block->ranges.end(), [&allocation](const MemoryBlock::Range& r) { return r.offset == allocation.offset; });
+			assert((range != block->ranges.end()) && (!range->free));
+			range->free = true;
+			range->linear = false;
+			// Merge with adjacent free ranges
+			size_t index = range - block->ranges.begin();
+			if ((index + 1 < block->ranges.size()) && block->ranges[index + 1].free)
+			{
+				block->ranges[index].size += block->ranges[index + 1].size;
+				block->ranges.erase(block->ranges.begin() + index + 1);
+			}
+			if ((index > 0) && block->ranges[index - 1].free)
+			{
+				block->ranges[index - 1].size += block->ranges[index].size;
+				block->ranges.erase(block->ranges.begin() + index);
+			}
+
+			// Release empty blocks, but keep one regular block per memory type around to avoid reallocating it over and over
+			if (block->ranges.size() == 1)
+			{
+				const std::vector<MemoryBlock*>& typeBlocks = blocks[block->memoryTypeIndex];
+				const size_t regularBlocks = std::count_if(typeBlocks.begin(), typeBlocks.end(), [](const MemoryBlock* b) { return !b->dedicated; });
+				if (block->dedicated || (regularBlocks > 1))
+				{
+					destroyBlock(block);
+				}
+			}
+			allocation = Allocation{};
+		}
+
+		/** @brief Get the usage statistics of all memory heaps */
+		std::vector<HeapStatistics> getHeapStatistics()
+		{
+			std::lock_guard<std::mutex> lock(mutex);
+			return heapStatistics;
+		}
+	};
+}
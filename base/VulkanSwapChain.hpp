@@ -73,6 +73,8 @@ public:
 	uint32_t imageCount;
 	std::vector<VkImage> images;
 	std::vector<SwapChainBuffer> buffers;
+	/** @brief Usage flags the swap chain images have been created with, transfer usage depends on the surface */
+	VkImageUsageFlags imageUsage = VK_IMAGE_USAGE_COLOR_ATTACHMENT_BIT;
 	/** @brief Queue family index of the detected graphics and presenting device queue */
 	uint32_t queueNodeIndex = UINT32_MAX;
 
@@ -402,6 +404,7 @@ public:
 		}
 
 		VK_CHECK_RESULT(fpCreateSwapchainKHR(device, &swapchainCI, nullptr, &swapChain));
+		imageUsage = swapchainCI.imageUsage;
 
 		// If an existing swap chain is re-created, destroy the old swap chain
 		// This also cleans up all the presentable images
@@ -39,10 +39,15 @@ namespace vks
 		VkSampleCountFlagBits rasterizationSamples = VK_SAMPLE_COUNT_1_BIT;
 		uint32_t subpass = 0;
 
-		vks::Buffer vertexBuffer;
-		vks::Buffer indexBuffer;
-		int32_t vertexCount = 0;
-		int32_t indexCount = 0;
+		// One set of vertex and index buffers per frame, so the buffers of a frame that's still in flight aren't overwritten
+		struct Buffers {
+			vks::Buffer vertexBuffer;
+			vks::Buffer indexBuffer;
+			// Vertex and index counts the frame's command buffer has been recorded with
+			int32_t vertexCount = 0;
+			int32_t indexCount = 0;
+		};
+		std::vector<Buffers> buffers;
 
 		std::vector<VkPipelineShaderStageCreateInfo> shaders;
 
@@ -72,8 +77,8 @@ namespace vks
 		void preparePipeline(const VkPipelineCache pipelineCache, const VkRenderPass renderPass);
 		void prepareResources();
 
-		bool update();
-		void draw(const VkCommandBuffer commandBuffer);
+		bool update(uint32_t frameIndex);
+		void draw(const VkCommandBuffer commandBuffer, uint32_t frameIndex);
 		void resize(uint32_t width, uint32_t height);
 
 		void freeResources();
@@ -15,6 +15,7 @@
 
 #include "vulkan/vulkan.h"
 #include "VulkanDevice.hpp"
+#include "CpuProfiler.hpp"
 
 #define GLM_FORCE_RADIANS
 #define GLM_FORCE_DEPTH_ZERO_TO_ONE
@@ -42,7 +43,7 @@ namespace vkglTF
 		vks::VulkanDevice *device;
 		VkImage image;
 		VkImageLayout imageLayout;
-		VkDeviceMemory deviceMemory;
+		vks::Allocation allocation;
 		VkImageView view;
 		uint32_t width, height;
 		uint32_t mipLevels;
@@ -61,7 +62,7 @@ namespace vkglTF
 		{
 			vkDestroyImageView(device->logicalDevice, view, nullptr);
 			vkDestroyImage(device->logicalDevice, image, nullptr);
-			vkFreeMemory(device->logicalDevice, deviceMemory, nullptr);
+			device->memoryAllocator->free(allocation);
 			vkDestroySampler(device->logicalDevice, sampler, nullptr);
 		}
 
@@ -109,12 +110,7 @@ namespace vkglTF
 			assert(formatProperties.optimalTilingFeatures & VK_FORMAT_FEATURE_BLIT_SRC_BIT);
 			assert(formatProperties.optimalTilingFeatures & VK_FORMAT_FEATURE_BLIT_DST_BIT);
 
-			VkMemoryAllocateInfo memAllocInfo{};
-			memAllocInfo.sType = VK_STRUCTURE_TYPE_MEMORY_ALLOCATE_INFO;
-			VkMemoryRequirements memReqs{};
-
 			VkBuffer stagingBuffer;
-			VkDeviceMemory stagingMemory;
 
 			VkBufferCreateInfo bufferCreateInfo{};
 			bufferCreateInfo.sType = VK_STRUCTURE_TYPE_BUFFER_CREATE_INFO;
@@ -122,16 +118,8 @@ namespace vkglTF
 			bufferCreateInfo.usage = VK_BUFFER_USAGE_TRANSFER_SRC_BIT;
 			bufferCreateInfo.sharingMode = VK_SHARING_MODE_EXCLUSIVE;
 			VK_CHECK_RESULT(vkCreateBuffer(device->logicalDevice, &bufferCreateInfo, nullptr, &stagingBuffer));
-			vkGetBufferMemoryRequirements(device->logicalDevice, stagingBuffer, &memReqs);
-			memAllocInfo.allocationSize = memReqs.size;
-			memAllocInfo.memoryTypeIndex = device->getMemoryType(memReqs.memoryTypeBits, VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT);
-			VK_CHECK_RESULT(vkAllocateMemory(device->logicalDevice, &memAllocInfo, nullptr, &stagingMemory));
-			VK_CHECK_RESULT(vkBindBufferMemory(device->logicalDevice, stagingBuffer, stagingMemory, 0));
-
-			uint8_t *data;
-			VK_CHECK_RESULT(vkMapMemory(device->logicalDevice, stagingMemory, 0, memReqs.size, 0, (void **)&data));
-			memcpy(data, buffer, bufferSize);
-			vkUnmapMemory(device->logicalDevice, stagingMemory);
+			vks::Allocation stagingAllocation = device->memoryAllocator->allocateBuffer(stagingBuffer, VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT);
+			memcpy(stagingAllocation.mapped, buffer, bufferSize);
 
 			VkImageCreateInfo imageCreateInfo{};
 			imageCreateInfo.sType = VK_STRUCTURE_TYPE_IMAGE_CREATE_INFO;
@@ -147,11 +135,7 @@ namespace vkglTF
 			imageCreateInfo.extent = { width, height, 1 };
 			imageCreateInfo.usage = VK_IMAGE_USAGE_TRANSFER_DST_BIT | VK_IMAGE_USAGE_TRANSFER_SRC_BIT | VK_IMAGE_USAGE_SAMPLED_BIT;
 			VK_CHECK_RESULT(vkCreateImage(device->logicalDevice, &imageCreateInfo, nullptr, &image));
-			vkGetImageMemoryRequirements(device->logicalDevice, image, &memReqs);
-			memAllocInfo.allocationSize = memReqs.size;
-			memAllocInfo.memoryTypeIndex = device->getMemoryType(memReqs.memoryTypeBits, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT);
-			VK_CHECK_RESULT(vkAllocateMemory(device->logicalDevice, &memAllocInfo, nullptr, &deviceMemory));
-			VK_CHECK_RESULT(vkBindImageMemory(device->logicalDevice, image, deviceMemory, 0));
+			allocation = device->memoryAllocator->allocateImage(image, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT);
 
 			VkCommandBuffer copyCmd = device->createCommandBuffer(VK_COMMAND_BUFFER_LEVEL_PRIMARY, true);
 
@@ -197,7 +181,7 @@ namespace vkglTF
 
 			device->flushCommandBuffer(copyCmd, copyQueue, true);
 
-			vkFreeMemory(device->logicalDevice, stagingMemory, nullptr);
+			device->memoryAllocator->free(stagingAllocation);
 			vkDestroyBuffer(device->logicalDevice, stagingBuffer, nullptr);
 
 			// Generate the mip chain (glTF uses jpg and png, so we need to create this manually)
@@ -364,7 +348,7 @@ namespace vkglTF
 
 		struct UniformBuffer {
 			VkBuffer buffer;
-			VkDeviceMemory memory;
+			vks::Allocation allocation;
 			VkDescriptorBufferInfo descriptor;
 			VkDescriptorSet descriptorSet = VK_NULL_HANDLE;
 			void *mapped;
@@ -384,15 +368,15 @@ namespace vkglTF
 				VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT,
 				sizeof(uniformBlock),
 				&uniformBuffer.buffer,
-				&uniformBuffer.memory,
+				&uniformBuffer.allocation,
 				&uniformBlock));
-			VK_CHECK_RESULT(vkMapMemory(device->logicalDevice, uniformBuffer.memory, 0, sizeof(uniformBlock), 0, &uniformBuffer.mapped));
+			uniformBuffer.mapped = uniformBuffer.allocation.mapped;
 			uniformBuffer.descriptor = { uniformBuffer.buffer, 0, sizeof(uniformBlock) };
 		};
 
 		~Mesh() {
 			vkDestroyBuffer(device->logicalDevice, uniformBuffer.buffer, nullptr);
-			vkFreeMemory(device->logicalDevice, uniformBuffer.memory, nullptr);
+			device->memoryAllocator->free(uniformBuffer.allocation);
 		}
 
 	};
@@ -509,8 +493,10 @@ namespace vkglTF
 	struct Model {
 
 		vks::VulkanDevice *device;
-		VkDescriptorPool descriptorPool;
-		VkDescriptorSetLayout descriptorSetLayout;
+		VkDescriptorPool descriptorPool = VK_NULL_HANDLE;
+		VkDescriptorSetLayout descriptorSetLayout = VK_NULL_HANDLE;
+		// Descriptors for the mesh nodes' uniform buffers, can be disabled before loading if the renderer doesn't bind them
+		bool nodeDescriptors = true;
 
 		struct Vertex {
 			glm::vec3 pos;
@@ -522,12 +508,12 @@ namespace vkglTF
 
 		struct Vertices {
 			VkBuffer buffer;
-			VkDeviceMemory memory;
+			vks::Allocation allocation;
 		} vertices;
 		struct Indices {
 			int count;
 			VkBuffer buffer;
-			VkDeviceMemory memory;
+			vks::Allocation allocation;
 		} indices;
 
 		std::vector<Node*> nodes;
@@ -554,9 +540,9 @@ namespace vkglTF
 		~Model() 
 		{
 			vkDestroyBuffer(device->logicalDevice, vertices.buffer, nullptr);
-			vkFreeMemory(device->logicalDevice, vertices.memory, nullptr);
+			device->memoryAllocator->free(vertices.allocation);
 			vkDestroyBuffer(device->logicalDevice, indices.buffer, nullptr);
-			vkFreeMemory(device->logicalDevice, indices.memory, nullptr);
+			device->memoryAllocator->free(indices.allocation);
 			for (auto texture : textures) {
 				texture.destroy();
 			}
@@ -931,6 +917,7 @@ namespace vkglTF
 
 		void loadFromFile(std::string filename, vks::VulkanDevice *device, VkQueue transferQueue, float scale = 1.0f)
 		{
+			CPU_PROFILE_SCOPE("Load glTF model");
 			tinygltf::Model gltfModel;
 			tinygltf::TinyGLTF gltfContext;
 			std::string error, warning;
@@ -999,7 +986,7 @@ namespace vkglTF
 
 			struct StagingBuffer {
 				VkBuffer buffer;
-				VkDeviceMemory memory;
+				vks::Allocation allocation;
 			} vertexStaging, indexStaging;
 
 			// Create staging buffers
@@ -1009,7 +996,7 @@ namespace vkglTF
 				VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT,
 				vertexBufferSize,
 				&vertexStaging.buffer,
-				&vertexStaging.memory,
+				&vertexStaging.allocation,
 				vertexBuffer.data()));
 			// Index data
 			VK_CHECK_RESULT(device->createBuffer(
@@ -1017,7 +1004,7 @@ namespace vkglTF
 				VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT,
 				indexBufferSize,
 				&indexStaging.buffer,
-				&indexStaging.memory,
+				&indexStaging.allocation,
 				indexBuffer.data()));
 
 			// Create device local buffers
@@ -1027,14 +1014,14 @@ namespace vkglTF
 				VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT,
 				vertexBufferSize,
 				&vertices.buffer,
-				&vertices.memory));
+				&vertices.allocation));
 			// Index buffer
 			VK_CHECK_RESULT(device->createBuffer(
 				VK_BUFFER_USAGE_INDEX_BUFFER_BIT | VK_BUFFER_USAGE_TRANSFER_DST_BIT,
 				VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT,
 				indexBufferSize,
 				&indices.buffer,
-				&indices.memory));
+				&indices.allocation));
 
 			// Copy from staging buffers
 			VkCommandBuffer copyCmd = device->createCommandBuffer(VK_COMMAND_BUFFER_LEVEL_PRIMARY, true);
@@ -1050,12 +1037,16 @@ namespace vkglTF
 			device->flushCommandBuffer(copyCmd, transferQueue, true);
 
 			vkDestroyBuffer(device->logicalDevice, vertexStaging.buffer, nullptr);
-			vkFreeMemory(device->logicalDevice, vertexStaging.memory, nullptr);
+			device->memoryAllocator->free(vertexStaging.allocation);
 			vkDestroyBuffer(device->logicalDevice, indexStaging.buffer, nullptr);
-			vkFreeMemory(device->logicalDevice, indexStaging.memory, nullptr);
+			device->memoryAllocator->free(indexStaging.allocation);
 
 			getSceneDimensions();
 
+			if (!nodeDescriptors) {
+				return;
+			}
+
 			// Setup descriptors
 			uint32_t uboCount{ 0 };
 			for (auto node : linearNodes) {
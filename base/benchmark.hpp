@@ -13,14 +13,194 @@
 #include <functional>
 #include <chrono>
 #include <iomanip>
+#include <numeric>
+#include <cmath>
+#include <fstream>
+#include <sstream>
+#include <iostream>
+#include <cstdlib>
+#include <assert.h>
+#include <glm/glm.hpp>
 
 namespace vks
 {
+	/**
+	* @brief Keyframed camera path for the benchmark mode, so every run renders the same views at the same simulated times
+	* The scenario is split into named segments (e.g. water, terrain or shadow heavy views) that are measured separately
+	*/
+	class BenchmarkScenario {
+	public:
+		struct Keyframe {
+			// In seconds from the start of the segment
+			float time = 0.0f;
+			// Camera position and rotation (in degrees)
+			glm::vec3 position = glm::vec3(0.0f);
+			glm::vec3 rotation = glm::vec3(0.0f);
+			glm::vec3 lightDir = glm::vec3(0.0f, 1.0f, 0.0f);
+			// Value of the example's global animation timer
+			float timer = 0.0f;
+		};
+		struct Segment {
+			std::string name;
+			std::vector<Keyframe> keyframes;
+			float getDuration() const {
+				return keyframes.empty() ? 0.0f : keyframes.back().time;
+			}
+		};
+
+		// Simulated time between two frames in seconds, independent of the actual frame time
+		float timestep = 1.0f / 60.0f;
+		std::vector<Segment> segments;
+
+		/**
+		* @brief Loads a scenario from a text file with one statement per line, lines starting with # are ignored
+		* timestep <seconds>
+		* segment <name>
+		* key <time> <position x y z> <rotation x y z> <light direction x y z> <timer>
+		*/
+		bool loadFromFile(const std::string& filename) {
+			std::ifstream file(filename);
+			if (!file.is_open()) {
+				std::cerr << "Could not open benchmark scenario file \"" << filename << "\"" << std::endl;
+				return false;
+			}
+			segments.clear();
+			std::string line;
+			uint32_t lineNumber = 0;
+			while (std::getline(file, line)) {
+				lineNumber++;
+				std::istringstream stream(line);
+				std::string statement;
+				if (!(stream >> statement) || (statement[0] == '#')) {
+					continue;
+				}
+				bool valid = true;
+				if (statement == "timestep") {
+					valid = (stream >> timestep) && (timestep > 0.0f);
+				} else if (statement == "segment") {
+					Segment segment;
+					std::getline(stream >> std::ws, segment.name);
+					valid = !segment.name.empty();
+					segments.push_back(segment);
+				} else if (statement == "key") {
+					Keyframe keyframe;
+					valid = !segments.empty() && (stream >> keyframe.time
+						>> keyframe.position.x >> keyframe.position.y >> keyframe.position.z
+						>> keyframe.rotation.x >> keyframe.rotation.y >> keyframe.rotation.z
+						>> keyframe.lightDir.x >> keyframe.lightDir.y >> keyframe.lightDir.z
+						>> keyframe.timer);
+					// Keyframes need to be in chronological order
+					valid = valid && (segments.back().keyframes.empty() || (keyframe.time > segments.back().keyframes.back().time));
+					if (valid) {
+						segments.back().keyframes.push_back(keyframe);
+					}
+				} else {
+					valid = false;
+				}
+				if (!valid) {
+					std::cerr << "Invalid statement in benchmark scenario file \"" << filename << "\" at line " << lineNumber << std::endl;
+					segments.clear();
+					return false;
+				}
+			}
+			segments.erase(std::remove_if(segments.begin(), segments.end(), [](const Segment& segment) { return segment.keyframes.empty(); }), segments.end());
+			return !segments.empty();
+		}
+
+		/** @brief Linear interpolation between the segment's keyframes surrounding the given time */
+		static Keyframe evaluate(const Segment& segment, float time) {
+			assert(!segment.keyframes.empty());
+			if (time <= segment.keyframes.front().time) {
+				return segment.keyframes.front();
+			}
+			for (size_t i = 1; i < segment.keyframes.size(); i++) {
+				const Keyframe& k0 = segment.keyframes[i - 1];
+				const Keyframe& k1 = segment.keyframes[i];
+				if (time <= k1.time) {
+					const float t = (time - k0.time) / (k1.time - k0.time);
+					Keyframe keyframe;
+					keyframe.time = time;
+					keyframe.position = glm::mix(k0.position, k1.position, t);
+					keyframe.rotation = glm::mix(k0.rotation, k1.rotation, t);
+					keyframe.lightDir = glm::mix(k0.lightDir, k1.lightDir, t);
+					keyframe.timer = glm::mix(k0.timer, k1.timer, t);
+					return keyframe;
+				}
+			}
+			return segment.keyframes.back();
+		}
+	};
+
 	class Benchmark {
 	private:
 		FILE *stream;
-		VkPhysicalDeviceProperties deviceProps;
+		VkPhysicalDeviceProperties deviceProps{};
+		// Nearest rank percentile of sorted values
+		static double percentile(const std::vector<double>& sorted, double p) {
+			// The epsilon keeps floating point errors from rounding up exact ranks
+			size_t rank = (size_t)std::ceil(p / 100.0 * (double)sorted.size() - 1e-9);
+			rank = std::min(std::max(rank, (size_t)1), sorted.size());
+			return sorted[rank - 1];
+		}
+		static std::string escapeJson(const std::string& str) {
+			std::string escaped;
+			for (char c : str) {
+				if ((c == '"') || (c == '\\')) {
+					escaped += '\\';
+				}
+				escaped += c;
+			}
+			return escaped;
+		}
+		static std::string unescapeJson(const std::string& str) {
+			std::string unescaped;
+			for (size_t i = 0; i < str.size(); i++) {
+				if ((str[i] == '\\') && (i + 1 < str.size())) {
+					i++;
+				}
+				unescaped += str[i];
+			}
+			return unescaped;
+		}
 	public:
+		// Distribution of a series of times in milliseconds
+		struct Statistics {
+			uint32_t count = 0;
+			double min = 0.0;
+			double max = 0.0;
+			double avg = 0.0;
+			double stdDev = 0.0;
+			double p50 = 0.0;
+			double p90 = 0.0;
+			double p99 = 0.0;
+			double p999 = 0.0;
+			// Number of times above twice the median, these show up as hitches the average hides
+			uint32_t stutterCount = 0;
+		};
+
+		static Statistics getStatistics(std::vector<double> times) {
+			Statistics statistics;
+			if (times.empty()) {
+				return statistics;
+			}
+			std::sort(times.begin(), times.end());
+			statistics.count = static_cast<uint32_t>(times.size());
+			statistics.min = times.front();
+			statistics.max = times.back();
+			statistics.avg = std::accumulate(times.begin(), times.end(), 0.0) / (double)times.size();
+			double variance = 0.0;
+			for (auto time : times) {
+				variance += (time - statistics.avg) * (time - statistics.avg);
+			}
+			statistics.stdDev = std::sqrt(variance / (double)times.size());
+			statistics.p50 = percentile(times, 50.0);
+			statistics.p90 = percentile(times, 90.0);
+			statistics.p99 = percentile(times, 99.0);
+			statistics.p999 = percentile(times, 99.9);
+			statistics.stutterCount = static_cast<uint32_t>(times.end() - std::upper_bound(times.begin(), times.end(), 2.0 * statistics.p50));
+			return statistics;
+		}
+
 		bool active = false;
 		bool outputFrameTimes = false;
 		uint32_t warmup = 1;
@@ -31,7 +211,71 @@ namespace vks
 		double runtime = 0.0;
 		uint32_t frameCount = 0;
 
-		void run(std::function<void()> renderFunc, VkPhysicalDeviceProperties deviceProps) {
+		// Optional scripted camera path, replaces the fixed duration if it has been loaded
+		BenchmarkScenario scenario;
+		// Frame times of each of the scenario's segments
+		std::vector<std::vector<double>> segmentTimes;
+
+		// Optional GPU times of named passes, reported by the example while the benchmark is running
+		bool measuring = false;
+		std::vector<std::string> passNames;
+		std::vector<std::vector<double>> passTimes;
+
+		void addPassTime(const std::string& name, double ms) {
+			if (!measuring) {
+				return;
+			}
+			auto it = std::find(passNames.begin(), passNames.end(), name);
+			if (it == passNames.end()) {
+				passNames.push_back(name);
+				passTimes.push_back({});
+				it = passNames.end() - 1;
+			}
+			passTimes[it - passNames.begin()].push_back(ms);
+		}
+
+		// Optional results file (JSON) of a previous run the results are compared against
+		std::string baselineFilename = "";
+		// Relative increase (in percent) of a metric's average or p99 time that fails the comparison
+		double regressionThreshold = 5.0;
+		// Maximum probability of the increase being random noise for it to count as a regression
+		double significanceLevel = 0.05;
+
+		// Distribution of a single metric (all frames, a scenario segment or a pass)
+		struct Metric {
+			std::string name;
+			Statistics statistics;
+			// Raw times of the run, empty if loaded from a results file written without them
+			std::vector<double> times;
+		};
+
+		std::vector<Metric> getMetrics() {
+			std::vector<Metric> metrics;
+			Metric metric;
+			metric.name = "frame time";
+			metric.times = frameTimes;
+			metrics.push_back(metric);
+			for (size_t i = 0; i < segmentTimes.size(); i++) {
+				metric.name = "segment " + scenario.segments[i].name;
+				metric.times = segmentTimes[i];
+				metrics.push_back(metric);
+			}
+			for (size_t i = 0; i < passNames.size(); i++) {
+				metric.name = "pass " + passNames[i];
+				metric.times = passTimes[i];
+				metrics.push_back(metric);
+			}
+			for (auto& m : metrics) {
+				m.statistics = getStatistics(m.times);
+			}
+			return metrics;
+		}
+
+		/**
+		* @brief Renders frames for the benchmark's duration, or along the scenario's segments if one has been loaded
+		* With a scenario, keyframeFunc is called before each frame with the camera pose and the fixed simulated timestep
+		*/
+		void run(std::function<void()> renderFunc, VkPhysicalDeviceProperties deviceProps, std::function<void(const BenchmarkScenario::Keyframe&, float)> keyframeFunc = nullptr) {
 			active = true;
 			this->deviceProps = deviceProps;
 #if defined(_WIN32)
@@ -41,6 +285,11 @@ namespace vks
 #endif
 			std::cout << std::fixed << std::setprecision(3);
 
+			const bool scripted = !scenario.segments.empty() && keyframeFunc;
+			if (scripted) {
+				keyframeFunc(scenario.segments[0].keyframes[0], scenario.timestep);
+			}
+
 			// Warm up phase to get more stable frame rates
 			{
 				double tMeasured = 0.0;
@@ -52,9 +301,32 @@ namespace vks
 				};
 			}
 
+			// Scripted benchmark phase, each segment is played back at the fixed timestep
+			// The number of frames only depends on the scenario, so frame times of different runs can be compared directly
+			if (scripted) {
+				measuring = true;
+				segmentTimes.resize(scenario.segments.size());
+				for (size_t i = 0; i < scenario.segments.size(); i++) {
+					const BenchmarkScenario::Segment& segment = scenario.segments[i];
+					const uint32_t segmentFrames = (uint32_t)std::floor(segment.getDuration() / scenario.timestep + 1e-4f) + 1;
+					for (uint32_t j = 0; j < segmentFrames; j++) {
+						keyframeFunc(BenchmarkScenario::evaluate(segment, (float)j * scenario.timestep), scenario.timestep);
+						auto tStart = std::chrono::high_resolution_clock::now();
+						renderFunc();
+						auto tDiff = std::chrono::duration<double, std::milli>(std::chrono::high_resolution_clock::now() - tStart).count();
+						runtime += tDiff;
+						frameTimes.push_back(tDiff);
+						segmentTimes[i].push_back(tDiff);
+						frameCount++;
+					}
+				}
+				measuring = false;
+			}
+
 			// Benchmark phase
 			{
-				while (runtime < (duration * 1000.0)) {
+				measuring = !scripted;
+				while (!scripted && (runtime < (duration * 1000.0))) {
 					auto tStart = std::chrono::high_resolution_clock::now();
 					renderFunc();
 					auto tDiff = std::chrono::duration<double, std::milli>(std::chrono::high_resolution_clock::now() - tStart).count();
@@ -62,11 +334,23 @@ namespace vks
 					frameTimes.push_back(tDiff);
 					frameCount++;
 				};
+				measuring = false;
 				std::cout << "Benchmark finished" << std::endl;
 				std::cout << "device : " << deviceProps.deviceName << " (driver version: " << deviceProps.driverVersion << ")" << std::endl;
 				std::cout << "runtime: " << (runtime / 1000.0) << std::endl;
 				std::cout << "frames : " << frameCount << std::endl;
 				std::cout << "fps    : " << frameCount / (runtime / 1000.0) << std::endl;
+				const Statistics statistics = getStatistics(frameTimes);
+				std::cout << "p50    : " << statistics.p50 << " ms" << std::endl;
+				std::cout << "p90    : " << statistics.p90 << " ms" << std::endl;
+				std::cout << "p99    : " << statistics.p99 << " ms" << std::endl;
+				std::cout << "p99.9  : " << statistics.p999 << " ms" << std::endl;
+				std::cout << "stddev : " << statistics.stdDev << " ms" << std::endl;
+				std::cout << "stutter: " << statistics.stutterCount << " frames above twice the median" << std::endl;
+				for (size_t i = 0; i < segmentTimes.size(); i++) {
+					const Statistics segmentStatistics = getStatistics(segmentTimes[i]);
+					std::cout << "segment \"" << scenario.segments[i].name << "\": " << segmentStatistics.count << " frames, avg " << segmentStatistics.avg << " ms, p99 " << segmentStatistics.p99 << " ms, " << segmentStatistics.stutterCount << " stutters" << std::endl;
+				}
 			}
 		}
 
@@ -78,6 +362,26 @@ namespace vks
 				result << "device,driverversion,duration (ms),frames,fps" << std::endl;
 				result << deviceProps.deviceName << "," << deviceProps.driverVersion << "," << runtime << "," << frameCount << "," << frameCount / (runtime / 1000.0) << std::endl;
 
+				const Statistics statistics = getStatistics(frameTimes);
+				result << std::endl << "min (ms),max (ms),avg (ms),stddev (ms),p50 (ms),p90 (ms),p99 (ms),p99.9 (ms),stutters" << std::endl;
+				result << statistics.min << "," << statistics.max << "," << statistics.avg << "," << statistics.stdDev << "," << statistics.p50 << "," << statistics.p90 << "," << statistics.p99 << "," << statistics.p999 << "," << statistics.stutterCount << std::endl;
+
+				if (!segmentTimes.empty()) {
+					result << std::endl << "segment,frames,avg (ms),stddev (ms),p50 (ms),p90 (ms),p99 (ms),p99.9 (ms),stutters" << std::endl;
+					for (size_t i = 0; i < segmentTimes.size(); i++) {
+						const Statistics segmentStatistics = getStatistics(segmentTimes[i]);
+						result << scenario.segments[i].name << "," << segmentStatistics.count << "," << segmentStatistics.avg << "," << segmentStatistics.stdDev << "," << segmentStatistics.p50 << "," << segmentStatistics.p90 << "," << segmentStatistics.p99 << "," << segmentStatistics.p999 << "," << segmentStatistics.stutterCount << std::endl;
+					}
+				}
+
+				if (!passNames.empty()) {
+					result << std::endl << "pass,samples,gpu avg (ms),gpu min (ms),gpu max (ms)" << std::endl;
+					for (size_t i = 0; i < passNames.size(); i++) {
+						const Statistics passStatistics = getStatistics(passTimes[i]);
+						result << passNames[i] << "," << passStatistics.count << "," << passStatistics.avg << "," << passStatistics.min << "," << passStatistics.max << std::endl;
+					}
+				}
+
 				if (outputFrameTimes) {
 					result << std::endl << "frame,ms" << std::endl;
 					for (size_t i = 0; i < frameTimes.size(); i++) {
@@ -97,6 +401,262 @@ namespace vks
 				FreeConsole();
 #endif
 			}
+			saveJson(getJsonFilename());
+		}
+
+		/** @brief The JSON results are saved next to the CSV file, replacing its extension */
+		std::string getJsonFilename() {
+			const std::string extension = ".csv";
+			if ((filename.size() > extension.size()) && (filename.compare(filename.size() - extension.size(), extension.size(), extension) == 0)) {
+				return filename.substr(0, filename.size() - extension.size()) + ".json";
+			}
+			return filename + ".json";
+		}
+
+		void writeJsonStatistics(std::ofstream& result, const Statistics& statistics, const std::string& indent) {
+			result << indent << "\"count\": " << statistics.count << "," << std::endl;
+			result << indent << "\"min\": " << statistics.min << "," << std::endl;
+			result << indent << "\"max\": " << statistics.max << "," << std::endl;
+			result << indent << "\"avg\": " << statistics.avg << "," << std::endl;
+			result << indent << "\"stddev\": " << statistics.stdDev << "," << std::endl;
+			result << indent << "\"p50\": " << statistics.p50 << "," << std::endl;
+			result << indent << "\"p90\": " << statistics.p90 << "," << std::endl;
+			result << indent << "\"p99\": " << statistics.p99 << "," << std::endl;
+			result << indent << "\"p99.9\": " << statistics.p999 << "," << std::endl;
+			result << indent << "\"stutters\": " << statistics.stutterCount << std::endl;
+		}
+
+		/** @brief Writes all times on a single line, so a later run can be tested against the exact distribution instead of a binned one */
+		void writeJsonTimes(std::ofstream& result, const std::vector<double>& times, const std::string& indent) {
+			result << indent << "\"times\": [";
+			for (size_t i = 0; i < times.size(); i++) {
+				result << (i > 0 ? ", " : "") << times[i];
+			}
+			result << "]," << std::endl;
+		}
+
+		void saveJson(const std::string& jsonFilename) {
+			std::ofstream result(jsonFilename, std::ios::out);
+			if (!result.is_open()) {
+				return;
+			}
+			result << std::fixed << std::setprecision(4);
+			result << "{" << std::endl;
+			result << "  \"device\": \"" << escapeJson(deviceProps.deviceName) << "\"," << std::endl;
+			result << "  \"driverVersion\": " << deviceProps.driverVersion << "," << std::endl;
+			result << "  \"warmup\": " << warmup << "," << std::endl;
+			result << "  \"duration\": " << duration << "," << std::endl;
+			result << "  \"runtime\": " << runtime << "," << std::endl;
+			result << "  \"frames\": " << frameCount << "," << std::endl;
+			result << "  \"fps\": " << ((runtime > 0.0) ? frameCount / (runtime / 1000.0) : 0.0) << "," << std::endl;
+			result << "  \"frameTimes\": {" << std::endl;
+			writeJsonStatistics(result, getStatistics(frameTimes), "    ");
+			result << "  }," << std::endl;
+			writeJsonTimes(result, frameTimes, "  ");
+			result << "  \"segments\": [";
+			for (size_t i = 0; i < segmentTimes.size(); i++) {
+				result << (i > 0 ? "," : "") << std::endl;
+				result << "    {" << std::endl;
+				result << "      \"name\": \"" << escapeJson(scenario.segments[i].name) << "\"," << std::endl;
+				writeJsonTimes(result, segmentTimes[i], "      ");
+				writeJsonStatistics(result, getStatistics(segmentTimes[i]), "      ");
+				result << "    }";
+			}
+			result << (segmentTimes.empty() ? "" : "\n  ") << "]," << std::endl;
+			result << "  \"passes\": [";
+			for (size_t i = 0; i < passNames.size(); i++) {
+				result << (i > 0 ? "," : "") << std::endl;
+				result << "    {" << std::endl;
+				result << "      \"name\": \"" << escapeJson(passNames[i]) << "\"," << std::endl;
+				writeJsonTimes(result, passTimes[i], "      ");
+				writeJsonStatistics(result, getStatistics(passTimes[i]), "      ");
+				result << "    }";
+			}
+			result << (passNames.empty() ? "" : "\n  ") << "]" << std::endl;
+			result << "}" << std::endl;
+		}
+
+		/** @brief Reads the metrics from a results file written by saveJson, this expects the exact layout written there */
+		static bool loadMetrics(const std::string& jsonFilename, std::vector<Metric>& metrics) {
+			std::ifstream file(jsonFilename);
+			if (!file.is_open()) {
+				return false;
+			}
+			metrics.clear();
+			std::string line;
+			std::string section = "";
+			// Metric the statistics are read into, -1 while outside of one
+			int32_t current = -1;
+			while (std::getline(file, line)) {
+				const size_t keyStart = line.find('"');
+				const size_t keyEnd = (keyStart != std::string::npos) ? line.find("\": ", keyStart + 1) : std::string::npos;
+				if (keyEnd == std::string::npos) {
+					continue;
+				}
+				const std::string key = line.substr(keyStart + 1, keyEnd - keyStart - 1);
+				std::string value = line.substr(keyEnd + 3);
+				if (!value.empty() && (value.back() == ',')) {
+					value.pop_back();
+				}
+				if (key == "frameTimes") {
+					Metric metric;
+					metric.name = "frame time";
+					metrics.push_back(metric);
+					current = static_cast<int32_t>(metrics.size()) - 1;
+				} else if ((key == "segments") || (key == "passes")) {
+					section = (key == "segments") ? "segment " : "pass ";
+					current = -1;
+				} else if ((key == "name") && !section.empty() && (value.size() >= 2)) {
+					Metric metric;
+					metric.name = section + unescapeJson(value.substr(1, value.size() - 2));
+					metrics.push_back(metric);
+					current = static_cast<int32_t>(metrics.size()) - 1;
+				} else if ((key == "times") && (current >= 0)) {
+					// The times follow the metric they belong to
+					std::istringstream times(value.substr(value.find('[') + 1));
+					std::string time;
+					metrics[current].times.clear();
+					while (std::getline(times, time, ',')) {
+						if (time.find_first_of("0123456789") != std::string::npos) {
+							metrics[current].times.push_back(std::atof(time.c_str()));
+						}
+					}
+				} else if (current >= 0) {
+					Statistics& statistics = metrics[current].statistics;
+					const double number = std::atof(value.c_str());
+					if (key == "count") statistics.count = static_cast<uint32_t>(number);
+					if (key == "min") statistics.min = number;
+					if (key == "max") statistics.max = number;
+					if (key == "avg") statistics.avg = number;
+					if (key == "stddev") statistics.stdDev = number;
+					if (key == "p50") statistics.p50 = number;
+					if (key == "p90") statistics.p90 = number;
+					if (key == "p99") statistics.p99 = number;
+					if (key == "p99.9") statistics.p999 = number;
+					if (key == "stutters") statistics.stutterCount = static_cast<uint32_t>(number);
+				}
+			}
+			return !metrics.empty();
+		}
+
+		/**
+		* @brief One-sided p-value of the Mann-Whitney U test for the current times being larger than the baseline's
+		* Frame times are skewed and have long tails, so this compares the whole distributions instead of assuming normal averages
+		* Uses the normal approximation with tie correction, which is close enough for the sample counts of a benchmark run
+		* Consecutive frame times are not independent, so the test is only used to filter noise on top of the thresholds
+		*/
+		static double getRegressionProbability(const std::vector<double>& baseline, const std::vector<double>& current) {
+			const double n = (double)baseline.size();
+			const double m = (double)current.size();
+			if ((n < 2.0) || (m < 2.0)) {
+				return 1.0;
+			}
+			// Ranks of all times, equal times share the average of their ranks
+			std::vector<std::pair<double, bool>> ranked;
+			ranked.reserve(baseline.size() + current.size());
+			for (auto time : baseline) {
+				ranked.push_back(std::make_pair(time, false));
+			}
+			for (auto time : current) {
+				ranked.push_back(std::make_pair(time, true));
+			}
+			std::sort(ranked.begin(), ranked.end());
+			double rankSum = 0.0;
+			double ties = 0.0;
+			for (size_t i = 0; i < ranked.size();) {
+				size_t j = i;
+				double currentCount = 0.0;
+				while ((j < ranked.size()) && (ranked[j].first == ranked[i].first)) {
+					currentCount += ranked[j].second ? 1.0 : 0.0;
+					j++;
+				}
+				const double t = (double)(j - i);
+				rankSum += currentCount * ((double)(i + 1 + j) / 2.0);
+				ties += t * t * t - t;
+				i = j;
+			}
+			const double u = rankSum - m * (m + 1.0) / 2.0;
+			const double total = n + m;
+			const double mean = n * m / 2.0;
+			const double variance = n * m / 12.0 * ((total + 1.0) - ties / (total * (total - 1.0)));
+			if (variance <= 0.0) {
+				return (u > mean) ? 0.0 : 1.0;
+			}
+			const double z = (u - mean) / std::sqrt(variance);
+			return 0.5 * std::erfc(z / std::sqrt(2.0));
+		}
+
+		/**
+		* @brief One-sided p-value of a two proportion z-test for more of the current times lying above the baseline's tail threshold (e.g. its p99)
+		* The rank test above hardly reacts to a few more slow frames, so a worse p99 is tested separately
+		*/
+		static double getTailRegressionProbability(const std::vector<double>& baseline, const std::vector<double>& current, double threshold) {
+			const double n = (double)baseline.size();
+			const double m = (double)current.size();
+			if ((n < 2.0) || (m < 2.0)) {
+				return 1.0;
+			}
+			const double baselineTail = (double)std::count_if(baseline.begin(), baseline.end(), [threshold](double time) { return time > threshold; });
+			const double currentTail = (double)std::count_if(current.begin(), current.end(), [threshold](double time) { return time > threshold; });
+			const double pooled = (baselineTail + currentTail) / (n + m);
+			const double standardError = std::sqrt(pooled * (1.0 - pooled) * (1.0 / n + 1.0 / m));
+			const double difference = currentTail / m - baselineTail / n;
+			if (standardError <= 0.0) {
+				return (difference > 0.0) ? 0.0 : 1.0;
+			}
+			const double z = difference / standardError;
+			return 0.5 * std::erfc(z / std::sqrt(2.0));
+		}
+
+		/**
+		* @brief Compares all metrics of this run against the baseline results file and prints the deltas
+		* Returns false if the baseline can't be loaded or any metric's average or p99 got slower by more than the threshold with statistical significance
+		* Baselines written without raw times can't be tested for significance, so for those the thresholds alone decide
+		*/
+		bool compareToBaseline() {
+			std::vector<Metric> baselineMetrics;
+			if (!loadMetrics(baselineFilename, baselineMetrics)) {
+				std::cerr << "Could not load benchmark baseline \"" << baselineFilename << "\"" << std::endl;
+				return false;
+			}
+			const std::vector<Metric> metrics = getMetrics();
+			bool passed = true;
+			std::cout << std::fixed << std::setprecision(3);
+			std::cout << "Comparison against baseline \"" << baselineFilename << "\" (threshold " << regressionThreshold << "%, significance level " << significanceLevel << ")" << std::endl;
+			for (auto& metric : metrics) {
+				auto baseline = std::find_if(baselineMetrics.begin(), baselineMetrics.end(), [&metric](const Metric& m) { return m.name == metric.name; });
+				if ((baseline == baselineMetrics.end()) || (baseline->statistics.count == 0) || (metric.statistics.count == 0)) {
+					std::cout << metric.name << ": not in baseline" << std::endl;
+					continue;
+				}
+				const Statistics& b = baseline->statistics;
+				const Statistics& c = metric.statistics;
+				const double delta = (b.avg > 0.0) ? (c.avg - b.avg) / b.avg * 100.0 : 0.0;
+				const double deltaP99 = (b.p99 > 0.0) ? (c.p99 - b.p99) / b.p99 * 100.0 : 0.0;
+				const bool hasTimes = !baseline->times.empty();
+				double probability = 0.0;
+				double tailProbability = 0.0;
+				if (hasTimes) {
+					probability = getRegressionProbability(baseline->times, metric.times);
+					tailProbability = getTailRegressionProbability(baseline->times, metric.times, b.p99);
+				}
+				const bool regression = ((delta > regressionThreshold) && (probability < significanceLevel)) || ((deltaP99 > regressionThreshold) && (tailProbability < significanceLevel));
+				passed = passed && !regression;
+				std::cout << metric.name << ": avg " << b.avg << " -> " << c.avg << " ms (" << std::showpos << delta << "%), p99 " << std::noshowpos << b.p99 << " -> " << c.p99 << " ms (" << std::showpos << deltaP99 << "%)" << std::noshowpos;
+				if (hasTimes) {
+					std::cout << ", p = " << probability << " (avg), " << tailProbability << " (p99)";
+				} else {
+					std::cout << ", no times in baseline";
+				}
+				std::cout << (regression ? " REGRESSION" : "") << std::endl;
+			}
+			for (auto& baseline : baselineMetrics) {
+				if (std::find_if(metrics.begin(), metrics.end(), [&baseline](const Metric& m) { return m.name == baseline.name; }) == metrics.end()) {
+					std::cout << baseline.name << ": only in baseline" << std::endl;
+				}
+			}
+			std::cout << (passed ? "No regressions" : "Regressions found") << std::endl;
+			return passed;
 		}
 	};
 }
\ No newline at end of file
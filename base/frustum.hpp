@@ -6,6 +6,8 @@
 * This code is licensed under the MIT license (MIT) (http://opensource.org/licenses/MIT)
 */
 
+#pragma once
+
 #include <array>
 #include <math.h>
 #include <glm/glm.hpp>
@@ -68,5 +70,31 @@ namespace vks
 			}
 			return true;
 		}
+
+		/**
+		* Check if an axis aligned bounding box is (partially) inside the frustum
+		*
+		* @param min Minimum corner of the box
+		* @param max Maximum corner of the box
+		* @param ignoreBackPlane Don't test against the BACK plane (z >= -w), e.g. for shadow casters between the light and its near plane
+		* This is the plane on the near side of the volume, but with GLM_FORCE_DEPTH_ZERO_TO_ONE it lies behind the actual near clip plane (z >= 0)
+		*/
+		bool checkBox(const glm::vec3& min, const glm::vec3& max, bool ignoreBackPlane = false) const
+		{
+			for (size_t i = 0; i < planes.size(); i++)
+			{
+				if (ignoreBackPlane && (i == BACK))
+				{
+					continue;
+				}
+				// Test the corner of the box that lies furthest along the plane's normal
+				const glm::vec3 p = glm::vec3(planes[i].x >= 0.0f ? max.x : min.x, planes[i].y >= 0.0f ? max.y : min.y, planes[i].z >= 0.0f ? max.z : min.z);
+				if ((planes[i].x * p.x) + (planes[i].y * p.y) + (planes[i].z * p.z) + planes[i].w < 0.0f)
+				{
+					return false;
+				}
+			}
+			return true;
+		}
 	};
 }
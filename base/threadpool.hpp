@@ -6,7 +6,10 @@
 * This code is licensed under the MIT license (MIT) (http://opensource.org/licenses/MIT)
 */
 
+#pragma once
+
 #include <vector>
+#include <memory>
 #include <thread>
 #include <queue>
 #include <mutex>
@@ -97,17 +100,27 @@ namespace vks
 	{
 	public:
 		std::vector<std::unique_ptr<Thread>> threads;
+		// Thread that receives the next job added to the pool
+		size_t nextThread = 0;
 
 		// Sets the number of threads to be allocted in this pool
 		void setThreadCount(uint32_t count)
 		{
 			threads.clear();
+			nextThread = 0;
 			for (auto i = 0; i < count; i++)
 			{
 				threads.push_back(make_unique<Thread>());
 			}
 		}
 
+		// Add a new job to the pool, jobs are distributed across the threads in a round-robin fashion
+		void addJob(std::function<void()> function)
+		{
+			threads[nextThread]->addJob(std::move(function));
+			nextThread = (nextThread + 1) % threads.size();
+		}
+
 		// Wait until all threads have finished their work items
 		void wait()
 		{
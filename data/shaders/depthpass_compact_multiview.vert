@@ -0,0 +1,50 @@
+#version 450
+
+#extension GL_EXT_multiview : enable
+
+// Compact terrain vertices only store height and normal, position and uv are derived from the vertex index
+layout (location = 0) in float inHeight;
+
+layout (constant_id = 0) const uint PATCH_SIZE = 256;
+layout (constant_id = 1) const float SCALE_X = 1.0;
+layout (constant_id = 2) const float SCALE_Z = 1.0;
+layout (constant_id = 3) const float HEIGHT_SCALE = 1.0;
+layout (constant_id = 4) const float SKIRT_OFFSET = 0.0;
+layout (constant_id = 5) const float UV_SCALE = 1.0;
+
+// todo: pass via specialization constant
+#define SHADOW_MAP_CASCADE_COUNT 4
+
+layout(push_constant) uniform PushConsts {
+	vec4 position;
+	uint cascadeIndex;
+} pushConsts;
+
+layout (binding = 0) uniform UBO {
+	mat4[SHADOW_MAP_CASCADE_COUNT] cascadeViewProjMat;
+} ubo;
+
+layout (location = 0) out vec2 outUV;
+
+out gl_PerVertex {
+	vec4 gl_Position;   
+};
+
+void main()
+{
+	// The skirt vertices follow the grid vertices
+	const uint vertexCount = PATCH_SIZE * PATCH_SIZE;
+	uint index = uint(gl_VertexIndex);
+	bool skirt = index >= vertexCount;
+	index = index % vertexCount;
+	vec2 grid = vec2(index % PATCH_SIZE, index / PATCH_SIZE);
+
+	outUV = grid / float(PATCH_SIZE) * UV_SCALE;
+	vec3 pos = vec3((grid * 2.0 + 1.0 - float(PATCH_SIZE)) * vec2(SCALE_X, SCALE_Z), -inHeight * HEIGHT_SCALE + 1.0).xzy;
+	if (skirt) {
+		pos.y += SKIRT_OFFSET;
+	}
+	pos += pushConsts.position.xyz;
+	// All cascades are rendered in a single pass, the view index selects the cascade
+	gl_Position =  ubo.cascadeViewProjMat[gl_ViewIndex] * vec4(pos, 1.0);
+}
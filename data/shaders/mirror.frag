@@ -10,6 +10,7 @@ layout (binding = 0) uniform UBO
 	vec4 cameraPos;
 	vec4 lightDir;
 	float time;
+	float resolutionScale;
 } ubo;
 
 layout (binding = 5) uniform UBOCSM {
@@ -139,10 +140,14 @@ void main()
 
 	vec4 dudv = normal * distortAmount;
 
+	// The refraction and reflection passes may only have rendered to part of their targets
+	vec2 maxUV = vec2(ubo.resolutionScale) - 0.5 / vec2(textureSize(samplerRefraction, 0));
+	vec2 targetUV = clamp((vec2(projCoord) + dudv.st) * ubo.resolutionScale, vec2(0.0), maxUV);
+
 	if (gl_FrontFacing) {
 		float shadow = shadowMapping();
-		vec4 refraction = texture(samplerRefraction, vec2(projCoord) + dudv.st) * (ambient + shadow);
-		vec4 reflection = texture(samplerReflection, vec2(projCoord) + dudv.st) * (ambient + shadow);
+		vec4 refraction = texture(samplerRefraction, targetUV) * (ambient + shadow);
+		vec4 reflection = texture(samplerReflection, targetUV) * (ambient + shadow);
 		outFragColor = mix(refraction, reflection, fresnel);
 	} else{
 		outFragColor = vec4(0.0, 0.0, 0.0, 1.0);
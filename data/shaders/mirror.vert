@@ -11,6 +11,7 @@ layout (binding = 0) uniform UBO
 	vec4 cameraPos;
 	vec4 lightDir;
 	float time;
+	float resolutionScale;
 } ubo;
 
 layout (location = 0) out vec2 outUV;
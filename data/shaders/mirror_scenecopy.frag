@@ -0,0 +1,178 @@
+#version 450
+
+#define SHADOW_MAP_CASCADE_COUNT 4
+#define ambient 0.2
+
+layout (binding = 0) uniform UBO 
+{
+	mat4 projection;
+	mat4 model;
+	vec4 cameraPos;
+	vec4 lightDir;
+	float time;
+	float resolutionScale;
+} ubo;
+
+layout (binding = 5) uniform UBOCSM {
+	vec4 cascadeSplits;
+	mat4 cascadeViewProjMat[SHADOW_MAP_CASCADE_COUNT];
+	mat4 inverseViewMat;
+	vec4 lightDir;
+} uboCSM;
+
+// Copies of the main pass' color and depth, taken after the opaque geometry has been drawn
+layout (set = 0, binding = 1) uniform sampler2D samplerSceneColor;
+layout (set = 0, binding = 2) uniform sampler2D samplerReflection;
+layout (set = 0, binding = 3) uniform sampler2D samplerWaterNormalMap;
+layout (set = 0, binding = 4) uniform sampler2DArray shadowMap;
+layout (set = 0, binding = 6) uniform sampler2D samplerSceneDepth;
+
+layout (location = 0) in vec2 inUV;
+layout (location = 1) in vec4 inPos;
+layout (location = 2) in vec3 inNormal;
+layout (location = 3) in vec3 inEyePos;
+layout (location = 5) in vec3 inViewPos;
+layout (location = 6) in vec3 inLPos;
+
+layout (location = 0) out vec4 outFragColor;
+
+const mat4 biasMat = mat4( 
+	0.5, 0.0, 0.0, 0.0,
+	0.0, 0.5, 0.0, 0.0,
+	0.0, 0.0, 1.0, 0.0,
+	0.5, 0.5, 0.0, 1.0 
+);
+
+float textureProj(vec4 shadowCoord, vec2 offset, uint cascadeIndex)
+{
+	float shadow = 1.0;
+	float bias = 0.005;
+
+	if ( shadowCoord.z > -1.0 && shadowCoord.z < 1.0 ) {
+		float dist = texture(shadowMap, vec3(shadowCoord.st + offset, cascadeIndex)).r;
+		if (shadowCoord.w > 0 && dist < shadowCoord.z - bias) {
+			shadow = ambient;
+		}
+	}
+	return shadow;
+
+}
+
+float filterPCF(vec4 sc, uint cascadeIndex)
+{
+	ivec2 texDim = textureSize(shadowMap, 0).xy;
+	float scale = 0.75;
+	float dx = scale * 1.0 / float(texDim.x);
+	float dy = scale * 1.0 / float(texDim.y);
+
+	float shadowFactor = 0.0;
+	int count = 0;
+	int range = 1;
+	
+	for (int x = -range; x <= range; x++) {
+		for (int y = -range; y <= range; y++) {
+			shadowFactor += textureProj(sc, vec2(dx*x, dy*y), cascadeIndex);
+			count++;
+		}
+	}
+	return shadowFactor / count;
+}
+
+float shadowMapping()
+{
+	// Get cascade index for the current fragment's view position
+	uint cascadeIndex = 0;
+	for(uint i = 0; i < SHADOW_MAP_CASCADE_COUNT - 1; ++i) {
+		if(inViewPos.z < uboCSM.cascadeSplits[i]) {	
+			cascadeIndex = i + 1;
+		}
+	}
+
+	// Depth compare for shadowing
+	vec4 shadowCoord = (biasMat * uboCSM.cascadeViewProjMat[cascadeIndex]) * vec4(inLPos, 1.0);	
+
+	float shadow = 0;
+	bool enablePCF = false;
+	if (enablePCF) {
+		return filterPCF(shadowCoord / shadowCoord.w, cascadeIndex);
+	} else {
+		return textureProj(shadowCoord / shadowCoord.w, vec2(0.0), cascadeIndex);
+	}
+}
+
+// Distance from the camera for a depth buffer value
+float linearDepth(float depth)
+{
+	return ubo.projection[3][2] / (depth + ubo.projection[2][2]);
+}
+
+float fog(float density)
+{
+	const float LOG2 = -1.442695;
+	float dist = gl_FragCoord.z / gl_FragCoord.w * 0.1;
+	float d = density * dist;
+	return 1.0 - clamp(exp2(d * d * LOG2), 0.0, 1.0);
+}
+
+void main() 
+{
+	const vec3 fogColor = vec3(0.47, 0.5, 0.67);
+
+	const vec4 tangent = vec4(1.0, 0.0, 0.0, 0.0);
+	const vec4 viewNormal = vec4(0.0, -1.0, 0.0, 0.0);
+	const vec4 bitangent = vec4(0.0, 0.0, 1.0, 0.0);
+	const float distortAmount = 0.05;
+	const float distortionFadeDepth = 0.5;
+
+	vec4 tmp = vec4(1.0 / inPos.w);
+	vec4 projCoord = inPos * tmp;
+
+	// Scale and bias
+	projCoord += vec4(1.0);
+	projCoord *= vec4(0.5);
+
+	float t = clamp(ubo.time / 6., 0., 1.);
+
+	vec2 coords = projCoord.st;
+	vec2 dir = coords - vec2(.5);
+	
+	float dist = distance(coords, vec2(.5));
+	vec2 offset = dir * (sin(dist * 80. - ubo.time*15.) + .5) / 30.;
+
+	vec4 normal = texture(samplerWaterNormalMap, inUV * 8.0 + ubo.time);
+	normal = normalize(normal * 2.0 - 1.0);
+
+	vec4 viewDir = normalize(vec4(inEyePos, 1.0));
+	vec4 viewTanSpace = normalize(vec4(dot(viewDir, tangent), dot(viewDir, bitangent), dot(viewDir, viewNormal), 1.0));	
+	vec4 viewReflection = normalize(reflect(-1.0 * viewTanSpace, normal));
+	float fresnel = dot(normal, viewReflection);	
+
+	vec4 dudv = normal * distortAmount;
+
+	// The reflection pass may only have rendered to part of its target
+	vec2 maxUV = vec2(ubo.resolutionScale) - 0.5 / vec2(textureSize(samplerReflection, 0));
+	vec2 reflectionUV = clamp((vec2(projCoord) + dudv.st) * ubo.resolutionScale, vec2(0.0), maxUV);
+
+	// The distortion fades out where the water gets shallow, so the shore line doesn't get displaced
+	float waterDepth = linearDepth(texture(samplerSceneDepth, projCoord.st).r) - linearDepth(gl_FragCoord.z);
+	vec2 refractionUV = projCoord.st + dudv.st * clamp(waterDepth / distortionFadeDepth, 0.0, 1.0);
+	// Geometry in front of the water must not be distorted into it
+	if (texture(samplerSceneDepth, refractionUV).r < gl_FragCoord.z) {
+		refractionUV = projCoord.st;
+	}
+
+	if (gl_FrontFacing) {
+		float shadow = shadowMapping();
+		// The scene copy has already been lit and shadowed
+		vec4 refraction = texture(samplerSceneColor, refractionUV);
+		vec4 reflection = texture(samplerReflection, reflectionUV) * (ambient + shadow);
+		outFragColor = mix(refraction, reflection, fresnel);
+	} else{
+		outFragColor = vec4(0.0, 0.0, 0.0, 1.0);
+	}
+
+	outFragColor.rgb = mix(outFragColor.rgb, fogColor, fog(0.5));
+
+	outFragColor.a = 1.0;
+//	outFragColor.rgb = fresnel.rrr;
+}
\ No newline at end of file
@@ -0,0 +1,25 @@
+#version 450 core
+
+#extension GL_EXT_nonuniform_qualifier : require
+
+layout (location = 0) in vec2 inUV;
+
+// Global texture array, the skysphere's texture is selected by its push constant index
+layout (set = 1, binding = 0) uniform sampler2D textures[];
+
+layout(push_constant) uniform PushConsts {
+	mat4 scale;
+	vec4 clipPlane;
+	uint shadows;
+	uint textureIndices[4];
+} pushConsts;
+
+#define samplerColorMap textures[pushConsts.textureIndices[0]]
+
+layout (location = 0) out vec4 outFragColor;
+
+void main(void)
+{
+	vec4 color = texture(samplerColorMap, inUV);
+	outFragColor = vec4(color.rgb, 1.0);
+}
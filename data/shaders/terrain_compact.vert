@@ -0,0 +1,75 @@
+#version 450
+
+// Compact terrain vertices only store height and normal, position and uv are derived from the vertex index
+layout (location = 0) in float inHeight;
+layout (location = 1) in vec2 inNormal;
+
+layout (constant_id = 0) const uint PATCH_SIZE = 256;
+layout (constant_id = 1) const float SCALE_X = 1.0;
+layout (constant_id = 2) const float SCALE_Z = 1.0;
+layout (constant_id = 3) const float HEIGHT_SCALE = 1.0;
+layout (constant_id = 4) const float SKIRT_OFFSET = 0.0;
+layout (constant_id = 5) const float UV_SCALE = 1.0;
+
+layout (set = 0, binding = 0) uniform UBO 
+{
+	mat4 projection;
+	mat4 modelview;
+	vec4 lightDir;
+} ubo;
+
+layout (location = 0) out vec3 outNormal;
+layout (location = 1) out vec2 outUV;
+layout (location = 2) out vec3 outViewVec;
+layout (location = 3) out vec3 outLightVec;
+layout (location = 4) out vec3 outEyePos;
+layout (location = 5) out vec3 outViewPos;
+layout (location = 6) out vec3 outPos;
+
+layout(push_constant) uniform PushConsts {
+	mat4 scale;
+	vec4 clipPlane;
+	uint shadows;
+} pushConsts;
+
+vec3 decodeOctahedral(vec2 e)
+{
+	vec3 n = vec3(e.xy, 1.0 - abs(e.x) - abs(e.y));
+	float t = max(-n.z, 0.0);
+	n.x += n.x >= 0.0 ? -t : t;
+	n.y += n.y >= 0.0 ? -t : t;
+	return normalize(n);
+}
+
+void main(void)
+{
+	// The skirt vertices follow the grid vertices
+	const uint vertexCount = PATCH_SIZE * PATCH_SIZE;
+	uint index = uint(gl_VertexIndex);
+	bool skirt = index >= vertexCount;
+	index = index % vertexCount;
+	vec2 grid = vec2(index % PATCH_SIZE, index / PATCH_SIZE);
+
+	outUV = grid / float(PATCH_SIZE) * UV_SCALE;
+	outNormal = decodeOctahedral(inNormal);
+	vec4 pos = vec4((grid * 2.0 + 1.0 - float(PATCH_SIZE)) * vec2(SCALE_X, SCALE_Z), -inHeight * HEIGHT_SCALE + 1.0, 1.0).xzyw;
+	if (skirt) {
+		pos.y += SKIRT_OFFSET;
+	}
+	if (pushConsts.scale[1][1] < 0) {
+		pos.y *= -1.0f;
+	}
+	gl_Position = ubo.projection * ubo.modelview * pos;
+	outPos = pos.xyz;
+	outViewVec = -pos.xyz;
+	outLightVec = normalize(ubo.lightDir.xyz + outViewVec);
+	outEyePos = vec3(ubo.modelview * pos);
+	outViewPos = (ubo.modelview * vec4(pos.xyz, 1.0)).xyz;
+
+	// Clip against reflection plane
+	if (length(pushConsts.clipPlane) != 0.0)  {
+		gl_ClipDistance[0] = dot(pos, pushConsts.clipPlane);
+	} else {
+		gl_ClipDistance[0] = 0.0f;
+	}
+}
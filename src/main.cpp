@@ -23,13 +23,15 @@
 #include "VulkanglTFModel.hpp"
 #include "VulkanBuffer.hpp"
 #include "VulkanHeightmap.hpp"
+#include "threadpool.hpp"
 
 #include "Pipeline.hpp"
 #include "PipelineLayout.hpp"
 #include "DescriptorSet.hpp"
 #include "DescriptorSetLayout.hpp"
 #include "RenderPass.hpp"
-#include "DescriptorPool.hpp"
+#include "DescriptorCache.hpp"
+#include "GpuProfiler.hpp"
 #include "Image.hpp"
 #include "ImageView.hpp"
 
@@ -54,8 +56,14 @@ public:
 	bool debugDisplayRefraction = false;
 
 	vks::HeightMap* heightMap;
+	const uint32_t terrainPatchSize = 256;
+	const glm::vec3 terrainScale = glm::vec3(0.15f * 0.25f, 1.0f, 0.15f * 0.25f);
+	// The compact format only stores height and normal, the terrain shaders reconstruct the rest from the vertex index
+	vks::HeightMap::VertexFormat terrainVertexFormat = vks::HeightMap::vertexFormatDefault;
 
 	glm::vec4 lightPos;
+	// Set by a scripted benchmark, which drives the light direction through its keyframes
+	bool scriptedLight = false;
 
 	enum class SceneDrawType { sceneDrawTypeRefract, sceneDrawTypeReflect, sceneDrawTypeDisplay };
 	enum class FramebufferType { Color, DepthStencil };
@@ -93,7 +101,8 @@ public:
 		vkglTF::Model testscene;
 	} models;
 
-	struct {
+	// Uniform buffers are duplicated for every swap chain image, so updating them doesn't stall on frames that are still in flight
+	struct UniformBuffers {
 		vks::Buffer vsShared;
 		vks::Buffer vsMirror;
 		vks::Buffer vsOffScreen;
@@ -101,7 +110,8 @@ public:
 		vks::Buffer terrain;
 		vks::Buffer sky;
 		vks::Buffer CSM;
-	} uniformBuffers;
+	};
+	std::vector<UniformBuffers> uniformBuffers;
 
 	struct UBO {
 		glm::mat4 projection;
@@ -129,6 +139,8 @@ public:
 		glm::vec4 cameraPos;
 		glm::vec4 lightDir;
 		float time;
+		// Part of the refraction and reflection targets that has been rendered to
+		float resolutionScale = 1.0f;
 	} uboWaterPlane;
 
 	struct {
@@ -138,14 +150,25 @@ public:
 		PipelineLayout* sky;
 	} pipelineLayouts;
 
-	DescriptorPool* descriptorPool;
+	// Sets with identical layout and descriptors are only allocated once, pools are added as required
+	DescriptorCache* descriptorCache = nullptr;
 
+	// GPU times and pipeline statistics of the render passes, read back for each swap chain image once its previous command buffer has finished
+	GpuProfiler* gpuProfiler;
+
+	// One set of descriptors per swap chain image, referencing that image's uniform buffers
 	struct DescriptorSets {
 		DescriptorSet* waterplane;
+		DescriptorSet* waterplaneSceneCopy;
 		DescriptorSet* debugquad;
 		DescriptorSet* terrain;
 		DescriptorSet* skysphere;
-	} descriptorSets;
+		// Uniform buffers only, the bindless pipelines select their textures from the global array
+		DescriptorSet* bindlessWaterplane;
+		DescriptorSet* bindlessTerrain;
+		DescriptorSet* bindlessSkysphere;
+	};
+	std::vector<DescriptorSets> descriptorSets;
 
 	struct {
 		DescriptorSetLayout* textured;
@@ -167,10 +190,106 @@ public:
 		VkSampler sampler;
 	} offscreenPass;
 
+	// Skips the refraction and reflection passes if the water plane can't be seen in the current frame
+	// Only used with dynamic command buffers, as pre-recorded command buffers always contain both passes
+	struct WaterVisibility {
+		bool enabled = true;
+		// Also skip the passes if none of the water plane's samples passed the depth test in the swap chain image's previous frame
+		bool occlusionQueries = true;
+		bool inFrustum = true;
+		bool visible = true;
+		// One occlusion query for the water plane per swap chain image
+		VkQueryPool queryPool = VK_NULL_HANDLE;
+		std::vector<bool> queriesWritten;
+		uint64_t passedSamples = 1;
+		uint32_t skippedFrames = 0;
+	} waterVisibility;
+
+	// Samples the water's refraction from a copy of the main pass instead of rendering the scene a second time in the refraction pass
+	// The main pass is split in two around the copy: Opaque geometry first, then the water plane, debug displays and UI
+	struct SceneCopyRefraction {
+		bool supported = false;
+		bool enabled = false;
+		// Leaves color and depth in transfer source layout for the copy
+		RenderPass* opaqueRenderPass;
+		// Loads the attachments written by the opaque pass
+		RenderPass* waterRenderPass;
+		// Only compiled once the scene copy refraction is enabled
+		Pipeline* pipeline = nullptr;
+		// Copy targets, shared by all frames in flight and recreated on resize
+		Image* colorImage = nullptr;
+		ImageView* colorView = nullptr;
+		Image* depthImage = nullptr;
+		ImageView* depthView = nullptr;
+		VkSampler depthSampler;
+		VkDescriptorImageInfo colorDescriptor;
+		VkDescriptorImageInfo depthDescriptor;
+	} sceneCopyRefraction;
+
+	// Resolution of the refraction and reflection passes, relative to the size of their targets
+	// The targets are allocated at full size and the passes render to a scaled viewport, so the scale can change without recreating them
+	struct WaterResolution {
+		enum Mode { modeFixed = 0, modeDynamic = 1 };
+		int32_t mode = modeFixed;
+		float fixedScale = 1.0f;
+		// GPU time budget for both passes in the dynamic mode, in milliseconds
+		float budget = 2.0f;
+		float minScale = 0.25f;
+		// Scale used by the current frame
+		float scale = 1.0f;
+		// Last GPU time of both passes in milliseconds, as measured by the GPU profiler's refraction and reflection scopes
+		float gpuTime = 0.0f;
+	} waterResolution;
+
+	// Push constants of the bindless pipelines, starting with the same members as the scene's regular push constants
+	struct BindlessPushConstBlock {
+		glm::mat4 scale = glm::mat4(1.0f);
+		glm::vec4 clipPlane = glm::vec4(0.0f);
+		uint32_t shadows = 1;
+		// Indices into the global texture array, their meaning depends on the pipeline
+		std::array<uint32_t, 4> textureIndices;
+	};
+
+	// Optional bindless texture path using descriptor indexing (VK_EXT_descriptor_indexing)
+	// All sampled textures of the scene are put into a single global array, which is bound once and indexed by push constants
+	// The scene's pipelines share one pipeline layout, so switching between them only rebinds their uniform buffers
+	struct Bindless {
+		bool supported = false;
+		bool enabled = false;
+		VkPhysicalDeviceDescriptorIndexingFeaturesEXT features{};
+		// Upper bound for the size of the texture array, the actual size is set when allocating its set
+		uint32_t maxTextureCount = 64;
+		std::vector<VkDescriptorImageInfo> textures;
+		struct TextureIndices {
+			uint32_t heightMap;
+			uint32_t terrainLayers;
+			uint32_t shadowMap;
+			uint32_t skySphere;
+			uint32_t waterNormalMap;
+			uint32_t refraction;
+			uint32_t reflection;
+		} textureIndices;
+		// Set 0 contains the uniform buffers of a single draw, set 1 the global texture array
+		DescriptorSetLayout* uniformSetLayout;
+		DescriptorSetLayout* textureSetLayout;
+		PipelineLayout* pipelineLayout;
+		DescriptorPool* descriptorPool;
+		DescriptorSet* textureSet;
+		// Only created if bindless textures have been selected at startup
+		struct {
+			Pipeline* mirror = nullptr;
+			Pipeline* terrain = nullptr;
+			Pipeline* sky = nullptr;
+		} pipelines;
+	} bindless;
+
 	/* CSM */
 
 	float cascadeSplitLambda = 0.95f;
 
+	// Sample distribution shadows fit the cascades tighter, so they get away with a smaller shadow map
+	uint32_t shadowMapDim = SHADOWMAP_DIM;
+
 	float zNear = 0.5f;
 	float zFar = 48.0f;
 
@@ -183,9 +302,9 @@ public:
 		RenderPass* renderPass;
 		PipelineLayout* pipelineLayout;
 		VkPipeline pipeline;
-		vks::Buffer uniformBuffer;
+		std::vector<vks::Buffer> uniformBuffers;
 		DescriptorSetLayout* descriptorSetLayout;
-		DescriptorSet* descriptorSet;
+		std::vector<DescriptorSet*> descriptorSets;
 		struct UniformBlock {
 			std::array<glm::mat4, SHADOW_MAP_CASCADE_COUNT> cascadeViewProjMat;
 		} ubo;
@@ -206,6 +325,9 @@ public:
 		DescriptorSet* descriptorSet;
 		ImageView* view;
 		float splitDepth;
+		// Bounding sphere of the cascade's view frustum slice, the matrix is only updated from this if the cascade gets redrawn
+		glm::vec3 center;
+		float radius;
 		glm::mat4 viewProjMatrix;
 		void destroy(VkDevice device) {
 			vkDestroyFramebuffer(device, frameBuffer, nullptr);
@@ -213,6 +335,107 @@ public:
 	};
 	std::array<Cascade, SHADOW_MAP_CASCADE_COUNT> cascades;
 
+	// Inputs of the last cascade bounds update, unchanged inputs skip the update
+	struct CascadeBoundsCache {
+		bool valid = false;
+		glm::mat4 viewProjMatrix;
+		float splitLambda;
+		float minZ;
+		float maxZ;
+	} cascadeBoundsCache;
+
+	// Decides which cascades need to be redrawn in the current frame, all others reuse the depth from their last update
+	// Only used with dynamic command buffers, pre-recorded command buffers always redraw all cascades
+	struct CascadeScheduler {
+		bool enabled = true;
+		// Minimum number of frames between two updates of a moving cascade, so far cascades are allowed to lag behind
+		std::array<uint32_t, SHADOW_MAP_CASCADE_COUNT> intervals;
+		// Cascades that moved by more than this fraction of their radius are redrawn immediately
+		// Lagging cascades are enlarged by the same fraction, so the view frustum slice stays covered until then
+		float threshold = 0.1f;
+		// Bounds the cached depth of each cascade has been rendered with
+		struct Cached {
+			bool valid = false;
+			glm::vec3 center;
+			float radius;
+			uint64_t frame;
+		};
+		std::array<Cached, SHADOW_MAP_CASCADE_COUNT> cached;
+		glm::vec3 lightDir;
+		std::array<bool, SHADOW_MAP_CASCADE_COUNT> redraw;
+		uint64_t frame = 0;
+		// Statistics
+		uint32_t redrawCount = 0;
+		uint64_t totalRedrawCount = 0;
+	} cascadeScheduler;
+
+	// Reduces the depth buffer to the visible depth range on the GPU, so the cascade splits can be fitted to it (sample distribution shadow maps)
+	// The result is read back once the swap chain image's command buffer has finished, so the range used is a few frames old
+	struct DepthReduction {
+		bool supported = false;
+		bool enabled = false;
+		// Depth aspect only view of the scene's depth buffer, recreated on resize
+		VkImageView view = VK_NULL_HANDLE;
+		VkSampler sampler;
+		DescriptorSetLayout* descriptorSetLayout;
+		PipelineLayout* pipelineLayout;
+		// Only compiled once sample distribution shadows are enabled
+		Pipeline* pipeline = nullptr;
+		// Per swap chain image: Minimum and maximum view depth as float bits
+		std::vector<vks::Buffer> buffers;
+		std::vector<DescriptorSet*> descriptorSets;
+		bool valid = false;
+		glm::vec2 range;
+		// The range is widened by this fraction to account for camera movement during the read back latency
+		float margin = 0.05f;
+	} depthReduction;
+
+	// Renders all cascades in a single render pass using multiview, with the view index selecting the cascade
+	// Falls back to one render pass per cascade if multiview is not supported
+	struct CascadeMultiview {
+		bool supported = false;
+		bool enabled = true;
+		VkPhysicalDeviceMultiviewFeatures features{};
+		RenderPass* renderPass;
+		// Renders to all layers of the depth image
+		VkFramebuffer frameBuffer;
+		Pipeline* pipeline;
+	} cascadeMultiview;
+
+	// Per view culling and level of detail selection for the terrain's quadtree nodes
+	// The selection is baked into pre-recorded command buffers, so these are re-recorded once the views have changed
+	struct TerrainCulling {
+		bool enabled = true;
+		// Also used for the refraction and (mirrored) reflection passes
+		vks::Frustum camera;
+		std::array<vks::Frustum, SHADOW_MAP_CASCADE_COUNT> cascades;
+		glm::vec3 viewPos;
+		// Incremented whenever one of the views changes, pre-recorded command buffers store the version they were recorded with
+		uint32_t version = 0;
+		std::vector<uint32_t> recordedVersions;
+		glm::mat4 viewProjMatrix = glm::mat4(0.0f);
+		std::array<glm::mat4, SHADOW_MAP_CASCADE_COUNT> cascadeViewProjMatrices{};
+		// Terrain nodes drawn and culled for each cascade during its last update
+		std::array<vks::HeightMap::CullingStatistics, SHADOW_MAP_CASCADE_COUNT> casterStatistics;
+	} terrainCulling;
+
+	// Passes that are recorded into separate secondary command buffers, the first SHADOW_MAP_CASCADE_COUNT entries are the shadow map cascades
+	enum SecondaryPass { secondaryPassRefraction = SHADOW_MAP_CASCADE_COUNT, secondaryPassReflection, secondaryPassScene, secondaryPassUI, secondaryPassCount };
+
+	// Multi threaded command buffer recording
+	// Each pass is recorded into a secondary command buffer on a worker thread, the primary command buffer only executes them
+	struct MultiThreading {
+		bool enabled = true;
+		vks::ThreadPool threadPool;
+		// Command pools need to be externally synchronized, so each thread allocates from its own pool
+		std::vector<CommandPool*> commandPools;
+		// Secondary command buffers for each swap chain image, indexed by SecondaryPass
+		std::vector<std::array<CommandBuffer*, secondaryPassCount>> commandBuffers;
+	} multiThreading;
+
+	// Pipelines are compiled on these threads while the assets are loaded, the threads are released once all pipelines have been created
+	vks::ThreadPool pipelineThreadPool;
+
 	VulkanExample() : VulkanExampleBase(ENABLE_VALIDATION)
 	{
 		title = "Vulkan Playground";
@@ -233,6 +456,29 @@ public:
 		enabledFeatures.shaderClipDistance = VK_TRUE;
 		enabledFeatures.samplerAnisotropy = VK_TRUE;
 		enabledFeatures.depthClamp = VK_TRUE;
+		// Required for enabling multiview via the feature chain
+		apiVersion = VK_API_VERSION_1_1;
+
+		for (uint32_t i = 0; i < SHADOW_MAP_CASCADE_COUNT; i++) {
+			cascadeScheduler.intervals[i] = 1 << i;
+		}
+		cascadeScheduler.redraw.fill(true);
+
+		for (auto& arg : args) {
+			if ((arg == std::string("-ctv")) || (arg == std::string("--compactterrainvertices"))) {
+				terrainVertexFormat = vks::HeightMap::vertexFormatCompact;
+			}
+			if ((arg == std::string("-sdsm")) || (arg == std::string("--sampledistributionshadows"))) {
+				depthReduction.enabled = true;
+				shadowMapDim = SHADOWMAP_DIM / 2;
+			}
+			if ((arg == std::string("-scr")) || (arg == std::string("--scenecopyrefraction"))) {
+				sceneCopyRefraction.enabled = true;
+			}
+			if ((arg == std::string("-bl")) || (arg == std::string("--bindless"))) {
+				bindless.enabled = true;
+			}
+		}
 
 		// @todo
 		float radius = 20.0f;
@@ -251,11 +497,41 @@ public:
 
 	~VulkanExample()
 	{
+		delete gpuProfiler;
+		destroySecondaryCommandBuffers();
+		for (auto& commandPool : multiThreading.commandPools) {
+			delete commandPool;
+		}
 		vkDestroySampler(device, offscreenPass.sampler, nullptr);
-		uniformBuffers.vsShared.destroy();
-		uniformBuffers.vsMirror.destroy();
-		uniformBuffers.vsOffScreen.destroy();
-		uniformBuffers.vsDebugQuad.destroy();
+		vkDestroyQueryPool(device, waterVisibility.queryPool, nullptr);
+		if (sceneCopyRefraction.supported) {
+			destroySceneCopyTargets();
+			vkDestroySampler(device, sceneCopyRefraction.depthSampler, nullptr);
+		}
+		if (depthReduction.supported) {
+			vkDestroyImageView(device, depthReduction.view, nullptr);
+			vkDestroySampler(device, depthReduction.sampler, nullptr);
+			for (auto& buffer : depthReduction.buffers) {
+				buffer.destroy();
+			}
+		}
+		if (cascadeMultiview.supported) {
+			vkDestroyFramebuffer(device, cascadeMultiview.frameBuffer, nullptr);
+		}
+		for (auto& buffers : uniformBuffers) {
+			buffers.vsShared.destroy();
+			buffers.vsMirror.destroy();
+			buffers.vsOffScreen.destroy();
+			buffers.vsDebugQuad.destroy();
+			buffers.terrain.destroy();
+			buffers.sky.destroy();
+			buffers.CSM.destroy();
+		}
+		for (auto& buffer : depthPass.uniformBuffers) {
+			buffer.destroy();
+		}
+		// Also destroys the pools all cached descriptor sets have been allocated from
+		delete descriptorCache;
 	}
 
 	void createFrameBufferImage(FrameBufferAttachment& target, FramebufferType type)
@@ -299,6 +575,7 @@ public:
 	// The color attachment of this framebuffer will then be used to sample from in the fragment shader of the final pass
 	void prepareOffscreen()
 	{
+		CPU_PROFILE_SCOPE("Prepare offscreen");
 		// Find a suitable depth format
 		VkFormat fbDepthFormat;
 		VkBool32 validDepthFormat = vks::tools::getSupportedDepthFormat(physicalDevice, &fbDepthFormat);
@@ -366,6 +643,16 @@ public:
 			VK_ACCESS_SHADER_READ_BIT,
 			VK_DEPENDENCY_BY_REGION_BIT,
 		});
+		// The depth attachment is shared by the refraction and reflection passes of all frames in flight
+		offscreenPass.renderPass->addSubpassDependency({
+			VK_SUBPASS_EXTERNAL,
+			0,
+			VK_PIPELINE_STAGE_EARLY_FRAGMENT_TESTS_BIT | VK_PIPELINE_STAGE_LATE_FRAGMENT_TESTS_BIT,
+			VK_PIPELINE_STAGE_EARLY_FRAGMENT_TESTS_BIT | VK_PIPELINE_STAGE_LATE_FRAGMENT_TESTS_BIT,
+			VK_ACCESS_DEPTH_STENCIL_ATTACHMENT_WRITE_BIT,
+			VK_ACCESS_DEPTH_STENCIL_ATTACHMENT_READ_BIT | VK_ACCESS_DEPTH_STENCIL_ATTACHMENT_WRITE_BIT,
+			0,
+		});
 
 		offscreenPass.renderPass->setColorClearValue(0, { 0.0f, 0.0f, 0.0f, 0.0f });
 		offscreenPass.renderPass->setDepthStencilClearValue(1, 1.0f, 0.0f);
@@ -415,9 +702,217 @@ public:
 
 		attachments[0] = offscreenPass.reflection.view->handle;
 		VK_CHECK_RESULT(vkCreateFramebuffer(device, &frameBufferCI, nullptr, &offscreenPass.reflection.frameBuffer));
+
+		createWaterOcclusionQueries();
+	}
+
+	// Occlusion queries for the water plane, one per swap chain image
+	void createWaterOcclusionQueries()
+	{
+		if (waterVisibility.queryPool != VK_NULL_HANDLE) {
+			vkDestroyQueryPool(device, waterVisibility.queryPool, nullptr);
+		}
+		VkQueryPoolCreateInfo occlusionQueryPoolCI{};
+		occlusionQueryPoolCI.sType = VK_STRUCTURE_TYPE_QUERY_POOL_CREATE_INFO;
+		occlusionQueryPoolCI.queryType = VK_QUERY_TYPE_OCCLUSION;
+		occlusionQueryPoolCI.queryCount = swapChain.imageCount;
+		VK_CHECK_RESULT(vkCreateQueryPool(device, &occlusionQueryPoolCI, nullptr, &waterVisibility.queryPool));
+		waterVisibility.queriesWritten.assign(swapChain.imageCount, false);
+	}
+
+	void destroySceneCopyTargets()
+	{
+		delete sceneCopyRefraction.colorView;
+		delete sceneCopyRefraction.colorImage;
+		delete sceneCopyRefraction.depthView;
+		delete sceneCopyRefraction.depthImage;
+	}
+
+	// Color and depth copies of the main pass at the size of the swap chain
+	void createSceneCopyTargets()
+	{
+		destroySceneCopyTargets();
+
+		sceneCopyRefraction.colorImage = new Image(vulkanDevice);
+		sceneCopyRefraction.colorImage->setType(VK_IMAGE_TYPE_2D);
+		sceneCopyRefraction.colorImage->setFormat(swapChain.colorFormat);
+		sceneCopyRefraction.colorImage->setExtent({ width, height, 1 });
+		sceneCopyRefraction.colorImage->setTiling(VK_IMAGE_TILING_OPTIMAL);
+		sceneCopyRefraction.colorImage->setUsage(VK_IMAGE_USAGE_TRANSFER_DST_BIT | VK_IMAGE_USAGE_SAMPLED_BIT);
+		sceneCopyRefraction.colorImage->create();
+
+		sceneCopyRefraction.colorView = new ImageView(vulkanDevice);
+		sceneCopyRefraction.colorView->setType(VK_IMAGE_VIEW_TYPE_2D);
+		sceneCopyRefraction.colorView->setFormat(swapChain.colorFormat);
+		sceneCopyRefraction.colorView->setSubResourceRange({ VK_IMAGE_ASPECT_COLOR_BIT, 0, 1, 0, 1 });
+		sceneCopyRefraction.colorView->setImage(sceneCopyRefraction.colorImage);
+		sceneCopyRefraction.colorView->create();
+
+		sceneCopyRefraction.depthImage = new Image(vulkanDevice);
+		sceneCopyRefraction.depthImage->setType(VK_IMAGE_TYPE_2D);
+		sceneCopyRefraction.depthImage->setFormat(depthFormat);
+		sceneCopyRefraction.depthImage->setExtent({ width, height, 1 });
+		sceneCopyRefraction.depthImage->setTiling(VK_IMAGE_TILING_OPTIMAL);
+		sceneCopyRefraction.depthImage->setUsage(VK_IMAGE_USAGE_TRANSFER_DST_BIT | VK_IMAGE_USAGE_SAMPLED_BIT);
+		sceneCopyRefraction.depthImage->create();
+
+		// Sampled views may only contain a single aspect
+		sceneCopyRefraction.depthView = new ImageView(vulkanDevice);
+		sceneCopyRefraction.depthView->setType(VK_IMAGE_VIEW_TYPE_2D);
+		sceneCopyRefraction.depthView->setFormat(depthFormat);
+		sceneCopyRefraction.depthView->setSubResourceRange({ VK_IMAGE_ASPECT_DEPTH_BIT, 0, 1, 0, 1 });
+		sceneCopyRefraction.depthView->setImage(sceneCopyRefraction.depthImage);
+		sceneCopyRefraction.depthView->create();
+
+		sceneCopyRefraction.colorDescriptor = { offscreenPass.sampler, sceneCopyRefraction.colorView->handle, VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL };
+		sceneCopyRefraction.depthDescriptor = { sceneCopyRefraction.depthSampler, sceneCopyRefraction.depthView->handle, VK_IMAGE_LAYOUT_DEPTH_STENCIL_READ_ONLY_OPTIMAL };
+	}
+
+	// Render passes for splitting the main pass around the scene copy
+	// Both are compatible with the swap chain frame buffers, so these and the pipelines created for the main pass can be used with them
+	void prepareSceneCopyRefraction()
+	{
+		CPU_PROFILE_SCOPE("Prepare scene copy refraction");
+		const VkAttachmentReference colorReference = { 0, VK_IMAGE_LAYOUT_COLOR_ATTACHMENT_OPTIMAL };
+		const VkAttachmentReference depthReference = { 1, VK_IMAGE_LAYOUT_DEPTH_STENCIL_ATTACHMENT_OPTIMAL };
+		const VkSubpassDescription subpassDescription = {
+			0,
+			VK_PIPELINE_BIND_POINT_GRAPHICS,
+			0,
+			nullptr,
+			1,
+			&colorReference,
+			nullptr,
+			&depthReference,
+			0,
+			nullptr
+		};
+
+		// Opaque geometry
+		sceneCopyRefraction.opaqueRenderPass = new RenderPass(device);
+		sceneCopyRefraction.opaqueRenderPass->setDimensions(width, height);
+		sceneCopyRefraction.opaqueRenderPass->addSubpassDescription(subpassDescription);
+		// Color attachment
+		sceneCopyRefraction.opaqueRenderPass->addAttachmentDescription({
+			0,
+			swapChain.colorFormat,
+			VK_SAMPLE_COUNT_1_BIT,
+			VK_ATTACHMENT_LOAD_OP_CLEAR,
+			VK_ATTACHMENT_STORE_OP_STORE,
+			VK_ATTACHMENT_LOAD_OP_DONT_CARE,
+			VK_ATTACHMENT_STORE_OP_DONT_CARE,
+			VK_IMAGE_LAYOUT_UNDEFINED,
+			VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL
+		});
+		// Depth attachment
+		sceneCopyRefraction.opaqueRenderPass->addAttachmentDescription({
+			0,
+			depthFormat,
+			VK_SAMPLE_COUNT_1_BIT,
+			VK_ATTACHMENT_LOAD_OP_CLEAR,
+			VK_ATTACHMENT_STORE_OP_STORE,
+			VK_ATTACHMENT_LOAD_OP_DONT_CARE,
+			VK_ATTACHMENT_STORE_OP_DONT_CARE,
+			VK_IMAGE_LAYOUT_UNDEFINED,
+			VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL
+		});
+		// Subpass dependencies
+		sceneCopyRefraction.opaqueRenderPass->addSubpassDependency({
+			VK_SUBPASS_EXTERNAL,
+			0,
+			VK_PIPELINE_STAGE_BOTTOM_OF_PIPE_BIT,
+			VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT,
+			VK_ACCESS_MEMORY_READ_BIT,
+			VK_ACCESS_COLOR_ATTACHMENT_READ_BIT | VK_ACCESS_COLOR_ATTACHMENT_WRITE_BIT,
+			VK_DEPENDENCY_BY_REGION_BIT,
+		});
+		// The depth attachment is shared by all frames in flight, so the previous frame's depth writes and copy need to be finished
+		sceneCopyRefraction.opaqueRenderPass->addSubpassDependency({
+			VK_SUBPASS_EXTERNAL,
+			0,
+			VK_PIPELINE_STAGE_TRANSFER_BIT | VK_PIPELINE_STAGE_EARLY_FRAGMENT_TESTS_BIT | VK_PIPELINE_STAGE_LATE_FRAGMENT_TESTS_BIT,
+			VK_PIPELINE_STAGE_EARLY_FRAGMENT_TESTS_BIT | VK_PIPELINE_STAGE_LATE_FRAGMENT_TESTS_BIT,
+			VK_ACCESS_DEPTH_STENCIL_ATTACHMENT_WRITE_BIT,
+			VK_ACCESS_DEPTH_STENCIL_ATTACHMENT_READ_BIT | VK_ACCESS_DEPTH_STENCIL_ATTACHMENT_WRITE_BIT,
+			0,
+		});
+		sceneCopyRefraction.opaqueRenderPass->addSubpassDependency({
+			0,
+			VK_SUBPASS_EXTERNAL,
+			VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT | VK_PIPELINE_STAGE_LATE_FRAGMENT_TESTS_BIT,
+			VK_PIPELINE_STAGE_TRANSFER_BIT,
+			VK_ACCESS_COLOR_ATTACHMENT_WRITE_BIT | VK_ACCESS_DEPTH_STENCIL_ATTACHMENT_WRITE_BIT,
+			VK_ACCESS_TRANSFER_READ_BIT,
+			0,
+		});
+		sceneCopyRefraction.opaqueRenderPass->setColorClearValue(0, { 0.0f, 0.0f, 0.0f, 0.0f });
+		sceneCopyRefraction.opaqueRenderPass->setDepthStencilClearValue(1, 1.0f, 0.0f);
+		sceneCopyRefraction.opaqueRenderPass->create();
+
+		// Water plane, debug displays and UI
+		sceneCopyRefraction.waterRenderPass = new RenderPass(device);
+		sceneCopyRefraction.waterRenderPass->setDimensions(width, height);
+		sceneCopyRefraction.waterRenderPass->addSubpassDescription(subpassDescription);
+		// Color attachment
+		sceneCopyRefraction.waterRenderPass->addAttachmentDescription({
+			0,
+			swapChain.colorFormat,
+			VK_SAMPLE_COUNT_1_BIT,
+			VK_ATTACHMENT_LOAD_OP_LOAD,
+			VK_ATTACHMENT_STORE_OP_STORE,
+			VK_ATTACHMENT_LOAD_OP_DONT_CARE,
+			VK_ATTACHMENT_STORE_OP_DONT_CARE,
+			VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL,
+			settings.headless ? VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL : VK_IMAGE_LAYOUT_PRESENT_SRC_KHR
+		});
+		// Depth attachment
+		sceneCopyRefraction.waterRenderPass->addAttachmentDescription({
+			0,
+			depthFormat,
+			VK_SAMPLE_COUNT_1_BIT,
+			VK_ATTACHMENT_LOAD_OP_LOAD,
+			VK_ATTACHMENT_STORE_OP_STORE,
+			VK_ATTACHMENT_LOAD_OP_DONT_CARE,
+			VK_ATTACHMENT_STORE_OP_DONT_CARE,
+			VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL,
+			VK_IMAGE_LAYOUT_DEPTH_STENCIL_ATTACHMENT_OPTIMAL
+		});
+		// Subpass dependencies
+		// The copy only reads the attachments, so an execution dependency is sufficient
+		sceneCopyRefraction.waterRenderPass->addSubpassDependency({
+			VK_SUBPASS_EXTERNAL,
+			0,
+			VK_PIPELINE_STAGE_TRANSFER_BIT,
+			VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT | VK_PIPELINE_STAGE_EARLY_FRAGMENT_TESTS_BIT | VK_PIPELINE_STAGE_LATE_FRAGMENT_TESTS_BIT,
+			0,
+			VK_ACCESS_COLOR_ATTACHMENT_READ_BIT | VK_ACCESS_COLOR_ATTACHMENT_WRITE_BIT | VK_ACCESS_DEPTH_STENCIL_ATTACHMENT_READ_BIT | VK_ACCESS_DEPTH_STENCIL_ATTACHMENT_WRITE_BIT,
+			0,
+		});
+		sceneCopyRefraction.waterRenderPass->addSubpassDependency({
+			0,
+			VK_SUBPASS_EXTERNAL,
+			VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT,
+			VK_PIPELINE_STAGE_BOTTOM_OF_PIPE_BIT,
+			VK_ACCESS_COLOR_ATTACHMENT_READ_BIT | VK_ACCESS_COLOR_ATTACHMENT_WRITE_BIT,
+			VK_ACCESS_MEMORY_READ_BIT,
+			VK_DEPENDENCY_BY_REGION_BIT,
+		});
+		sceneCopyRefraction.waterRenderPass->create();
+
+		VkSamplerCreateInfo samplerCI = vks::initializers::samplerCreateInfo();
+		samplerCI.magFilter = VK_FILTER_NEAREST;
+		samplerCI.minFilter = VK_FILTER_NEAREST;
+		samplerCI.mipmapMode = VK_SAMPLER_MIPMAP_MODE_NEAREST;
+		samplerCI.addressModeU = VK_SAMPLER_ADDRESS_MODE_CLAMP_TO_EDGE;
+		samplerCI.addressModeV = samplerCI.addressModeU;
+		samplerCI.addressModeW = samplerCI.addressModeU;
+		samplerCI.maxAnisotropy = 1.0f;
+		VK_CHECK_RESULT(vkCreateSampler(device, &samplerCI, nullptr, &sceneCopyRefraction.depthSampler));
+
+		createSceneCopyTargets();
 	}
 
-	void drawScene(CommandBuffer* cb, SceneDrawType drawType)
+	void drawScene(CommandBuffer* cb, uint32_t bufferIndex, SceneDrawType drawType)
 	{
 		// @todo: rename to localMat
 		struct PushConst {
@@ -440,45 +935,97 @@ public:
 			break;
 		}
 
+		BindlessPushConstBlock bindlessPushConst;
+		bindlessPushConst.scale = pushConst.scale;
+		bindlessPushConst.clipPlane = pushConst.clipPlane;
+		bindlessPushConst.shadows = pushConst.shadows;
+
 		// Skysphere
-		cb->bindPipeline(pipelines.sky);
-		cb->bindDescriptorSets(pipelineLayouts.sky, { descriptorSets.skysphere }, 0);
-		cb->updatePushConstant(pipelineLayouts.sky, 0, &pushConst);
+		if (bindless.enabled) {
+			bindBindlessTextures(cb);
+			bindlessPushConst.textureIndices = { bindless.textureIndices.skySphere, 0, 0, 0 };
+			cb->bindPipeline(bindless.pipelines.sky);
+			cb->bindDescriptorSets(bindless.pipelineLayout, { descriptorSets[bufferIndex].bindlessSkysphere }, 0);
+			cb->updatePushConstant(bindless.pipelineLayout, 0, &bindlessPushConst);
+		} else {
+			cb->bindPipeline(pipelines.sky);
+			cb->bindDescriptorSets(pipelineLayouts.sky, { descriptorSets[bufferIndex].skysphere }, 0);
+			cb->updatePushConstant(pipelineLayouts.sky, 0, &pushConst);
+		}
 		models.skysphere.draw(cb->handle);
 		
 		// Terrain
-		cb->bindPipeline(pipelines.terrain);
-		cb->bindDescriptorSets(pipelineLayouts.terrain, { descriptorSets.terrain }, 0);
-		cb->updatePushConstant(pipelineLayouts.terrain, 0, &pushConst);
-		heightMap->draw(cb->handle);
+		if (bindless.enabled) {
+			// The texture array stays bound, as both pipelines use the same pipeline layout
+			bindlessPushConst.textureIndices = { bindless.textureIndices.heightMap, bindless.textureIndices.terrainLayers, bindless.textureIndices.shadowMap, 0 };
+			cb->bindPipeline(bindless.pipelines.terrain);
+			cb->bindDescriptorSets(bindless.pipelineLayout, { descriptorSets[bufferIndex].bindlessTerrain }, 0);
+			cb->updatePushConstant(bindless.pipelineLayout, 0, &bindlessPushConst);
+		} else {
+			cb->bindPipeline(pipelines.terrain);
+			cb->bindDescriptorSets(pipelineLayouts.terrain, { descriptorSets[bufferIndex].terrain }, 0);
+			cb->updatePushConstant(pipelineLayouts.terrain, 0, &pushConst);
+		}
+		if (terrainCulling.enabled) {
+			heightMap->draw(cb->handle, terrainCulling.camera, terrainCulling.viewPos, drawType == SceneDrawType::sceneDrawTypeReflect);
+		} else {
+			heightMap->draw(cb->handle);
+		}
+	}
+
+	// Binds the global texture array, which stays bound for all following draws using the bindless pipeline layout
+	void bindBindlessTextures(CommandBuffer* cb)
+	{
+		cb->bindDescriptorSets(bindless.pipelineLayout, { bindless.textureSet }, 1);
+	}
+
+	// Multiview always renders all cascades, so it's only used if none of them can be reused from the cache
+	bool useCascadeMultiview() {
+		if (!cascadeMultiview.supported || !cascadeMultiview.enabled) {
+			return false;
+		}
+		for (auto redraw : cascadeScheduler.redraw) {
+			if (!redraw) {
+				return false;
+			}
+		}
+		return true;
 	}
 
-	void drawShadowCasters(CommandBuffer* cb, uint32_t cascadeIndex = 0) {
+	// Draws the shadow casters for a single cascade, or for all cascades at once with multiview
+	void drawShadowCasters(CommandBuffer* cb, uint32_t bufferIndex, uint32_t cascadeIndex = 0) {
+		const bool multiview = useCascadeMultiview();
 		const CascadePushConstBlock pushConst = { glm::vec4(0.0f), cascadeIndex };
-		cb->bindPipeline(pipelines.depthpass);
-		cb->bindDescriptorSets(depthPass.pipelineLayout, { depthPass.descriptorSet }, 0);
+		cb->bindPipeline(multiview ? cascadeMultiview.pipeline : pipelines.depthpass);
+		cb->bindDescriptorSets(depthPass.pipelineLayout, { depthPass.descriptorSets[bufferIndex] }, 0);
 		cb->updatePushConstant(depthPass.pipelineLayout, 0, &pushConst);
-		heightMap->draw(cb->handle);
+		if (terrainCulling.enabled) {
+			// The cascade's volume is left open towards the light by skipping its BACK plane, as casters in front of the near plane still cast shadows due to depth clamping
+			// Casters behind the far plane can't cast shadows into the cascade and are culled
+			if (multiview) {
+				heightMap->draw(cb->handle, terrainCulling.cascades.data(), SHADOW_MAP_CASCADE_COUNT, terrainCulling.viewPos, false, true, terrainCulling.casterStatistics.data());
+			} else {
+				heightMap->draw(cb->handle, terrainCulling.cascades[cascadeIndex], terrainCulling.viewPos, false, true, &terrainCulling.casterStatistics[cascadeIndex]);
+			}
+		} else {
+			heightMap->draw(cb->handle);
+		}
 	}
 
 	/*
 		CSM
 	*/
 
-	void prepareCSM()
+	/*
+		Depth map renderpass
+	*/
+	RenderPass* createDepthRenderPass(VkFormat depthFormat, uint32_t viewMask)
 	{
-		VkFormat depthFormat;
-		vks::tools::getSupportedDepthFormat(physicalDevice, &depthFormat);
-
-		/*
-			Depth map renderpass
-		*/
-
 		VkAttachmentReference depthReference = { 0, VK_IMAGE_LAYOUT_DEPTH_STENCIL_ATTACHMENT_OPTIMAL };
 
-		depthPass.renderPass = new RenderPass(device);
-		depthPass.renderPass->setDimensions(SHADOWMAP_DIM, SHADOWMAP_DIM);
-		depthPass.renderPass->addSubpassDescription({
+		RenderPass* renderPass = new RenderPass(device);
+		renderPass->setDimensions(shadowMapDim, shadowMapDim);
+		renderPass->addSubpassDescription({
 			0,
 			VK_PIPELINE_BIND_POINT_GRAPHICS,
 			0,
@@ -491,7 +1038,7 @@ public:
 			nullptr
 			});
 		// Depth attachment
-		depthPass.renderPass->addAttachmentDescription({
+		renderPass->addAttachmentDescription({
 			0,
 			depthFormat,
 			VK_SAMPLE_COUNT_1_BIT,
@@ -503,7 +1050,7 @@ public:
 			VK_IMAGE_LAYOUT_DEPTH_STENCIL_READ_ONLY_OPTIMAL
 			});
 		// Subpass dependencies
-		depthPass.renderPass->addSubpassDependency({
+		renderPass->addSubpassDependency({
 			VK_SUBPASS_EXTERNAL,
 			0,
 			VK_PIPELINE_STAGE_FRAGMENT_SHADER_BIT,
@@ -512,7 +1059,7 @@ public:
 			VK_ACCESS_DEPTH_STENCIL_ATTACHMENT_WRITE_BIT,
 			VK_DEPENDENCY_BY_REGION_BIT,
 			});
-		depthPass.renderPass->addSubpassDependency({
+		renderPass->addSubpassDependency({
 			0,
 			VK_SUBPASS_EXTERNAL,
 			VK_PIPELINE_STAGE_LATE_FRAGMENT_TESTS_BIT,
@@ -522,8 +1069,25 @@ public:
 			VK_DEPENDENCY_BY_REGION_BIT,
 			});
 
-		depthPass.renderPass->setDepthStencilClearValue(0, 1.0f, 0.0f);
-		depthPass.renderPass->create();
+		renderPass->setDepthStencilClearValue(0, 1.0f, 0.0f);
+		// All cascades are rendered at once with multiview, and as they share the light direction they are marked as correlated
+		if (viewMask != 0) {
+			renderPass->setMultiviewMasks(viewMask, viewMask);
+		}
+		renderPass->create();
+		return renderPass;
+	}
+
+	void prepareCSM()
+	{
+		CPU_PROFILE_SCOPE("Prepare shadow cascades");
+		VkFormat depthFormat;
+		vks::tools::getSupportedDepthFormat(physicalDevice, &depthFormat);
+
+		depthPass.renderPass = createDepthRenderPass(depthFormat, 0);
+		if (cascadeMultiview.supported) {
+			cascadeMultiview.renderPass = createDepthRenderPass(depthFormat, (1 << SHADOW_MAP_CASCADE_COUNT) - 1);
+		}
 
 		/*
 			Layered depth image and views
@@ -531,7 +1095,7 @@ public:
 		depth.image = new Image(vulkanDevice);
 		depth.image->setType(VK_IMAGE_TYPE_2D);
 		depth.image->setFormat(depthFormat);
-		depth.image->setExtent({ SHADOWMAP_DIM, SHADOWMAP_DIM, 1 });
+		depth.image->setExtent({ shadowMapDim, shadowMapDim, 1 });
 		depth.image->setNumArrayLayers(SHADOW_MAP_CASCADE_COUNT);
 		depth.image->setUsage(VK_IMAGE_USAGE_DEPTH_STENCIL_ATTACHMENT_BIT | VK_IMAGE_USAGE_SAMPLED_BIT);
 		depth.image->setTiling(VK_IMAGE_TILING_OPTIMAL);
@@ -559,12 +1123,24 @@ public:
 			framebufferInfo.renderPass = depthPass.renderPass->handle;
 			framebufferInfo.attachmentCount = 1;
 			framebufferInfo.pAttachments = &cascades[i].view->handle;
-			framebufferInfo.width = SHADOWMAP_DIM;
-			framebufferInfo.height = SHADOWMAP_DIM;
+			framebufferInfo.width = shadowMapDim;
+			framebufferInfo.height = shadowMapDim;
 			framebufferInfo.layers = 1;
 			VK_CHECK_RESULT(vkCreateFramebuffer(device, &framebufferInfo, nullptr, &cascades[i].frameBuffer));
 		}
 
+		// With multiview a single framebuffer covers all layers, the framebuffer itself must have a single layer
+		if (cascadeMultiview.supported) {
+			VkFramebufferCreateInfo framebufferInfo = vks::initializers::framebufferCreateInfo();
+			framebufferInfo.renderPass = cascadeMultiview.renderPass->handle;
+			framebufferInfo.attachmentCount = 1;
+			framebufferInfo.pAttachments = &depth.view->handle;
+			framebufferInfo.width = shadowMapDim;
+			framebufferInfo.height = shadowMapDim;
+			framebufferInfo.layers = 1;
+			VK_CHECK_RESULT(vkCreateFramebuffer(device, &framebufferInfo, nullptr, &cascadeMultiview.frameBuffer));
+		}
+
 		// Shared sampler for cascade deoth reads
 		VkSamplerCreateInfo sampler = vks::initializers::samplerCreateInfo();
 		sampler.magFilter = VK_FILTER_LINEAR;
@@ -585,8 +1161,11 @@ public:
 		Calculate frustum split depths and matrices for the shadow map cascades
 		Based on https://johanmedestrom.wordpress.com/2016/03/18/opengl-cascaded-shadow-maps/
 	*/
+	// Calculates the bounds of each cascade's slice of the camera frustum
+	// The matrices are built from these once a cascade is scheduled for redrawing, see scheduleCascades()
 	void updateCascades()
 	{
+		CPU_PROFILE_SCOPE("Update cascades");
 		float cascadeSplits[SHADOW_MAP_CASCADE_COUNT];
 
 		float nearClip = camera.getNearClip();
@@ -596,6 +1175,28 @@ public:
 		float minZ = nearClip;
 		float maxZ = nearClip + clipRange;
 
+		// Fit the cascades to the depth range that's actually visible
+		if (depthReduction.enabled && depthReduction.valid) {
+			const float reducedMinZ = glm::clamp(depthReduction.range.x * (1.0f - depthReduction.margin), nearClip, farClip);
+			const float reducedMaxZ = glm::clamp(depthReduction.range.y * (1.0f + depthReduction.margin), nearClip, farClip);
+			if (reducedMaxZ > reducedMinZ) {
+				minZ = reducedMinZ;
+				maxZ = reducedMaxZ;
+			}
+		}
+
+		// The bounds only depend on the camera and the split distribution, so there's nothing to do if neither changed
+		const glm::mat4 viewProjMatrix = camera.matrices.perspective * camera.matrices.view;
+		CascadeBoundsCache& cache = cascadeBoundsCache;
+		if (cache.valid && (cache.viewProjMatrix == viewProjMatrix) && (cache.splitLambda == cascadeSplitLambda) && (cache.minZ == minZ) && (cache.maxZ == maxZ)) {
+			return;
+		}
+		cache.valid = true;
+		cache.viewProjMatrix = viewProjMatrix;
+		cache.splitLambda = cascadeSplitLambda;
+		cache.minZ = minZ;
+		cache.maxZ = maxZ;
+
 		float range = maxZ - minZ;
 		float ratio = maxZ / minZ;
 
@@ -609,65 +1210,121 @@ public:
 			cascadeSplits[i] = (d - nearClip) / clipRange;
 		}
 
-		// Calculate orthographic projection matrix for each cascade
-		float lastSplitDist = 0.0;
+		// Project the corners of the camera frustum into world space once, the cascade slices are interpolated between them
+		// Depth is in [0, 1], so the near plane is at z = 0
+		const glm::vec2 frustumCornersNDC[4] = {
+			glm::vec2(-1.0f,  1.0f),
+			glm::vec2( 1.0f,  1.0f),
+			glm::vec2( 1.0f, -1.0f),
+			glm::vec2(-1.0f, -1.0f),
+		};
+		const glm::mat4 invCam = glm::inverse(viewProjMatrix);
+		glm::vec3 nearCorners[4];
+		glm::vec3 cornerRays[4];
+		for (uint32_t i = 0; i < 4; i++) {
+			const glm::vec4 nearCorner = invCam * glm::vec4(frustumCornersNDC[i], 0.0f, 1.0f);
+			const glm::vec4 farCorner = invCam * glm::vec4(frustumCornersNDC[i], 1.0f, 1.0f);
+			nearCorners[i] = glm::vec3(nearCorner) / nearCorner.w;
+			cornerRays[i] = glm::vec3(farCorner) / farCorner.w - nearCorners[i];
+		}
+
+		float lastSplitDist = (minZ - nearClip) / clipRange;
 		for (uint32_t i = 0; i < SHADOW_MAP_CASCADE_COUNT; i++) {
 			float splitDist = cascadeSplits[i];
 
-			glm::vec3 frustumCorners[8] = {
-				glm::vec3(-1.0f,  1.0f, -1.0f),
-				glm::vec3(1.0f,  1.0f, -1.0f),
-				glm::vec3(1.0f, -1.0f, -1.0f),
-				glm::vec3(-1.0f, -1.0f, -1.0f),
-				glm::vec3(-1.0f,  1.0f,  1.0f),
-				glm::vec3(1.0f,  1.0f,  1.0f),
-				glm::vec3(1.0f, -1.0f,  1.0f),
-				glm::vec3(-1.0f, -1.0f,  1.0f),
-			};
-
-			// Project frustum corners into world space
-			glm::mat4 invCam = glm::inverse(camera.matrices.perspective * camera.matrices.view);
-			for (uint32_t i = 0; i < 8; i++) {
-				glm::vec4 invCorner = invCam * glm::vec4(frustumCorners[i], 1.0f);
-				frustumCorners[i] = invCorner / invCorner.w;
-			}
-
-			for (uint32_t i = 0; i < 4; i++) {
-				glm::vec3 dist = frustumCorners[i + 4] - frustumCorners[i];
-				frustumCorners[i + 4] = frustumCorners[i] + (dist * splitDist);
-				frustumCorners[i] = frustumCorners[i] + (dist * lastSplitDist);
+			glm::vec3 frustumCorners[8];
+			for (uint32_t j = 0; j < 4; j++) {
+				frustumCorners[j] = nearCorners[j] + cornerRays[j] * lastSplitDist;
+				frustumCorners[j + 4] = nearCorners[j] + cornerRays[j] * splitDist;
 			}
 
 			// Get frustum center
 			glm::vec3 frustumCenter = glm::vec3(0.0f);
-			for (uint32_t i = 0; i < 8; i++) {
-				frustumCenter += frustumCorners[i];
+			for (uint32_t j = 0; j < 8; j++) {
+				frustumCenter += frustumCorners[j];
 			}
 			frustumCenter /= 8.0f;
 
+			// The radius doesn't change with the camera's position and orientation, rounding it keeps it stable despite precision issues
 			float radius = 0.0f;
-			for (uint32_t i = 0; i < 8; i++) {
-				float distance = glm::length(frustumCorners[i] - frustumCenter);
+			for (uint32_t j = 0; j < 8; j++) {
+				float distance = glm::length(frustumCorners[j] - frustumCenter);
 				radius = glm::max(radius, distance);
 			}
 			radius = std::ceil(radius * 16.0f) / 16.0f;
 
-			glm::vec3 maxExtents = glm::vec3(radius);
-			glm::vec3 minExtents = -maxExtents;
-
-			glm::vec3 lightDir = glm::normalize(-lightPos);
-			glm::mat4 lightViewMatrix = glm::lookAt(frustumCenter - lightDir * -minExtents.z, frustumCenter, glm::vec3(0.0f, 1.0f, 0.0f));
-			glm::mat4 lightOrthoMatrix = glm::ortho(minExtents.x, maxExtents.x, minExtents.y, maxExtents.y, 0.0f, maxExtents.z - minExtents.z);
-
-			// Store split distance and matrix in cascade
+			// Store split distance and bounds in cascade, the matrix is calculated once the cascade is scheduled for redrawing
 			cascades[i].splitDepth = (camera.getNearClip() + splitDist * clipRange) * -1.0f;
-			cascades[i].viewProjMatrix = lightOrthoMatrix * lightViewMatrix;
+			cascades[i].center = frustumCenter;
+			cascades[i].radius = radius;
 
 			lastSplitDist = cascadeSplits[i];
 		}
 	}
 
-	void drawCSM(CommandBuffer *cb) {
+	glm::mat4 getCascadeMatrix(const glm::vec3& center, float radius, const glm::vec3& lightDir)
+	{
+		glm::vec3 maxExtents = glm::vec3(radius);
+		glm::vec3 minExtents = -maxExtents;
+
+		glm::mat4 lightViewMatrix = glm::lookAt(center - lightDir * -minExtents.z, center, glm::vec3(0.0f, 1.0f, 0.0f));
+		glm::mat4 lightOrthoMatrix = glm::ortho(minExtents.x, maxExtents.x, minExtents.y, maxExtents.y, 0.0f, maxExtents.z - minExtents.z);
+
+		// Snap the projection to whole shadow map texels, so the depth doesn't shimmer while the cascade moves
+		// This also lines up the texels of cached cascades with those of redrawn ones
+		const glm::vec4 shadowOrigin = (lightOrthoMatrix * lightViewMatrix) * glm::vec4(0.0f, 0.0f, 0.0f, 1.0f) * (shadowMapDim / 2.0f);
+		glm::vec4 roundOffset = (glm::round(shadowOrigin) - shadowOrigin) * (2.0f / shadowMapDim);
+		roundOffset.z = 0.0f;
+		roundOffset.w = 0.0f;
+		lightOrthoMatrix[3] += roundOffset;
+
+		return lightOrthoMatrix * lightViewMatrix;
+	}
+
+	void invalidateCascades()
+	{
+		for (auto& cached : cascadeScheduler.cached) {
+			cached.valid = false;
+		}
+	}
+
+	// Selects the cascades to be redrawn in this frame and updates their matrices
+	// As the scene is static, a cascade only needs to be redrawn if its bounds changed
+	void scheduleCascades()
+	{
+		const bool scheduling = settings.dynamicCommandBuffers && cascadeScheduler.enabled;
+		const glm::vec3 lightDir = glm::normalize(glm::vec3(-lightPos));
+		if (lightDir != cascadeScheduler.lightDir) {
+			invalidateCascades();
+			cascadeScheduler.lightDir = lightDir;
+		}
+
+		cascadeScheduler.redrawCount = 0;
+		for (uint32_t i = 0; i < SHADOW_MAP_CASCADE_COUNT; i++) {
+			CascadeScheduler::Cached& cached = cascadeScheduler.cached[i];
+			bool redraw = !scheduling || !cached.valid;
+			if (!redraw) {
+				const float distance = glm::length(cascades[i].center - cached.center);
+				const bool due = (cascadeScheduler.frame - cached.frame) >= cascadeScheduler.intervals[i];
+				// A changed radius (e.g. from the split lambda or aspect ratio) would change the cascade's resolution, so it can't be deferred
+				redraw = (cascades[i].radius != cached.radius) || (distance > cascadeScheduler.threshold * cascades[i].radius) || ((distance > 0.0f) && due);
+			}
+			cascadeScheduler.redraw[i] = redraw;
+			if (redraw) {
+				const float padding = (scheduling && (cascadeScheduler.intervals[i] > 1)) ? 1.0f + cascadeScheduler.threshold : 1.0f;
+				cascades[i].viewProjMatrix = getCascadeMatrix(cascades[i].center, cascades[i].radius * padding, lightDir);
+				cached.valid = true;
+				cached.center = cascades[i].center;
+				cached.radius = cascades[i].radius;
+				cached.frame = cascadeScheduler.frame;
+				cascadeScheduler.redrawCount++;
+			}
+		}
+		cascadeScheduler.totalRedrawCount += cascadeScheduler.redrawCount;
+		cascadeScheduler.frame++;
+	}
+
+	void drawCSM(CommandBuffer *cb, uint32_t bufferIndex) {
 		/*
 			Generate depth map cascades
 
@@ -677,109 +1334,638 @@ public:
 		VkClearValue clearValues[1];
 		clearValues[0].depthStencil = { 1.0f, 0 };
 
-		cb->setViewport(0, 0, (float)SHADOWMAP_DIM, (float)SHADOWMAP_DIM, 0.0f, 1.0f);
-		cb->setScissor(0, 0, SHADOWMAP_DIM, SHADOWMAP_DIM);
+		cb->setViewport(0, 0, (float)shadowMapDim, (float)shadowMapDim, 0.0f, 1.0f);
+		cb->setScissor(0, 0, shadowMapDim, shadowMapDim);
+		if (useCascadeMultiview()) {
+			cb->beginRenderPass(cascadeMultiview.renderPass, cascadeMultiview.frameBuffer, VK_SUBPASS_CONTENTS_INLINE, "Shadow cascades");
+			drawShadowCasters(cb, bufferIndex);
+			cb->endRenderPass();
+			return;
+		}
 		// One pass per cascade
 		// The layer that this pass renders to is defined by the cascade's image view (selected via the cascade's decsriptor set)
+		// Cascades that are not redrawn keep the depth from their last update
 		for (uint32_t j = 0; j < SHADOW_MAP_CASCADE_COUNT; j++) {
-			cb->beginRenderPass(depthPass.renderPass, cascades[j].frameBuffer);
-			drawShadowCasters(cb, j);
+			if (!cascadeScheduler.redraw[j]) {
+				continue;
+			}
+			cb->beginRenderPass(depthPass.renderPass, cascades[j].frameBuffer, VK_SUBPASS_CONTENTS_INLINE, "Shadow cascades");
+			drawShadowCasters(cb, bufferIndex, j);
 			cb->endRenderPass();
 		}
 	}
 
 	/*
-		Sample
+		Water resolution
 	*/
 
-	void buildCommandBuffers()
+	// Sets viewport and scissor for the refraction and reflection passes
+	void setWaterViewport(CommandBuffer* cb)
 	{
-		for (int32_t i = 0; i < commandBuffers.size(); i++) {
-			CommandBuffer *cb = commandBuffers[i];
-			cb->begin();
-
-			/*
-				CSM
-			*/
-			drawCSM(cb);
+		const uint32_t viewportWidth = std::max(static_cast<uint32_t>(offscreenPass.width * waterResolution.scale), 1u);
+		const uint32_t viewportHeight = std::max(static_cast<uint32_t>(offscreenPass.height * waterResolution.scale), 1u);
+		cb->setViewport(0.0f, 0.0f, (float)viewportWidth, (float)viewportHeight, 0.0f, 1.0f);
+		cb->setScissor(0, 0, viewportWidth, viewportHeight);
+	}
 
-			/*
-				Render refraction
-			*/	
-			{
-				cb->beginRenderPass(offscreenPass.renderPass, offscreenPass.refraction.frameBuffer);
-				cb->setViewport(0.0f, 0.0f, (float)offscreenPass.width, (float)offscreenPass.height, 0.0f, 1.0f);
-				cb->setScissor(0, 0, offscreenPass.width, offscreenPass.height);
-				drawScene(cb, SceneDrawType::sceneDrawTypeRefract);
-				cb->endRenderPass();
+	// Takes the GPU time of the water passes from the profiler results read back for the swap chain image and selects the scale for the current frame
+	void updateWaterResolution(bool profilerResults)
+	{
+		if (profilerResults) {
+			// Frames without visible water don't contain the passes and keep the last measurement
+			float gpuTime = 0.0f;
+			for (auto& result : gpuProfiler->getResults()) {
+				if ((result.name == "Refraction") || (result.name == "Reflection")) {
+					gpuTime += result.gpuTime;
+				}
 			}
-
-			/*
-				Render reflection
-			*/
-			{
-				cb->beginRenderPass(offscreenPass.renderPass, offscreenPass.reflection.frameBuffer);
-				cb->setViewport(0.0f, 0.0f, (float)offscreenPass.width, (float)offscreenPass.height, 0.0f, 1.0f);
-				cb->setScissor(0, 0, offscreenPass.width, offscreenPass.height);
-				drawScene(cb, SceneDrawType::sceneDrawTypeReflect);
-				cb->endRenderPass();
+			if (gpuTime > 0.0f) {
+				waterResolution.gpuTime = gpuTime;
 			}
+		}
+		// The dynamic scale needs the viewport to be recorded every frame
+		if ((waterResolution.mode == WaterResolution::modeDynamic) && settings.dynamicCommandBuffers && gpuProfiler->supported) {
+			// The cost of both passes is roughly proportional to their pixel count, damped as the measurement lags behind by a few frames
+			if (waterResolution.gpuTime > 0.0f) {
+				const float targetScale = waterResolution.scale * std::sqrt(waterResolution.budget / waterResolution.gpuTime);
+				waterResolution.scale = glm::clamp(glm::mix(waterResolution.scale, targetScale, 0.25f), waterResolution.minScale, 1.0f);
+			}
+		} else {
+			waterResolution.scale = waterResolution.fixedScale;
+		}
+	}
 
-			/*
-				Scene rendering with reflection, refraction and shadows
-			*/
-			{
-				cb->beginRenderPass(renderPass, frameBuffers[i]);
-				cb->setViewport(0.0f, 0.0f, (float)width, (float)height, 0.0f, 1.0f);
-				cb->setScissor(0, 0, width, height);			
-				drawScene(cb, SceneDrawType::sceneDrawTypeDisplay);
-				// Reflection plane
-				cb->bindDescriptorSets(pipelineLayouts.textured, { descriptorSets.waterplane }, 0);
-				cb->bindPipeline(pipelines.mirror);
-				models.plane.draw(cb->handle);
-
-				if (debugDisplayReflection) {
-					uint32_t val0 = 0;
-					cb->bindDescriptorSets(pipelineLayouts.textured, { descriptorSets.debugquad }, 0);
-					cb->bindPipeline(pipelines.debug);
-					cb->updatePushConstant(pipelineLayouts.debug, 0, &val0);
-					cb->draw(6, 1, 0, 0);
-				}
-
-				if (debugDisplayRefraction) {
-					uint32_t val1 = 1;
-					cb->bindDescriptorSets(pipelineLayouts.textured, { descriptorSets.debugquad }, 0);
-					cb->bindPipeline(pipelines.debug);
-					cb->updatePushConstant(pipelineLayouts.debug, 0, &val1);
-					cb->draw(6, 1, 0, 0);
-				}
-
-				if (cascadeDebug.enabled) {
-					const CascadePushConstBlock pushConst = { glm::vec4(0.0f), cascadeDebug.cascadeIndex };
-					cb->bindDescriptorSets(cascadeDebug.pipelineLayout, { cascadeDebug.descriptorSet }, 0);
-					cb->bindPipeline(cascadeDebug.pipeline);
-					cb->updatePushConstant(cascadeDebug.pipelineLayout, 0, &pushConst);
-					cb->draw(6, 1, 0, 0);
-				}
+	/*
+		Water visibility
+	*/
 
-				drawUI(cb->handle);
+	bool useWaterOcclusionQuery()
+	{
+		return settings.dynamicCommandBuffers && waterVisibility.enabled && waterVisibility.occlusionQueries;
+	}
 
-				cb->endRenderPass();
+	// Decides if the water passes are required for the current frame, called after the camera frustum has been updated
+	void updateWaterVisibility()
+	{
+		if (!settings.dynamicCommandBuffers || !waterVisibility.enabled) {
+			waterVisibility.inFrustum = true;
+			waterVisibility.visible = true;
+			return;
+		}
+		waterVisibility.inFrustum = terrainCulling.camera.checkBox(models.plane.dimensions.min, models.plane.dimensions.max);
+		if (!waterVisibility.inFrustum) {
+			// Unknown once the plane enters the frustum again, so it's assumed to be visible until its first query has been read
+			waterVisibility.passedSamples = 1;
+		} else if (useWaterOcclusionQuery() && waterVisibility.queriesWritten[currentBuffer]) {
+			uint64_t passedSamples;
+			if (vkGetQueryPoolResults(device, waterVisibility.queryPool, currentBuffer, 1, sizeof(passedSamples), &passedSamples, sizeof(uint64_t), VK_QUERY_RESULT_64_BIT) == VK_SUCCESS) {
+				waterVisibility.passedSamples = passedSamples;
 			}
-			cb->end();
+		}
+		waterVisibility.visible = waterVisibility.inFrustum && (!useWaterOcclusionQuery() || (waterVisibility.passedSamples > 0));
+		if (!waterVisibility.visible) {
+			waterVisibility.skippedFrames++;
 		}
 	}
 
-	void loadAssets()
+	// Query pool resets need to be recorded outside of a render pass
+	void resetWaterOcclusionQuery(CommandBuffer* cb, uint32_t bufferIndex)
 	{
-		models.skysphere.loadFromFile(getAssetPath() + "scenes/geosphere.gltf", vulkanDevice, queue);
-		models.plane.loadFromFile(getAssetPath() + "scenes/plane.gltf", vulkanDevice, queue);
-		models.testscene.loadFromFile(getAssetPath() + "scenes/testscene.gltf", vulkanDevice, queue);
-				
-		textures.skySphere.loadFromFile(getAssetPath() + "textures/skysphere_02.ktx", VK_FORMAT_R8G8B8A8_UNORM, vulkanDevice, queue);
-		textures.terrainArray.loadFromFile(getAssetPath() + "textures/terrain_layers_01_rgba.ktx", VK_FORMAT_R8G8B8A8_UNORM, vulkanDevice, queue);
-		textures.heightMap.loadFromFile(getAssetPath() + "heightmap.ktx", VK_FORMAT_R16_UNORM, vulkanDevice, queue);
-		textures.waterNormalMap.loadFromFile(getAssetPath() + "textures/water_normal_rgba.ktx", VK_FORMAT_R8G8B8A8_UNORM, vulkanDevice, queue);
+		if (useWaterOcclusionQuery() && waterVisibility.inFrustum) {
+			vkCmdResetQueryPool(cb->handle, waterVisibility.queryPool, bufferIndex, 1);
+		}
+	}
+
+	/*
+		Scene copy refraction
+	*/
+
+	// Only split the main pass if the water plane is actually drawn
+	bool useSceneCopyRefraction()
+	{
+		return sceneCopyRefraction.enabled && waterVisibility.inFrustum;
+	}
+
+	// Copies color and depth of the opaque pass, which leaves both attachments in transfer source layout
+	void copySceneForRefraction(CommandBuffer* cb, uint32_t bufferIndex)
+	{
+		// Layout transitions of combined depth stencil images need to include both aspects
+		VkImageSubresourceRange depthSubresourceRange = { VK_IMAGE_ASPECT_DEPTH_BIT, 0, 1, 0, 1 };
+		if (depthFormat >= VK_FORMAT_D16_UNORM_S8_UINT) {
+			depthSubresourceRange.aspectMask |= VK_IMAGE_ASPECT_STENCIL_BIT;
+		}
+
+		// The previous contents are discarded, but the copy targets are shared by all frames in flight, so earlier water draws need to be done sampling them
+		std::array<VkImageMemoryBarrier, 2> imageBarriers;
+		for (auto& imageBarrier : imageBarriers) {
+			imageBarrier = vks::initializers::imageMemoryBarrier();
+			imageBarrier.srcQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+			imageBarrier.dstQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+			imageBarrier.oldLayout = VK_IMAGE_LAYOUT_UNDEFINED;
+			imageBarrier.newLayout = VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL;
+			imageBarrier.srcAccessMask = 0;
+			imageBarrier.dstAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT;
+		}
+		imageBarriers[0].image = sceneCopyRefraction.colorImage->handle;
+		imageBarriers[0].subresourceRange = { VK_IMAGE_ASPECT_COLOR_BIT, 0, 1, 0, 1 };
+		imageBarriers[1].image = sceneCopyRefraction.depthImage->handle;
+		imageBarriers[1].subresourceRange = depthSubresourceRange;
+		vkCmdPipelineBarrier(cb->handle, VK_PIPELINE_STAGE_FRAGMENT_SHADER_BIT, VK_PIPELINE_STAGE_TRANSFER_BIT, 0, 0, nullptr, 0, nullptr, static_cast<uint32_t>(imageBarriers.size()), imageBarriers.data());
+
+		VkImageCopy imageCopy{};
+		imageCopy.srcSubresource = { VK_IMAGE_ASPECT_COLOR_BIT, 0, 0, 1 };
+		imageCopy.dstSubresource = imageCopy.srcSubresource;
+		imageCopy.extent = { width, height, 1 };
+		vkCmdCopyImage(cb->handle, swapChain.images[bufferIndex], VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL, sceneCopyRefraction.colorImage->handle, VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL, 1, &imageCopy);
+		// Only the depth aspect is sampled
+		imageCopy.srcSubresource.aspectMask = VK_IMAGE_ASPECT_DEPTH_BIT;
+		imageCopy.dstSubresource.aspectMask = VK_IMAGE_ASPECT_DEPTH_BIT;
+		vkCmdCopyImage(cb->handle, depthStencil.image, VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL, sceneCopyRefraction.depthImage->handle, VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL, 1, &imageCopy);
+
+		for (auto& imageBarrier : imageBarriers) {
+			imageBarrier.oldLayout = VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL;
+			imageBarrier.srcAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT;
+			imageBarrier.dstAccessMask = VK_ACCESS_SHADER_READ_BIT;
+		}
+		imageBarriers[0].newLayout = VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL;
+		imageBarriers[1].newLayout = VK_IMAGE_LAYOUT_DEPTH_STENCIL_READ_ONLY_OPTIMAL;
+		vkCmdPipelineBarrier(cb->handle, VK_PIPELINE_STAGE_TRANSFER_BIT, VK_PIPELINE_STAGE_FRAGMENT_SHADER_BIT, 0, 0, nullptr, 0, nullptr, static_cast<uint32_t>(imageBarriers.size()), imageBarriers.data());
+	}
+
+	/*
+		Depth reduction
+	*/
+
+	void createDepthReductionView()
+	{
+		if (depthReduction.view != VK_NULL_HANDLE) {
+			vkDestroyImageView(device, depthReduction.view, nullptr);
+		}
+		// Sampled views may only contain a single aspect
+		VkImageViewCreateInfo viewCI = vks::initializers::imageViewCreateInfo();
+		viewCI.viewType = VK_IMAGE_VIEW_TYPE_2D;
+		viewCI.image = depthStencil.image;
+		viewCI.format = depthFormat;
+		viewCI.subresourceRange = { VK_IMAGE_ASPECT_DEPTH_BIT, 0, 1, 0, 1 };
+		VK_CHECK_RESULT(vkCreateImageView(device, &viewCI, nullptr, &depthReduction.view));
+	}
+
+	// Reduces the depth buffer written by the scene pass into the swap chain image's range buffer
+	void reduceDepth(CommandBuffer* cb, uint32_t bufferIndex)
+	{
+		if (!depthReduction.enabled) {
+			return;
+		}
+		const vks::Buffer& buffer = depthReduction.buffers[bufferIndex];
+		vkCmdFillBuffer(cb->handle, buffer.buffer, 0, sizeof(uint32_t), 0x7f7fffff);
+		vkCmdFillBuffer(cb->handle, buffer.buffer, sizeof(uint32_t), sizeof(uint32_t), 0);
+
+		// Layout transitions of combined depth stencil images need to include both aspects
+		VkImageSubresourceRange subresourceRange = { VK_IMAGE_ASPECT_DEPTH_BIT, 0, 1, 0, 1 };
+		if (depthFormat >= VK_FORMAT_D16_UNORM_S8_UINT) {
+			subresourceRange.aspectMask |= VK_IMAGE_ASPECT_STENCIL_BIT;
+		}
+
+		VkBufferMemoryBarrier bufferBarrier = vks::initializers::bufferMemoryBarrier();
+		bufferBarrier.srcQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+		bufferBarrier.dstQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+		bufferBarrier.buffer = buffer.buffer;
+		bufferBarrier.size = VK_WHOLE_SIZE;
+		bufferBarrier.srcAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT;
+		bufferBarrier.dstAccessMask = VK_ACCESS_SHADER_READ_BIT | VK_ACCESS_SHADER_WRITE_BIT;
+		VkImageMemoryBarrier imageBarrier = vks::initializers::imageMemoryBarrier();
+		imageBarrier.srcQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+		imageBarrier.dstQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+		imageBarrier.image = depthStencil.image;
+		imageBarrier.subresourceRange = subresourceRange;
+		imageBarrier.oldLayout = VK_IMAGE_LAYOUT_DEPTH_STENCIL_ATTACHMENT_OPTIMAL;
+		imageBarrier.newLayout = VK_IMAGE_LAYOUT_DEPTH_STENCIL_READ_ONLY_OPTIMAL;
+		imageBarrier.srcAccessMask = VK_ACCESS_DEPTH_STENCIL_ATTACHMENT_WRITE_BIT;
+		imageBarrier.dstAccessMask = VK_ACCESS_SHADER_READ_BIT;
+		vkCmdPipelineBarrier(cb->handle, VK_PIPELINE_STAGE_TRANSFER_BIT | VK_PIPELINE_STAGE_LATE_FRAGMENT_TESTS_BIT, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, 0, 0, nullptr, 1, &bufferBarrier, 1, &imageBarrier);
+
+		const glm::mat4 inverseProjection = glm::inverse(camera.matrices.perspective);
+		cb->bindPipeline(depthReduction.pipeline);
+		cb->bindDescriptorSets(depthReduction.pipelineLayout, { depthReduction.descriptorSets[bufferIndex] }, 0, VK_PIPELINE_BIND_POINT_COMPUTE);
+		cb->updatePushConstant(depthReduction.pipelineLayout, 0, &inverseProjection);
+		cb->dispatch((width + 15) / 16, (height + 15) / 16, 1);
+
+		// Make the result visible to the host and hand the depth buffer back to the next frame's scene pass
+		bufferBarrier.srcAccessMask = VK_ACCESS_SHADER_WRITE_BIT;
+		bufferBarrier.dstAccessMask = VK_ACCESS_HOST_READ_BIT;
+		imageBarrier.oldLayout = VK_IMAGE_LAYOUT_DEPTH_STENCIL_READ_ONLY_OPTIMAL;
+		imageBarrier.newLayout = VK_IMAGE_LAYOUT_DEPTH_STENCIL_ATTACHMENT_OPTIMAL;
+		imageBarrier.srcAccessMask = 0;
+		imageBarrier.dstAccessMask = VK_ACCESS_DEPTH_STENCIL_ATTACHMENT_READ_BIT | VK_ACCESS_DEPTH_STENCIL_ATTACHMENT_WRITE_BIT;
+		vkCmdPipelineBarrier(cb->handle, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, VK_PIPELINE_STAGE_HOST_BIT | VK_PIPELINE_STAGE_EARLY_FRAGMENT_TESTS_BIT | VK_PIPELINE_STAGE_LATE_FRAGMENT_TESTS_BIT, 0, 0, nullptr, 1, &bufferBarrier, 1, &imageBarrier);
+	}
+
+	// Called once the swap chain image's previous command buffer has finished
+	void readDepthReduction()
+	{
+		if (!depthReduction.enabled) {
+			return;
+		}
+		const uint32_t* range = (const uint32_t*)depthReduction.buffers[currentBuffer].mapped;
+		// Not written yet or no visible samples
+		if (range[0] > range[1]) {
+			return;
+		}
+		memcpy(&depthReduction.range.x, &range[0], sizeof(float));
+		memcpy(&depthReduction.range.y, &range[1], sizeof(float));
+		depthReduction.valid = true;
+	}
+
+	/*
+		Sample
+	*/
+
+	// Reflection plane
+	void drawWater(CommandBuffer* cb, uint32_t bufferIndex)
+	{
+		// Still drawn if it was occluded in the previous frame, so the query notices once it becomes visible again
+		if (!waterVisibility.inFrustum) {
+			return;
+		}
+		const bool occlusionQuery = useWaterOcclusionQuery();
+		if (occlusionQuery) {
+			vkCmdBeginQuery(cb->handle, waterVisibility.queryPool, bufferIndex, 0);
+		}
+		if (useSceneCopyRefraction()) {
+			cb->bindDescriptorSets(pipelineLayouts.textured, { descriptorSets[bufferIndex].waterplaneSceneCopy }, 0);
+			cb->bindPipeline(sceneCopyRefraction.pipeline);
+		} else if (bindless.enabled) {
+			BindlessPushConstBlock pushConst;
+			pushConst.textureIndices = { bindless.textureIndices.refraction, bindless.textureIndices.reflection, bindless.textureIndices.waterNormalMap, bindless.textureIndices.shadowMap };
+			bindBindlessTextures(cb);
+			cb->bindDescriptorSets(bindless.pipelineLayout, { descriptorSets[bufferIndex].bindlessWaterplane }, 0);
+			cb->bindPipeline(bindless.pipelines.mirror);
+			cb->updatePushConstant(bindless.pipelineLayout, 0, &pushConst);
+		} else {
+			cb->bindDescriptorSets(pipelineLayouts.textured, { descriptorSets[bufferIndex].waterplane }, 0);
+			cb->bindPipeline(pipelines.mirror);
+		}
+		models.plane.draw(cb->handle);
+		if (occlusionQuery) {
+			vkCmdEndQuery(cb->handle, waterVisibility.queryPool, bufferIndex);
+		}
+	}
+
+	void drawDebugDisplays(CommandBuffer* cb, uint32_t bufferIndex)
+	{
+		if (debugDisplayReflection) {
+			uint32_t val0 = 0;
+			cb->bindDescriptorSets(pipelineLayouts.textured, { descriptorSets[bufferIndex].debugquad }, 0);
+			cb->bindPipeline(pipelines.debug);
+			cb->updatePushConstant(pipelineLayouts.debug, 0, &val0);
+			cb->draw(6, 1, 0, 0);
+		}
+
+		// The refraction pass isn't rendered with the scene copy
+		if (debugDisplayRefraction && !sceneCopyRefraction.enabled) {
+			uint32_t val1 = 1;
+			cb->bindDescriptorSets(pipelineLayouts.textured, { descriptorSets[bufferIndex].debugquad }, 0);
+			cb->bindPipeline(pipelines.debug);
+			cb->updatePushConstant(pipelineLayouts.debug, 0, &val1);
+			cb->draw(6, 1, 0, 0);
+		}
+
+		if (cascadeDebug.enabled) {
+			const CascadePushConstBlock pushConst = { glm::vec4(0.0f), cascadeDebug.cascadeIndex };
+			cb->bindDescriptorSets(cascadeDebug.pipelineLayout, { cascadeDebug.descriptorSet }, 0);
+			cb->bindPipeline(cascadeDebug.pipeline);
+			cb->updatePushConstant(cascadeDebug.pipelineLayout, 0, &pushConst);
+			cb->draw(6, 1, 0, 0);
+		}
+	}
+
+	// Scene rendering with reflection, refraction and shadows
+	void drawDisplay(CommandBuffer* cb, uint32_t bufferIndex)
+	{
+		drawScene(cb, bufferIndex, SceneDrawType::sceneDrawTypeDisplay);
+		drawWater(cb, bufferIndex);
+		drawDebugDisplays(cb, bufferIndex);
+	}
+
+	void prepareMultiThreading()
+	{
+		CPU_PROFILE_SCOPE("Prepare multi threading");
+		// A thread per pass at most, additional threads would never get any work
+		uint32_t threadCount = std::max(std::min(std::thread::hardware_concurrency(), (uint32_t)secondaryPassCount), 1u);
+		multiThreading.threadPool.setThreadCount(threadCount);
+		multiThreading.commandPools.resize(threadCount);
+		for (auto& commandPool : multiThreading.commandPools) {
+			commandPool = new CommandPool(device);
+			// The secondary command buffers are re-recorded every frame, so they are short lived
+			commandPool->setFlags(VK_COMMAND_POOL_CREATE_TRANSIENT_BIT | VK_COMMAND_POOL_CREATE_RESET_COMMAND_BUFFER_BIT);
+			commandPool->setQueueFamilyIndex(vulkanDevice->queueFamilyIndices.graphics);
+			commandPool->create();
+		}
+	}
+
+	void createSecondaryCommandBuffers()
+	{
+		destroySecondaryCommandBuffers();
+		multiThreading.commandBuffers.resize(swapChain.imageCount);
+		for (auto& secondaries : multiThreading.commandBuffers) {
+			for (uint32_t i = 0; i < secondaryPassCount; i++) {
+				// Passes are distributed over the threads in a fixed order, so a pass always allocates from and records on the same thread
+				secondaries[i] = new CommandBuffer(device);
+				secondaries[i]->setPool(multiThreading.commandPools[i % multiThreading.commandPools.size()]);
+				secondaries[i]->setLevel(VK_COMMAND_BUFFER_LEVEL_SECONDARY);
+				secondaries[i]->create();
+			}
+		}
+	}
+
+	void destroySecondaryCommandBuffers()
+	{
+		for (auto& secondaries : multiThreading.commandBuffers) {
+			for (auto& commandBuffer : secondaries) {
+				delete commandBuffer;
+			}
+		}
+		multiThreading.commandBuffers.clear();
+	}
+
+	// Records a single pass into its secondary command buffer, called from the worker threads
+	void recordSecondaryCommandBuffer(uint32_t bufferIndex, uint32_t pass)
+	{
+		CPU_PROFILE_SCOPE("Record secondary command buffer");
+		CommandBuffer* cb = multiThreading.commandBuffers[bufferIndex][pass];
+		// Dynamic state is not inherited from the primary command buffer, so each secondary command buffer needs to set viewport and scissor
+		if (pass < SHADOW_MAP_CASCADE_COUNT) {
+			// With multiview the first cascade's command buffer renders all cascades
+			if (useCascadeMultiview()) {
+				cb->beginSecondary(cascadeMultiview.renderPass, cascadeMultiview.frameBuffer);
+			} else {
+				cb->beginSecondary(depthPass.renderPass, cascades[pass].frameBuffer);
+			}
+			cb->setViewport(0, 0, (float)shadowMapDim, (float)shadowMapDim, 0.0f, 1.0f);
+			cb->setScissor(0, 0, shadowMapDim, shadowMapDim);
+			drawShadowCasters(cb, bufferIndex, pass);
+		} else if ((pass == secondaryPassRefraction) || (pass == secondaryPassReflection)) {
+			const bool refraction = (pass == secondaryPassRefraction);
+			cb->beginSecondary(offscreenPass.renderPass, refraction ? offscreenPass.refraction.frameBuffer : offscreenPass.reflection.frameBuffer);
+			setWaterViewport(cb);
+			drawScene(cb, bufferIndex, refraction ? SceneDrawType::sceneDrawTypeRefract : SceneDrawType::sceneDrawTypeReflect);
+		} else {
+			// With the scene copy, the water is drawn together with the UI in the render pass following the copy
+			const bool sceneCopy = useSceneCopyRefraction();
+			if (pass == secondaryPassScene) {
+				cb->beginSecondary(sceneCopy ? sceneCopyRefraction.opaqueRenderPass : renderPass, frameBuffers[bufferIndex]);
+			} else {
+				cb->beginSecondary(sceneCopy ? sceneCopyRefraction.waterRenderPass : renderPass, frameBuffers[bufferIndex]);
+			}
+			cb->setViewport(0.0f, 0.0f, (float)width, (float)height, 0.0f, 1.0f);
+			cb->setScissor(0, 0, width, height);
+			if (pass == secondaryPassScene) {
+				if (sceneCopy) {
+					drawScene(cb, bufferIndex, SceneDrawType::sceneDrawTypeDisplay);
+				} else {
+					drawDisplay(cb, bufferIndex);
+				}
+			} else {
+				if (sceneCopy) {
+					drawWater(cb, bufferIndex);
+					drawDebugDisplays(cb, bufferIndex);
+				}
+				drawUI(cb->handle, bufferIndex);
+			}
+		}
+		cb->end();
+	}
+
+	// Distributes the passes of a single swap chain image over the worker threads, callers need to wait for the thread pool to finish
+	void recordSecondaryCommandBuffers(uint32_t bufferIndex)
+	{
+		if (multiThreading.commandBuffers.size() != swapChain.imageCount) {
+			createSecondaryCommandBuffers();
+		}
+		const uint32_t threadCount = static_cast<uint32_t>(multiThreading.threadPool.threads.size());
+		for (uint32_t j = 0; j < secondaryPassCount; j++) {
+			if ((j < SHADOW_MAP_CASCADE_COUNT) && (!cascadeScheduler.redraw[j] || ((j > 0) && useCascadeMultiview()))) {
+				continue;
+			}
+			if (((j == secondaryPassRefraction) || (j == secondaryPassReflection)) && !waterVisibility.visible) {
+				continue;
+			}
+			if ((j == secondaryPassRefraction) && useSceneCopyRefraction()) {
+				continue;
+			}
+			multiThreading.threadPool.threads[j % threadCount]->addJob([=] { recordSecondaryCommandBuffer(bufferIndex, j); });
+		}
+	}
+
+	// The primary command buffer only begins the render passes and executes the secondary command buffers
+	void executeSecondaryCommandBuffers(CommandBuffer* cb, uint32_t bufferIndex)
+	{
+		std::array<CommandBuffer*, secondaryPassCount>& secondaries = multiThreading.commandBuffers[bufferIndex];
+		cb->begin();
+		beginProfiling(cb, bufferIndex);
+
+		if (useCascadeMultiview()) {
+			cb->beginRenderPass(cascadeMultiview.renderPass, cascadeMultiview.frameBuffer, VK_SUBPASS_CONTENTS_SECONDARY_COMMAND_BUFFERS, "Shadow cascades");
+			cb->executeCommands({ secondaries[0] });
+			cb->endRenderPass();
+		} else {
+			for (uint32_t j = 0; j < SHADOW_MAP_CASCADE_COUNT; j++) {
+				if (!cascadeScheduler.redraw[j]) {
+					continue;
+				}
+				cb->beginRenderPass(depthPass.renderPass, cascades[j].frameBuffer, VK_SUBPASS_CONTENTS_SECONDARY_COMMAND_BUFFERS, "Shadow cascades");
+				cb->executeCommands({ secondaries[j] });
+				cb->endRenderPass();
+			}
+		}
+
+		if (waterVisibility.visible) {
+			if (!useSceneCopyRefraction()) {
+				cb->beginRenderPass(offscreenPass.renderPass, offscreenPass.refraction.frameBuffer, VK_SUBPASS_CONTENTS_SECONDARY_COMMAND_BUFFERS, "Refraction");
+				cb->executeCommands({ secondaries[secondaryPassRefraction] });
+				cb->endRenderPass();
+			}
+
+			cb->beginRenderPass(offscreenPass.renderPass, offscreenPass.reflection.frameBuffer, VK_SUBPASS_CONTENTS_SECONDARY_COMMAND_BUFFERS, "Reflection");
+			cb->executeCommands({ secondaries[secondaryPassReflection] });
+			cb->endRenderPass();
+		}
+
+		resetWaterOcclusionQuery(cb, bufferIndex);
+
+		// The UI overlay is recorded into a secondary command buffer of the scene's render pass, so it can't be timed separately
+		if (useSceneCopyRefraction()) {
+			cb->beginRenderPass(sceneCopyRefraction.opaqueRenderPass, frameBuffers[bufferIndex], VK_SUBPASS_CONTENTS_SECONDARY_COMMAND_BUFFERS, "Scene");
+			cb->executeCommands({ secondaries[secondaryPassScene] });
+			cb->endRenderPass();
+			copySceneForRefraction(cb, bufferIndex);
+			cb->beginRenderPass(sceneCopyRefraction.waterRenderPass, frameBuffers[bufferIndex], VK_SUBPASS_CONTENTS_SECONDARY_COMMAND_BUFFERS, "Scene");
+			cb->executeCommands({ secondaries[secondaryPassUI] });
+			cb->endRenderPass();
+		} else {
+			cb->beginRenderPass(renderPass, frameBuffers[bufferIndex], VK_SUBPASS_CONTENTS_SECONDARY_COMMAND_BUFFERS, "Scene");
+			cb->executeCommands({ secondaries[secondaryPassScene], secondaries[secondaryPassUI] });
+			cb->endRenderPass();
+		}
+
+		reduceDepth(cb, bufferIndex);
+
+		cb->end();
+	}
+
+	// Render passes that are begun with a scope name are profiled
+	void beginProfiling(CommandBuffer* cb, uint32_t bufferIndex)
+	{
+		gpuProfiler->beginFrame(cb->handle, bufferIndex);
+		cb->setProfiler(gpuProfiler->supported ? gpuProfiler : nullptr, bufferIndex);
+	}
+
+	// Records all passes for the given swap chain image on the calling thread
+	void recordCommandBuffer(CommandBuffer* cb, uint32_t bufferIndex)
+	{
+		CPU_PROFILE_SCOPE("Record command buffer");
+		cb->begin();
+		beginProfiling(cb, bufferIndex);
+
+		/*
+			CSM
+		*/
+		drawCSM(cb, bufferIndex);
+
+		if (waterVisibility.visible) {
+			/*
+				Render refraction
+			*/
+			if (!useSceneCopyRefraction()) {
+				cb->beginRenderPass(offscreenPass.renderPass, offscreenPass.refraction.frameBuffer, VK_SUBPASS_CONTENTS_INLINE, "Refraction");
+				setWaterViewport(cb);
+				drawScene(cb, bufferIndex, SceneDrawType::sceneDrawTypeRefract);
+				cb->endRenderPass();
+			}
+
+			/*
+				Render reflection
+			*/
+			{
+				cb->beginRenderPass(offscreenPass.renderPass, offscreenPass.reflection.frameBuffer, VK_SUBPASS_CONTENTS_INLINE, "Reflection");
+				setWaterViewport(cb);
+				drawScene(cb, bufferIndex, SceneDrawType::sceneDrawTypeReflect);
+				cb->endRenderPass();
+			}
+		}
+
+		resetWaterOcclusionQuery(cb, bufferIndex);
+
+		/*
+			Scene rendering with reflection, refraction and shadows
+		*/
+		if (useSceneCopyRefraction()) {
+			// Split around the copy the water's refraction is sampled from
+			cb->beginRenderPass(sceneCopyRefraction.opaqueRenderPass, frameBuffers[bufferIndex], VK_SUBPASS_CONTENTS_INLINE, "Scene");
+			cb->setViewport(0.0f, 0.0f, (float)width, (float)height, 0.0f, 1.0f);
+			cb->setScissor(0, 0, width, height);
+			drawScene(cb, bufferIndex, SceneDrawType::sceneDrawTypeDisplay);
+			cb->endRenderPass();
+
+			copySceneForRefraction(cb, bufferIndex);
+
+			cb->beginRenderPass(sceneCopyRefraction.waterRenderPass, frameBuffers[bufferIndex]);
+			cb->setViewport(0.0f, 0.0f, (float)width, (float)height, 0.0f, 1.0f);
+			cb->setScissor(0, 0, width, height);
+			cb->beginScope("Scene");
+			drawWater(cb, bufferIndex);
+			drawDebugDisplays(cb, bufferIndex);
+			cb->endScope();
+			cb->beginScope("UI overlay");
+			drawUI(cb->handle, bufferIndex);
+			cb->endScope();
+			cb->endRenderPass();
+		} else {
+			// The scene and the UI overlay share a render pass, so they are profiled within it
+			cb->beginRenderPass(renderPass, frameBuffers[bufferIndex]);
+			cb->setViewport(0.0f, 0.0f, (float)width, (float)height, 0.0f, 1.0f);
+			cb->setScissor(0, 0, width, height);
+			cb->beginScope("Scene");
+			drawDisplay(cb, bufferIndex);
+			cb->endScope();
+			cb->beginScope("UI overlay");
+			drawUI(cb->handle, bufferIndex);
+			cb->endScope();
+			cb->endRenderPass();
+		}
+
+		/*
+			Visible depth range for the next frames' cascade splits
+		*/
+		reduceDepth(cb, bufferIndex);
+
+		cb->end();
+	}
+
+	void buildCommandBuffers()
+	{
+		CPU_PROFILE_SCOPE("Build command buffers");
+		// With dynamic command buffers the current frame's command buffer is recorded in draw(), so toggles don't require a rebuild
+		if (settings.dynamicCommandBuffers) {
+			return;
+		}
+
+		// Command buffers may still be in use by frames in flight
+		VK_CHECK_RESULT(vkDeviceWaitIdle(device));
+
+		terrainCulling.recordedVersions.assign(commandBuffers.size(), terrainCulling.version);
+
+		if (multiThreading.enabled) {
+			for (uint32_t i = 0; i < commandBuffers.size(); i++) {
+				recordSecondaryCommandBuffers(i);
+			}
+			multiThreading.threadPool.wait();
+			for (uint32_t i = 0; i < commandBuffers.size(); i++) {
+				executeSecondaryCommandBuffers(commandBuffers[i], i);
+			}
+			return;
+		}
+
+		for (uint32_t i = 0; i < commandBuffers.size(); i++) {
+			recordCommandBuffer(commandBuffers[i], i);
+		}
+	}
+
+	void buildCommandBuffer(uint32_t bufferIndex)
+	{
+		CPU_PROFILE_SCOPE("Build command buffer");
+		if (settings.dynamicCommandBuffers) {
+			return;
+		}
+
+		terrainCulling.recordedVersions[bufferIndex] = terrainCulling.version;
+
+		// The image's fence has been waited on by prepareFrame, so other frames in flight can keep running
+		if (multiThreading.enabled) {
+			recordSecondaryCommandBuffers(bufferIndex);
+			multiThreading.threadPool.wait();
+			executeSecondaryCommandBuffers(commandBuffers[bufferIndex], bufferIndex);
+			return;
+		}
+
+		recordCommandBuffer(commandBuffers[bufferIndex], bufferIndex);
+	}
+
+	void loadAssets()
+	{
+		CPU_PROFILE_SCOPE("Load assets");
+		// The scene's pipelines don't use the models' per node uniform buffers, so no descriptors are created for them
+		models.skysphere.nodeDescriptors = false;
+		models.plane.nodeDescriptors = false;
+		models.testscene.nodeDescriptors = false;
+		models.skysphere.loadFromFile(getAssetPath() + "scenes/geosphere.gltf", vulkanDevice, queue);
+		models.plane.loadFromFile(getAssetPath() + "scenes/plane.gltf", vulkanDevice, queue);
+		models.testscene.loadFromFile(getAssetPath() + "scenes/testscene.gltf", vulkanDevice, queue);
+				
+		textures.skySphere.loadFromFile(getAssetPath() + "textures/skysphere_02.ktx", VK_FORMAT_R8G8B8A8_UNORM, vulkanDevice, queue);
+		textures.terrainArray.loadFromFile(getAssetPath() + "textures/terrain_layers_01_rgba.ktx", VK_FORMAT_R8G8B8A8_UNORM, vulkanDevice, queue);
+		textures.heightMap.loadFromFile(getAssetPath() + "heightmap.ktx", VK_FORMAT_R16_UNORM, vulkanDevice, queue);
+		textures.waterNormalMap.loadFromFile(getAssetPath() + "textures/water_normal_rgba.ktx", VK_FORMAT_R8G8B8A8_UNORM, vulkanDevice, queue);
 
 		VkSamplerCreateInfo samplerInfo = vks::initializers::samplerCreateInfo();
 
@@ -823,28 +2009,28 @@ public:
 	// Generate a terrain quad patch for feeding to the tessellation control shader
 	void generateTerrain()
 	{
-		const glm::vec3 scale = glm::vec3(0.15f * 0.25f, 1.0f, 0.15f * 0.25f);
-		const uint32_t patchSize = 256;
-		heightMap = new vks::HeightMap(vulkanDevice, queue);
+		CPU_PROFILE_SCOPE("Generate terrain");
 #if defined(__ANDROID__)
-		heightMap->loadFromFile(getAssetPath() + "heightmap.ktx", patchSize, androidApp->activity->assetManager, scale, vks::HeightMap::topologyTriangles);
+		heightMap->loadFromFile(getAssetPath() + "heightmap.ktx", terrainPatchSize, androidApp->activity->assetManager, terrainScale, vks::HeightMap::topologyTriangles, terrainVertexFormat);
 #else
-		heightMap->loadFromFile(getAssetPath() + "heightmap.ktx", patchSize, scale, vks::HeightMap::topologyTriangles);
+		heightMap->loadFromFile(getAssetPath() + "heightmap.ktx", terrainPatchSize, terrainScale, vks::HeightMap::topologyTriangles, terrainVertexFormat);
 #endif
 	}
 
-	void setupDescriptorPool()
+	void setupDescriptorCache()
 	{
-		// @todo: proper sizes
-		descriptorPool = new DescriptorPool(device);
-		descriptorPool->setMaxSets(16);
-		descriptorPool->addPoolSize(VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER, 32);
-		descriptorPool->addPoolSize(VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER, 32);
-		descriptorPool->create();
+		CPU_PROFILE_SCOPE("Setup descriptor cache");
+		// Sizes of each pool in the cache's chain, another pool is added once one of them is exhausted
+		descriptorCache = new DescriptorCache(device);
+		descriptorCache->setMaxSetsPerPool(32);
+		descriptorCache->addPoolSize(VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER, 64);
+		descriptorCache->addPoolSize(VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER, 128);
+		descriptorCache->addPoolSize(VK_DESCRIPTOR_TYPE_STORAGE_BUFFER, 16);
 	}
 
 	void setupDescriptorSetLayout()
 	{
+		CPU_PROFILE_SCOPE("Setup descriptor set layouts");
 		// Shared (use all layout bindings)
 		descriptorSetLayouts.textured = new DescriptorSetLayout(device);
 		descriptorSetLayouts.textured->addBinding(0, VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER, VK_SHADER_STAGE_VERTEX_BIT | VK_SHADER_STAGE_FRAGMENT_BIT);
@@ -853,6 +2039,7 @@ public:
 		descriptorSetLayouts.textured->addBinding(3, VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER, VK_SHADER_STAGE_FRAGMENT_BIT);
 		descriptorSetLayouts.textured->addBinding(4, VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER, VK_SHADER_STAGE_FRAGMENT_BIT);
 		descriptorSetLayouts.textured->addBinding(5, VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER, VK_SHADER_STAGE_FRAGMENT_BIT);
+		descriptorSetLayouts.textured->addBinding(6, VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER, VK_SHADER_STAGE_FRAGMENT_BIT);
 		descriptorSetLayouts.textured->create();
 
 		pipelineLayouts.textured = new PipelineLayout(device);
@@ -900,6 +2087,17 @@ public:
 		depthPass.pipelineLayout->addPushConstantRange(sizeof(CascadePushConstBlock), 0, VK_SHADER_STAGE_VERTEX_BIT);
 		depthPass.pipelineLayout->create();
 
+		// Depth reduction
+		depthReduction.descriptorSetLayout = new DescriptorSetLayout(device);
+		depthReduction.descriptorSetLayout->addBinding(0, VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER, VK_SHADER_STAGE_COMPUTE_BIT);
+		depthReduction.descriptorSetLayout->addBinding(1, VK_DESCRIPTOR_TYPE_STORAGE_BUFFER, VK_SHADER_STAGE_COMPUTE_BIT);
+		depthReduction.descriptorSetLayout->create();
+
+		depthReduction.pipelineLayout = new PipelineLayout(device);
+		depthReduction.pipelineLayout->addLayout(depthReduction.descriptorSetLayout);
+		depthReduction.pipelineLayout->addPushConstantRange(sizeof(glm::mat4), 0, VK_SHADER_STAGE_COMPUTE_BIT);
+		depthReduction.pipelineLayout->create();
+
 		// Cascade debug
 		cascadeDebug.descriptorSetLayout = new DescriptorSetLayout(device);
 		cascadeDebug.descriptorSetLayout->addBinding(0, VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER, VK_SHADER_STAGE_FRAGMENT_BIT);
@@ -910,73 +2108,211 @@ public:
 		cascadeDebug.pipelineLayout->addPushConstantRange(sizeof(glm::vec4) + sizeof(uint32_t), 0, VK_SHADER_STAGE_VERTEX_BIT);
 		cascadeDebug.pipelineLayout->create();
 
+		// Bindless
+		if (bindless.supported) {
+			bindless.uniformSetLayout = new DescriptorSetLayout(device);
+			bindless.uniformSetLayout->addBinding(0, VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER, VK_SHADER_STAGE_VERTEX_BIT | VK_SHADER_STAGE_FRAGMENT_BIT);
+			bindless.uniformSetLayout->addBinding(1, VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER, VK_SHADER_STAGE_FRAGMENT_BIT);
+			bindless.uniformSetLayout->create();
+
+			// The textures are only loaded later on, so the array's binding is variable sized
+			bindless.maxTextureCount = std::min(bindless.maxTextureCount, std::min(deviceProperties.limits.maxPerStageDescriptorSamplers, deviceProperties.limits.maxPerStageDescriptorSampledImages));
+			bindless.textureSetLayout = new DescriptorSetLayout(device);
+			bindless.textureSetLayout->addBinding(0, VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER, VK_SHADER_STAGE_FRAGMENT_BIT, bindless.maxTextureCount, VK_DESCRIPTOR_BINDING_VARIABLE_DESCRIPTOR_COUNT_BIT_EXT);
+			bindless.textureSetLayout->create();
+
+			bindless.pipelineLayout = new PipelineLayout(device);
+			bindless.pipelineLayout->addLayout(bindless.uniformSetLayout);
+			bindless.pipelineLayout->addLayout(bindless.textureSetLayout);
+			bindless.pipelineLayout->addPushConstantRange(sizeof(BindlessPushConstBlock), 0, VK_SHADER_STAGE_VERTEX_BIT | VK_SHADER_STAGE_FRAGMENT_BIT);
+			bindless.pipelineLayout->create();
+		}
 	}
 
-	void setupDescriptorSet()
+	// Adds a texture to the global array of the bindless path and returns its index
+	uint32_t addBindlessTexture(const VkDescriptorImageInfo& descriptor)
+	{
+		bindless.textures.push_back(descriptor);
+		return static_cast<uint32_t>(bindless.textures.size() - 1);
+	}
+
+	// Sets for each swap chain image's uniform buffers, only the sets of images added since the last call are created
+	void setupImageDescriptorSets()
 	{
 		VkDescriptorImageInfo depthMapDescriptor = vks::initializers::descriptorImageInfo(depth.sampler, depth.view->handle, VK_IMAGE_LAYOUT_DEPTH_STENCIL_READ_ONLY_OPTIMAL);
 
-		// Water plane
-		descriptorSets.waterplane = new DescriptorSet(device);
-		descriptorSets.waterplane->setPool(descriptorPool);
-		descriptorSets.waterplane->addLayout(descriptorSetLayouts.textured);
-		descriptorSets.waterplane->addDescriptor(0, VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER, &uniformBuffers.vsMirror.descriptor);
-		descriptorSets.waterplane->addDescriptor(1, VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER, &offscreenPass.refraction.descriptor);
-		descriptorSets.waterplane->addDescriptor(2, VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER, &offscreenPass.reflection.descriptor);
-		descriptorSets.waterplane->addDescriptor(3, VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER, &textures.waterNormalMap.descriptor);
-		descriptorSets.waterplane->addDescriptor(4, VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER, &depthMapDescriptor);
-		descriptorSets.waterplane->addDescriptor(5, VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER, &uniformBuffers.CSM.descriptor);
-		descriptorSets.waterplane->create();
-			   			   		
-		// Debug quad
-		descriptorSets.debugquad = new DescriptorSet(device);
-		descriptorSets.debugquad->setPool(descriptorPool);
-		descriptorSets.debugquad->addLayout(descriptorSetLayouts.textured);
-		descriptorSets.debugquad->addDescriptor(1, VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER, &offscreenPass.reflection.descriptor);
-		descriptorSets.debugquad->addDescriptor(2, VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER, &offscreenPass.refraction.descriptor);
-		descriptorSets.debugquad->create();
+		const size_t firstImage = descriptorSets.size();
+		descriptorSets.resize(uniformBuffers.size());
+		for (size_t i = firstImage; i < descriptorSets.size(); i++) {
+			DescriptorSets& sets = descriptorSets[i];
+			UniformBuffers& buffers = uniformBuffers[i];
+
+			// Water plane
+			sets.waterplane = new DescriptorSet(device);
+			sets.waterplane->setCache(descriptorCache);
+			sets.waterplane->addLayout(descriptorSetLayouts.textured);
+			sets.waterplane->addDescriptor(0, VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER, &buffers.vsMirror.descriptor);
+			sets.waterplane->addDescriptor(1, VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER, &offscreenPass.refraction.descriptor);
+			sets.waterplane->addDescriptor(2, VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER, &offscreenPass.reflection.descriptor);
+			sets.waterplane->addDescriptor(3, VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER, &textures.waterNormalMap.descriptor);
+			sets.waterplane->addDescriptor(4, VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER, &depthMapDescriptor);
+			sets.waterplane->addDescriptor(5, VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER, &buffers.CSM.descriptor);
+			sets.waterplane->create();
+
+			// Water plane sampling the refraction from the scene copy
+			if (sceneCopyRefraction.supported) {
+				sets.waterplaneSceneCopy = new DescriptorSet(device);
+				sets.waterplaneSceneCopy->setCache(descriptorCache);
+				sets.waterplaneSceneCopy->addLayout(descriptorSetLayouts.textured);
+				sets.waterplaneSceneCopy->addDescriptor(0, VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER, &buffers.vsMirror.descriptor);
+				sets.waterplaneSceneCopy->addDescriptor(1, VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER, &sceneCopyRefraction.colorDescriptor);
+				sets.waterplaneSceneCopy->addDescriptor(2, VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER, &offscreenPass.reflection.descriptor);
+				sets.waterplaneSceneCopy->addDescriptor(3, VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER, &textures.waterNormalMap.descriptor);
+				sets.waterplaneSceneCopy->addDescriptor(4, VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER, &depthMapDescriptor);
+				sets.waterplaneSceneCopy->addDescriptor(5, VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER, &buffers.CSM.descriptor);
+				sets.waterplaneSceneCopy->addDescriptor(6, VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER, &sceneCopyRefraction.depthDescriptor);
+				sets.waterplaneSceneCopy->create();
+			}
 
-		// Terrain
-		descriptorSets.terrain = new DescriptorSet(device);
-		descriptorSets.terrain->setPool(descriptorPool);
-		descriptorSets.terrain->addLayout(descriptorSetLayouts.terrain);
-		descriptorSets.terrain->addDescriptor(0, VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER, &uniformBuffers.terrain.descriptor);
-		descriptorSets.terrain->addDescriptor(1, VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER, &textures.heightMap.descriptor);
-		descriptorSets.terrain->addDescriptor(2, VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER, &textures.terrainArray.descriptor);
-		descriptorSets.terrain->addDescriptor(3, VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER, &depthMapDescriptor);
-		descriptorSets.terrain->addDescriptor(4, VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER, &uniformBuffers.CSM.descriptor);
-		descriptorSets.terrain->create();
+			// Debug quad
+			sets.debugquad = new DescriptorSet(device);
+			sets.debugquad->setCache(descriptorCache);
+			sets.debugquad->addLayout(descriptorSetLayouts.textured);
+			sets.debugquad->addDescriptor(1, VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER, &offscreenPass.reflection.descriptor);
+			sets.debugquad->addDescriptor(2, VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER, &offscreenPass.refraction.descriptor);
+			sets.debugquad->create();
+
+			// Terrain
+			sets.terrain = new DescriptorSet(device);
+			sets.terrain->setCache(descriptorCache);
+			sets.terrain->addLayout(descriptorSetLayouts.terrain);
+			sets.terrain->addDescriptor(0, VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER, &buffers.terrain.descriptor);
+			sets.terrain->addDescriptor(1, VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER, &textures.heightMap.descriptor);
+			sets.terrain->addDescriptor(2, VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER, &textures.terrainArray.descriptor);
+			sets.terrain->addDescriptor(3, VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER, &depthMapDescriptor);
+			sets.terrain->addDescriptor(4, VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER, &buffers.CSM.descriptor);
+			sets.terrain->create();
+
+			// Skysphere
+			sets.skysphere = new DescriptorSet(device);
+			sets.skysphere->setCache(descriptorCache);
+			sets.skysphere->addLayout(descriptorSetLayouts.skysphere);
+			sets.skysphere->addDescriptor(0, VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER, &buffers.sky.descriptor);
+			sets.skysphere->addDescriptor(1, VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER, &textures.skySphere.descriptor);
+			sets.skysphere->create();
+
+			// Bindless
+			if (bindless.supported) {
+				sets.bindlessWaterplane = new DescriptorSet(device);
+				sets.bindlessWaterplane->setCache(descriptorCache);
+				sets.bindlessWaterplane->addLayout(bindless.uniformSetLayout);
+				sets.bindlessWaterplane->addDescriptor(0, VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER, &buffers.vsMirror.descriptor);
+				sets.bindlessWaterplane->addDescriptor(1, VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER, &buffers.CSM.descriptor);
+				sets.bindlessWaterplane->create();
+
+				sets.bindlessTerrain = new DescriptorSet(device);
+				sets.bindlessTerrain->setCache(descriptorCache);
+				sets.bindlessTerrain->addLayout(bindless.uniformSetLayout);
+				sets.bindlessTerrain->addDescriptor(0, VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER, &buffers.terrain.descriptor);
+				sets.bindlessTerrain->addDescriptor(1, VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER, &buffers.CSM.descriptor);
+				sets.bindlessTerrain->create();
+
+				// The skysphere doesn't use the cascades
+				sets.bindlessSkysphere = new DescriptorSet(device);
+				sets.bindlessSkysphere->setCache(descriptorCache);
+				sets.bindlessSkysphere->addLayout(bindless.uniformSetLayout);
+				sets.bindlessSkysphere->addDescriptor(0, VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER, &buffers.sky.descriptor);
+				sets.bindlessSkysphere->create();
+			}
+		}
 
-		// Skysphere
-		descriptorSets.skysphere = new DescriptorSet(device);
-		descriptorSets.skysphere->setPool(descriptorPool);
-		descriptorSets.skysphere->addLayout(descriptorSetLayouts.skysphere);
-		descriptorSets.skysphere->addDescriptor(0, VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER, &uniformBuffers.sky.descriptor);
-		descriptorSets.skysphere->addDescriptor(1, VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER, &textures.skySphere.descriptor);
-		descriptorSets.skysphere->create();
+		// Depth pass
+		depthPass.descriptorSets.resize(depthPass.uniformBuffers.size());
+		for (size_t i = firstImage; i < depthPass.descriptorSets.size(); i++) {
+			depthPass.descriptorSets[i] = new DescriptorSet(device);
+			depthPass.descriptorSets[i]->setCache(descriptorCache);
+			depthPass.descriptorSets[i]->addLayout(depthPass.descriptorSetLayout);
+			depthPass.descriptorSets[i]->addDescriptor(0, VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER, &depthPass.uniformBuffers[i].descriptor);
+			depthPass.descriptorSets[i]->create();
+		}
+
+		// Depth reduction
+		if (depthReduction.supported) {
+			VkDescriptorImageInfo sceneDepthDescriptor = vks::initializers::descriptorImageInfo(depthReduction.sampler, depthReduction.view, VK_IMAGE_LAYOUT_DEPTH_STENCIL_READ_ONLY_OPTIMAL);
+			depthReduction.descriptorSets.resize(depthReduction.buffers.size());
+			for (size_t i = firstImage; i < depthReduction.descriptorSets.size(); i++) {
+				depthReduction.descriptorSets[i] = new DescriptorSet(device);
+				depthReduction.descriptorSets[i]->setCache(descriptorCache);
+				depthReduction.descriptorSets[i]->addLayout(depthReduction.descriptorSetLayout);
+				depthReduction.descriptorSets[i]->addDescriptor(0, VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER, &sceneDepthDescriptor);
+				depthReduction.descriptorSets[i]->addDescriptor(1, VK_DESCRIPTOR_TYPE_STORAGE_BUFFER, &depthReduction.buffers[i].descriptor);
+				depthReduction.descriptorSets[i]->create();
+			}
+		}
+	}
+
+	void setupDescriptorSet()
+	{
+		CPU_PROFILE_SCOPE("Setup descriptor sets");
+		VkDescriptorImageInfo depthMapDescriptor = vks::initializers::descriptorImageInfo(depth.sampler, depth.view->handle, VK_IMAGE_LAYOUT_DEPTH_STENCIL_READ_ONLY_OPTIMAL);
+
+		// The scene depth sampled by the depth reduction
+		if (depthReduction.supported) {
+			VkSamplerCreateInfo samplerCI = vks::initializers::samplerCreateInfo();
+			samplerCI.magFilter = VK_FILTER_NEAREST;
+			samplerCI.minFilter = VK_FILTER_NEAREST;
+			samplerCI.mipmapMode = VK_SAMPLER_MIPMAP_MODE_NEAREST;
+			samplerCI.addressModeU = VK_SAMPLER_ADDRESS_MODE_CLAMP_TO_EDGE;
+			samplerCI.addressModeV = samplerCI.addressModeU;
+			samplerCI.addressModeW = samplerCI.addressModeU;
+			samplerCI.maxAnisotropy = 1.0f;
+			VK_CHECK_RESULT(vkCreateSampler(device, &samplerCI, nullptr, &depthReduction.sampler));
+			createDepthReductionView();
+		}
+
+		setupImageDescriptorSets();
+
+		// Global texture array of the bindless path
+		// None of the textures are recreated on resize, so the array is only written once
+		if (bindless.supported) {
+			bindless.textureIndices.heightMap = addBindlessTexture(textures.heightMap.descriptor);
+			bindless.textureIndices.terrainLayers = addBindlessTexture(textures.terrainArray.descriptor);
+			bindless.textureIndices.shadowMap = addBindlessTexture(depthMapDescriptor);
+			bindless.textureIndices.skySphere = addBindlessTexture(textures.skySphere.descriptor);
+			bindless.textureIndices.waterNormalMap = addBindlessTexture(textures.waterNormalMap.descriptor);
+			bindless.textureIndices.refraction = addBindlessTexture(offscreenPass.refraction.descriptor);
+			bindless.textureIndices.reflection = addBindlessTexture(offscreenPass.reflection.descriptor);
+			const uint32_t textureCount = static_cast<uint32_t>(bindless.textures.size());
+			assert(textureCount <= bindless.maxTextureCount);
+
+			bindless.descriptorPool = new DescriptorPool(device);
+			bindless.descriptorPool->setMaxSets(1);
+			bindless.descriptorPool->addPoolSize(VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER, textureCount);
+			bindless.descriptorPool->create();
+
+			bindless.textureSet = new DescriptorSet(device);
+			bindless.textureSet->setPool(bindless.descriptorPool);
+			bindless.textureSet->addLayout(bindless.textureSetLayout);
+			bindless.textureSet->addDescriptor(0, VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER, bindless.textures.data(), textureCount);
+			bindless.textureSet->setVariableDescriptorCount(textureCount);
+			bindless.textureSet->create();
+		}
 
 		// Shadow map cascades (one set per cascade)
-		// @todo: Doesn't make sense, all refer to same depth
+		// All cascades refer to the same depth, so the cache returns the same set for each of them
 		for (auto i = 0; i < cascades.size(); i++) {
 			VkDescriptorImageInfo cascadeImageInfo = vks::initializers::descriptorImageInfo(depth.sampler, depth.view->handle, VK_IMAGE_LAYOUT_DEPTH_STENCIL_READ_ONLY_OPTIMAL);
 			cascades[i].descriptorSet = new DescriptorSet(device);
-			cascades[i].descriptorSet->setPool(descriptorPool);
+			cascades[i].descriptorSet->setCache(descriptorCache);
 			cascades[i].descriptorSet->addLayout(descriptorSetLayouts.textured);
-			cascades[i].descriptorSet->addDescriptor(0, VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER, &depthPass.uniformBuffer.descriptor);
+			cascades[i].descriptorSet->addDescriptor(0, VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER, &depthPass.uniformBuffers[0].descriptor);
 			cascades[i].descriptorSet->addDescriptor(1, VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER, &cascadeImageInfo);
 			cascades[i].descriptorSet->create();
 		}
 
-		// Depth pass
-		depthPass.descriptorSet = new DescriptorSet(device);
-		depthPass.descriptorSet->setPool(descriptorPool);
-		depthPass.descriptorSet->addLayout(depthPass.descriptorSetLayout);
-		depthPass.descriptorSet->addDescriptor(0, VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER, &depthPass.uniformBuffer.descriptor);
-		depthPass.descriptorSet->create();
-
 		// Cascade debug
 		cascadeDebug.descriptorSet = new DescriptorSet(device);
-		cascadeDebug.descriptorSet->setPool(descriptorPool);
+		cascadeDebug.descriptorSet->setCache(descriptorCache);
 		cascadeDebug.descriptorSet->addLayout(cascadeDebug.descriptorSetLayout);
 		cascadeDebug.descriptorSet->addDescriptor(0, VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER, &depthMapDescriptor);
 		cascadeDebug.descriptorSet->create();
@@ -984,6 +2320,12 @@ public:
 
 	void preparePipelines()
 	{
+		CPU_PROFILE_SCOPE("Prepare pipelines");
+		// One thread per core, except for the one loading the assets in the meantime
+		pipelineThreadPool.setThreadCount(std::max(std::thread::hardware_concurrency(), 2u) - 1);
+		// Graphics pipelines are created with one call per batch, the batches are created concurrently
+		std::vector<Pipeline*> scenePipelines;
+		std::vector<Pipeline*> shadowPipelines;
 		VkPipelineInputAssemblyStateCreateInfo inputAssemblyState = vks::initializers::pipelineInputAssemblyStateCreateInfo(VK_PRIMITIVE_TOPOLOGY_TRIANGLE_LIST, 0, VK_FALSE);
 		VkPipelineRasterizationStateCreateInfo rasterizationState = vks::initializers::pipelineRasterizationStateCreateInfo(VK_POLYGON_MODE_FILL, VK_CULL_MODE_FRONT_BIT, VK_FRONT_FACE_CLOCKWISE, 0);
 		VkPipelineColorBlendAttachmentState blendAttachmentState = vks::initializers::pipelineColorBlendAttachmentState(0xf, VK_FALSE);
@@ -1031,7 +2373,7 @@ public:
 		pipelines.debug->setRenderPass(renderPass);
 		pipelines.debug->addShader(getAssetPath() + "shaders/quad.vert.spv");
 		pipelines.debug->addShader(getAssetPath() + "shaders/quad.frag.spv");
-		pipelines.debug->create();
+		scenePipelines.push_back(pipelines.debug);
 		// Debug cascades
 		cascadeDebug.pipeline = new Pipeline(device);
 		cascadeDebug.pipeline->setCreateInfo(pipelineCI);
@@ -1040,7 +2382,7 @@ public:
 		cascadeDebug.pipeline->setRenderPass(renderPass);
 		cascadeDebug.pipeline->addShader(getAssetPath() + "shaders/debug_csm.vert.spv");
 		cascadeDebug.pipeline->addShader(getAssetPath() + "shaders/debug_csm.frag.spv");
-		cascadeDebug.pipeline->create();
+		scenePipelines.push_back(cascadeDebug.pipeline);
 
 		depthStencilState.depthTestEnable = VK_TRUE;
 
@@ -1053,17 +2395,74 @@ public:
 		pipelines.mirror->setRenderPass(renderPass);
 		pipelines.mirror->addShader(getAssetPath() + "shaders/mirror.vert.spv");
 		pipelines.mirror->addShader(getAssetPath() + "shaders/mirror.frag.spv");
-		pipelines.mirror->create();
+		scenePipelines.push_back(pipelines.mirror);
+		if (bindless.enabled) {
+			bindless.pipelines.mirror = new Pipeline(device);
+			bindless.pipelines.mirror->setCreateInfo(pipelineCI);
+			bindless.pipelines.mirror->setCache(pipelineCache);
+			bindless.pipelines.mirror->setLayout(bindless.pipelineLayout);
+			bindless.pipelines.mirror->setRenderPass(renderPass);
+			bindless.pipelines.mirror->addShader(getAssetPath() + "shaders/mirror.vert.spv");
+			bindless.pipelines.mirror->addShader(getAssetPath() + "shaders/mirror_bindless.frag.spv");
+			scenePipelines.push_back(bindless.pipelines.mirror);
+		}
+		// Only compiled at startup if selected, otherwise once enabled from the UI
+		if (sceneCopyRefraction.supported) {
+			sceneCopyRefraction.pipeline = new Pipeline(device);
+			sceneCopyRefraction.pipeline->setCreateInfo(pipelineCI);
+			sceneCopyRefraction.pipeline->setCache(pipelineCache);
+			sceneCopyRefraction.pipeline->setLayout(pipelineLayouts.textured);
+			sceneCopyRefraction.pipeline->setRenderPass(sceneCopyRefraction.waterRenderPass);
+			sceneCopyRefraction.pipeline->addShader(getAssetPath() + "shaders/mirror.vert.spv");
+			sceneCopyRefraction.pipeline->addShader(getAssetPath() + "shaders/mirror_scenecopy.frag.spv");
+			if (sceneCopyRefraction.enabled) {
+				scenePipelines.push_back(sceneCopyRefraction.pipeline);
+			}
+		}
+
+		// The terrain pipelines use the height map's vertex layout
+		const bool compactTerrain = (terrainVertexFormat == vks::HeightMap::vertexFormatCompact);
+		const std::vector<VkVertexInputBindingDescription> terrainVertexInputBindings = vks::HeightMap::getVertexInputBindings(terrainVertexFormat);
+		const std::vector<VkVertexInputAttributeDescription> terrainVertexInputAttributes = vks::HeightMap::getVertexInputAttributes(terrainVertexFormat);
+		VkPipelineVertexInputStateCreateInfo terrainVertexInputState = vks::initializers::pipelineVertexInputStateCreateInfo();
+		terrainVertexInputState.vertexBindingDescriptionCount = static_cast<uint32_t>(terrainVertexInputBindings.size());
+		terrainVertexInputState.pVertexBindingDescriptions = terrainVertexInputBindings.data();
+		terrainVertexInputState.vertexAttributeDescriptionCount = static_cast<uint32_t>(terrainVertexInputAttributes.size());
+		terrainVertexInputState.pVertexAttributeDescriptions = terrainVertexInputAttributes.data();
+		const std::vector<VkSpecializationMapEntry> terrainSpecializationEntries = vks::HeightMap::getCompactVertexSpecializationEntries();
+		const vks::HeightMap::CompactVertexParameters terrainParameters = heightMap->getCompactVertexParameters(terrainPatchSize, terrainScale);
 
 		// Terrain
+		pipelineCI.pVertexInputState = &terrainVertexInputState;
 		pipelines.terrain = new Pipeline(device);
 		pipelines.terrain->setCreateInfo(pipelineCI);
 		pipelines.terrain->setCache(pipelineCache);
 		pipelines.terrain->setLayout(pipelineLayouts.terrain);
 		pipelines.terrain->setRenderPass(renderPass);
-		pipelines.terrain->addShader(getAssetPath() + "shaders/terrain.vert.spv");
+		if (compactTerrain) {
+			pipelines.terrain->setSpecializationConstants(terrainSpecializationEntries, &terrainParameters, sizeof(terrainParameters));
+			pipelines.terrain->addShader(getAssetPath() + "shaders/terrain_compact.vert.spv");
+		} else {
+			pipelines.terrain->addShader(getAssetPath() + "shaders/terrain.vert.spv");
+		}
 		pipelines.terrain->addShader(getAssetPath() + "shaders/terrain.frag.spv");
-		pipelines.terrain->create();
+		scenePipelines.push_back(pipelines.terrain);
+		if (bindless.enabled) {
+			bindless.pipelines.terrain = new Pipeline(device);
+			bindless.pipelines.terrain->setCreateInfo(pipelineCI);
+			bindless.pipelines.terrain->setCache(pipelineCache);
+			bindless.pipelines.terrain->setLayout(bindless.pipelineLayout);
+			bindless.pipelines.terrain->setRenderPass(renderPass);
+			if (compactTerrain) {
+				bindless.pipelines.terrain->setSpecializationConstants(terrainSpecializationEntries, &terrainParameters, sizeof(terrainParameters));
+				bindless.pipelines.terrain->addShader(getAssetPath() + "shaders/terrain_compact.vert.spv");
+			} else {
+				bindless.pipelines.terrain->addShader(getAssetPath() + "shaders/terrain.vert.spv");
+			}
+			bindless.pipelines.terrain->addShader(getAssetPath() + "shaders/terrain_bindless.frag.spv");
+			scenePipelines.push_back(bindless.pipelines.terrain);
+		}
+		pipelineCI.pVertexInputState = &vertexInputState;
 
 		// Sky
 		rasterizationState.cullMode = VK_CULL_MODE_NONE;
@@ -1075,7 +2474,17 @@ public:
 		pipelines.sky->setRenderPass(renderPass);
 		pipelines.sky->addShader(getAssetPath() + "shaders/skysphere.vert.spv");
 		pipelines.sky->addShader(getAssetPath() + "shaders/skysphere.frag.spv");
-		pipelines.sky->create();
+		scenePipelines.push_back(pipelines.sky);
+		if (bindless.enabled) {
+			bindless.pipelines.sky = new Pipeline(device);
+			bindless.pipelines.sky->setCreateInfo(pipelineCI);
+			bindless.pipelines.sky->setCache(pipelineCache);
+			bindless.pipelines.sky->setLayout(bindless.pipelineLayout);
+			bindless.pipelines.sky->setRenderPass(renderPass);
+			bindless.pipelines.sky->addShader(getAssetPath() + "shaders/skysphere.vert.spv");
+			bindless.pipelines.sky->addShader(getAssetPath() + "shaders/skysphere_bindless.frag.spv");
+			scenePipelines.push_back(bindless.pipelines.sky);
+		}
 
 		depthStencilState.depthWriteEnable = VK_TRUE;
 
@@ -1084,50 +2493,138 @@ public:
 		depthStencilState.depthCompareOp = VK_COMPARE_OP_LESS_OR_EQUAL;
 		// Enable depth clamp (if available)
 		rasterizationState.depthClampEnable = deviceFeatures.depthClamp;
+		pipelineCI.pVertexInputState = &terrainVertexInputState;
 		pipelines.depthpass = new Pipeline(device);
 		pipelines.depthpass->setCreateInfo(pipelineCI);
 		pipelines.depthpass->setCache(pipelineCache);
 		pipelines.depthpass->setLayout(depthPass.pipelineLayout);
 		pipelines.depthpass->setRenderPass(depthPass.renderPass);
-		pipelines.depthpass->addShader(getAssetPath() + "shaders/depthpass.vert.spv");
+		if (compactTerrain) {
+			pipelines.depthpass->setSpecializationConstants(terrainSpecializationEntries, &terrainParameters, sizeof(terrainParameters));
+			pipelines.depthpass->addShader(getAssetPath() + "shaders/depthpass_compact.vert.spv");
+		} else {
+			pipelines.depthpass->addShader(getAssetPath() + "shaders/depthpass.vert.spv");
+		}
 		pipelines.depthpass->addShader(getAssetPath() + "shaders/terrain_depthpass.frag.spv");
-		pipelines.depthpass->create();
+		shadowPipelines.push_back(pipelines.depthpass);
+
+		// Depth reduction, only compiled at startup if selected, otherwise once enabled from the UI
+		if (depthReduction.supported) {
+			depthReduction.pipeline = new Pipeline(device);
+			depthReduction.pipeline->setCache(pipelineCache);
+			depthReduction.pipeline->setLayout(depthReduction.pipelineLayout);
+			depthReduction.pipeline->addShader(getAssetPath() + "shaders/depthreduction.comp.spv");
+			if (depthReduction.enabled) {
+				depthReduction.pipeline->createAsync(pipelineThreadPool);
+			}
+		}
+
+		// Shadow map depth pass for all cascades at once
+		if (cascadeMultiview.supported) {
+			cascadeMultiview.pipeline = new Pipeline(device);
+			cascadeMultiview.pipeline->setCreateInfo(pipelineCI);
+			cascadeMultiview.pipeline->setCache(pipelineCache);
+			cascadeMultiview.pipeline->setLayout(depthPass.pipelineLayout);
+			cascadeMultiview.pipeline->setRenderPass(cascadeMultiview.renderPass);
+			if (compactTerrain) {
+				cascadeMultiview.pipeline->setSpecializationConstants(terrainSpecializationEntries, &terrainParameters, sizeof(terrainParameters));
+				cascadeMultiview.pipeline->addShader(getAssetPath() + "shaders/depthpass_compact_multiview.vert.spv");
+			} else {
+				cascadeMultiview.pipeline->addShader(getAssetPath() + "shaders/depthpass_multiview.vert.spv");
+			}
+			cascadeMultiview.pipeline->addShader(getAssetPath() + "shaders/terrain_depthpass.frag.spv");
+			shadowPipelines.push_back(cascadeMultiview.pipeline);
+		}
+
+		Pipeline::createBatchAsync(scenePipelines, pipelineThreadPool);
+		Pipeline::createBatchAsync(shadowPipelines, pipelineThreadPool);
+	}
+
+	// Pipelines of features that can be toggled from the UI are set up at startup, but only compiled once the feature is first enabled
+	void createPipelineOnDemand(Pipeline* pipeline)
+	{
+		if (pipeline->getHandle() == VK_NULL_HANDLE) {
+			pipeline->create();
+		}
+	}
+
+	void waitForPipelines()
+	{
+		CPU_PROFILE_SCOPE("Wait for pipelines");
+		for (auto& pipeline : { pipelines.debug, pipelines.mirror, pipelines.terrain, pipelines.sky, pipelines.depthpass, cascadeDebug.pipeline }) {
+			pipeline->wait();
+		}
+		if (cascadeMultiview.supported) {
+			cascadeMultiview.pipeline->wait();
+		}
+		if (depthReduction.pipeline) {
+			depthReduction.pipeline->wait();
+		}
+		if (sceneCopyRefraction.pipeline) {
+			sceneCopyRefraction.pipeline->wait();
+		}
+		if (bindless.enabled) {
+			for (auto& pipeline : { bindless.pipelines.mirror, bindless.pipelines.terrain, bindless.pipelines.sky }) {
+				pipeline->wait();
+			}
+		}
+		// All pipelines have been created, so the threads are no longer needed
+		pipelineThreadPool.setThreadCount(0);
 	}
 
 	// Prepare and initialize uniform buffer containing shader uniforms
 	void prepareUniformBuffers()
-	{		
-		VK_CHECK_RESULT(vulkanDevice->createBuffer(VK_BUFFER_USAGE_UNIFORM_BUFFER_BIT, VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT, &uniformBuffers.vsShared, sizeof(uboShared)));
-		VK_CHECK_RESULT(vulkanDevice->createBuffer(VK_BUFFER_USAGE_UNIFORM_BUFFER_BIT, VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT, &uniformBuffers.vsMirror, sizeof(uboWaterPlane)));
-		VK_CHECK_RESULT(vulkanDevice->createBuffer(VK_BUFFER_USAGE_UNIFORM_BUFFER_BIT, VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT, &uniformBuffers.vsOffScreen, sizeof(uboShared)));
-		VK_CHECK_RESULT(vulkanDevice->createBuffer(VK_BUFFER_USAGE_UNIFORM_BUFFER_BIT, VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT, &uniformBuffers.vsDebugQuad, sizeof(uboShared)));
-		VK_CHECK_RESULT(vulkanDevice->createBuffer(VK_BUFFER_USAGE_UNIFORM_BUFFER_BIT, VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT, &uniformBuffers.terrain, sizeof(uboShared)));
-		VK_CHECK_RESULT(vulkanDevice->createBuffer(VK_BUFFER_USAGE_UNIFORM_BUFFER_BIT, VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT, &uniformBuffers.sky, sizeof(uboShared)));
-		VK_CHECK_RESULT(vulkanDevice->createBuffer(VK_BUFFER_USAGE_UNIFORM_BUFFER_BIT, VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT, &depthPass.uniformBuffer, sizeof(depthPass.ubo)));
-		VK_CHECK_RESULT(vulkanDevice->createBuffer(VK_BUFFER_USAGE_UNIFORM_BUFFER_BIT, VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT, &uniformBuffers.CSM, sizeof(uboCSM)));
-
-		// Map persistent
-		VK_CHECK_RESULT(uniformBuffers.vsShared.map());
-		VK_CHECK_RESULT(uniformBuffers.vsMirror.map());
-		VK_CHECK_RESULT(uniformBuffers.vsOffScreen.map());
-		VK_CHECK_RESULT(uniformBuffers.vsDebugQuad.map());
-		VK_CHECK_RESULT(uniformBuffers.terrain.map());
-		VK_CHECK_RESULT(uniformBuffers.sky.map());
-		VK_CHECK_RESULT(depthPass.uniformBuffer.map());
-		VK_CHECK_RESULT(uniformBuffers.CSM.map());
-
-		updateUniformBuffers();
-		updateUniformBufferOffscreen();
+	{
+		CPU_PROFILE_SCOPE("Prepare uniform buffers");
+		// Called again if the swap chain has more images after a resize, only the buffers of the added images are created
+		const size_t firstImage = uniformBuffers.size();
+		const size_t imageCount = std::max(firstImage, (size_t)swapChain.imageCount);
+		uniformBuffers.resize(imageCount);
+		depthPass.uniformBuffers.resize(imageCount);
+		for (size_t i = firstImage; i < uniformBuffers.size(); i++) {
+			UniformBuffers& buffers = uniformBuffers[i];
+			VK_CHECK_RESULT(vulkanDevice->createBuffer(VK_BUFFER_USAGE_UNIFORM_BUFFER_BIT, VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT, &buffers.vsShared, sizeof(uboShared)));
+			VK_CHECK_RESULT(vulkanDevice->createBuffer(VK_BUFFER_USAGE_UNIFORM_BUFFER_BIT, VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT, &buffers.vsMirror, sizeof(uboWaterPlane)));
+			VK_CHECK_RESULT(vulkanDevice->createBuffer(VK_BUFFER_USAGE_UNIFORM_BUFFER_BIT, VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT, &buffers.vsOffScreen, sizeof(uboShared)));
+			VK_CHECK_RESULT(vulkanDevice->createBuffer(VK_BUFFER_USAGE_UNIFORM_BUFFER_BIT, VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT, &buffers.vsDebugQuad, sizeof(uboShared)));
+			VK_CHECK_RESULT(vulkanDevice->createBuffer(VK_BUFFER_USAGE_UNIFORM_BUFFER_BIT, VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT, &buffers.terrain, sizeof(uboShared)));
+			VK_CHECK_RESULT(vulkanDevice->createBuffer(VK_BUFFER_USAGE_UNIFORM_BUFFER_BIT, VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT, &buffers.sky, sizeof(uboShared)));
+			VK_CHECK_RESULT(vulkanDevice->createBuffer(VK_BUFFER_USAGE_UNIFORM_BUFFER_BIT, VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT, &depthPass.uniformBuffers[i], sizeof(depthPass.ubo)));
+			VK_CHECK_RESULT(vulkanDevice->createBuffer(VK_BUFFER_USAGE_UNIFORM_BUFFER_BIT, VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT, &buffers.CSM, sizeof(uboCSM)));
+
+			// Map persistent
+			VK_CHECK_RESULT(buffers.vsShared.map());
+			VK_CHECK_RESULT(buffers.vsMirror.map());
+			VK_CHECK_RESULT(buffers.vsOffScreen.map());
+			VK_CHECK_RESULT(buffers.vsDebugQuad.map());
+			VK_CHECK_RESULT(buffers.terrain.map());
+			VK_CHECK_RESULT(buffers.sky.map());
+			VK_CHECK_RESULT(depthPass.uniformBuffers[i].map());
+			VK_CHECK_RESULT(buffers.CSM.map());
+		}
+		if (depthReduction.supported) {
+			// Initialized to an empty range, so nothing is read back before the first reduction finished
+			const uint32_t emptyRange[2] = { 0x7f7fffff, 0 };
+			depthReduction.buffers.resize(imageCount);
+			for (size_t i = firstImage; i < depthReduction.buffers.size(); i++) {
+				VK_CHECK_RESULT(vulkanDevice->createBuffer(VK_BUFFER_USAGE_STORAGE_BUFFER_BIT | VK_BUFFER_USAGE_TRANSFER_DST_BIT, VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT, &depthReduction.buffers[i], sizeof(emptyRange), (void*)emptyRange));
+				VK_CHECK_RESULT(depthReduction.buffers[i].map());
+			}
+		}
+		// Contents are written right before a frame is submitted, see draw()
 	}
 
 	void updateUniformBuffers()
 	{
+		CPU_PROFILE_SCOPE("Update uniform buffers");
 		float radius = 50.0f;
 		lightPos = glm::vec4(20.0f, -15.0f, -15.0f, 0.0f) * radius;
 		lightPos = glm::vec4(-20.0f, -15.0f, -15.0f, 0.0f) * radius;
 		lightPos = glm::vec4(-20.0f, -15.0f, 20.0f, 0.0f) * radius;
 		// @todo
-		lightPos = glm::vec4(20.0f, -10.0f, 20.0f, 0.0f);
+		if (!scriptedLight) {
+			lightPos = glm::vec4(20.0f, -10.0f, 20.0f, 0.0f);
+		}
 
 		//float angle = glm::radians(timer * 360.0f);
 		//lightPos = glm::vec4(cos(angle) * radius, -15.0f, sin(angle) * radius, 0.0f);
@@ -1139,40 +2636,42 @@ public:
 		uboShared.model = camera.matrices.view * glm::mat4(1.0f);
 
 		// Mesh
-		memcpy(uniformBuffers.vsShared.mapped, &uboShared, sizeof(uboShared));
+		memcpy(uniformBuffers[currentBuffer].vsShared.mapped, &uboShared, sizeof(uboShared));
 
 		// Mirror
 		uboWaterPlane.projection = camera.matrices.perspective;
 		uboWaterPlane.model = camera.matrices.view * glm::mat4(1.0f);
 		uboWaterPlane.cameraPos = glm::vec4(camera.position, 0.0f);
 		uboWaterPlane.time = sin(glm::radians(timer * 360.0f));
-		memcpy(uniformBuffers.vsMirror.mapped, &uboWaterPlane, sizeof(uboWaterPlane));
+		uboWaterPlane.resolutionScale = waterResolution.scale;
+		memcpy(uniformBuffers[currentBuffer].vsMirror.mapped, &uboWaterPlane, sizeof(uboWaterPlane));
 
 		// Debug quad
 		uboShared.projection = glm::ortho(4.0f, 0.0f, 0.0f, 4.0f*(float)height / (float)width, -1.0f, 1.0f);
 		uboShared.model = glm::mat4(1.0f);
-		memcpy(uniformBuffers.vsDebugQuad.mapped, &uboShared, sizeof(uboShared));
+		memcpy(uniformBuffers[currentBuffer].vsDebugQuad.mapped, &uboShared, sizeof(uboShared));
 
 		updateUniformBufferTerrain();
 		updateUniformBufferCSM();
+		updateTerrainCulling();
 
 		// Sky
 		uboSky.projection = camera.matrices.perspective;
 		uboSky.model = glm::mat4(glm::mat3(camera.matrices.view));
-		uniformBuffers.sky.copyTo(&uboSky, sizeof(uboSky));
+		uniformBuffers[currentBuffer].sky.copyTo(&uboSky, sizeof(uboSky));
 	}
 
 	void updateUniformBufferTerrain() {
 		uboTerrain.projection = camera.matrices.perspective;
 		uboTerrain.model = camera.matrices.view;
-		uniformBuffers.terrain.copyTo(&uboTerrain, sizeof(uboTerrain));
+		uniformBuffers[currentBuffer].terrain.copyTo(&uboTerrain, sizeof(uboTerrain));
 	}
 
 	void updateUniformBufferCSM() {
 		for (auto i = 0; i < cascades.size(); i++) {
 			depthPass.ubo.cascadeViewProjMat[i] = cascades[i].viewProjMatrix;
 		}
-		memcpy(depthPass.uniformBuffer.mapped, &depthPass.ubo, sizeof(depthPass.ubo));
+		memcpy(depthPass.uniformBuffers[currentBuffer].mapped, &depthPass.ubo, sizeof(depthPass.ubo));
 
 		for (auto i = 0; i < cascades.size(); i++) {
 			uboCSM.cascadeSplits[i] = cascades[i].splitDepth;
@@ -1180,7 +2679,24 @@ public:
 		}
 		uboCSM.inverseViewMat = glm::inverse(camera.matrices.view);
 		uboCSM.lightDir = normalize(-lightPos);
-		memcpy(uniformBuffers.CSM.mapped, &uboCSM, sizeof(uboCSM));
+		memcpy(uniformBuffers[currentBuffer].CSM.mapped, &uboCSM, sizeof(uboCSM));
+	}
+
+	void updateTerrainCulling()
+	{
+		const glm::mat4 viewProjMatrix = camera.matrices.perspective * camera.matrices.view;
+		bool changed = viewProjMatrix != terrainCulling.viewProjMatrix;
+		terrainCulling.viewProjMatrix = viewProjMatrix;
+		terrainCulling.camera.update(viewProjMatrix);
+		for (auto i = 0; i < cascades.size(); i++) {
+			changed |= cascades[i].viewProjMatrix != terrainCulling.cascadeViewProjMatrices[i];
+			terrainCulling.cascadeViewProjMatrices[i] = cascades[i].viewProjMatrix;
+			terrainCulling.cascades[i].update(cascades[i].viewProjMatrix);
+		}
+		if (changed) {
+			terrainCulling.version++;
+		}
+		terrainCulling.viewPos = glm::vec3(glm::inverse(camera.matrices.view)[3]);
 	}
 
 	void updateUniformBufferOffscreen()
@@ -1188,35 +2704,193 @@ public:
 		uboShared.projection = camera.matrices.perspective;
 		uboShared.model = camera.matrices.view * glm::mat4(1.0f);
 		uboShared.model = glm::scale(uboShared.model, glm::vec3(1.0f, -1.0f, 1.0f));
-		memcpy(uniformBuffers.vsOffScreen.mapped, &uboShared, sizeof(uboShared));
+		memcpy(uniformBuffers[currentBuffer].vsOffScreen.mapped, &uboShared, sizeof(uboShared));
 	}
 
 	void draw()
 	{
-		VulkanExampleBase::prepareFrame();
+		CPU_PROFILE_SCOPE("Draw");
+		if (!VulkanExampleBase::prepareFrame()) {
+			return;
+		}
+
+		// The uniform buffers of the acquired image are no longer in use by the GPU, so they can be updated without stalling
+		// This also applies to the depth range written by the image's previous command buffer
+		readDepthReduction();
+		const bool profilerResults = gpuProfiler->readResults(currentBuffer);
+		if (profilerResults && benchmark.active) {
+			for (auto& result : gpuProfiler->getResults()) {
+				benchmark.addPassTime(result.name, result.gpuTime);
+			}
+		}
+		updateWaterResolution(profilerResults);
+		updateUniformBuffers();
+		updateUniformBufferOffscreen();
+		updateWaterVisibility();
+
+		CommandBuffer* cb = commandBuffers[currentBuffer];
+		// The acquired image's fence has been waited on, so its command buffer can be re-recorded with the current terrain selection
+		if (!settings.dynamicCommandBuffers && terrainCulling.enabled && (terrainCulling.recordedVersions[currentBuffer] != terrainCulling.version)) {
+			buildCommandBuffer(currentBuffer);
+		}
+		if (settings.dynamicCommandBuffers) {
+			// Only the current frame's command buffer is recorded, its pool has been reset by prepareFrame
+			cb = frameCommandBuffers[currentFrame];
+			if (multiThreading.enabled) {
+				recordSecondaryCommandBuffers(currentBuffer);
+				multiThreading.threadPool.wait();
+				executeSecondaryCommandBuffers(cb, currentBuffer);
+			} else {
+				recordCommandBuffer(cb, currentBuffer);
+			}
+		}
 
 		// Command buffer to be sumitted to the queue
 		submitInfo.commandBufferCount = 1;
-		submitInfo.pCommandBuffers = &commandBuffers[currentBuffer]->handle;
+		submitInfo.pCommandBuffers = &cb->handle;
 
-		// Submit to queue
-		VK_CHECK_RESULT(vkQueueSubmit(queue, 1, &submitInfo, VK_NULL_HANDLE));
+		// Submit to queue, the fence signals once this frame in flight has been processed
+		VK_CHECK_RESULT(vkQueueSubmit(queue, 1, &submitInfo, waitFences[currentFrame]));
+		waterVisibility.queriesWritten[currentBuffer] = useWaterOcclusionQuery() && waterVisibility.inFrustum;
+		gpuProfiler->frameSubmitted(currentBuffer);
 
 		VulkanExampleBase::submitFrame();
 	}
 
+	virtual void windowResized()
+	{
+		// The depth buffer has been recreated
+		if (depthReduction.supported) {
+			createDepthReductionView();
+			VkDescriptorImageInfo sceneDepthDescriptor = vks::initializers::descriptorImageInfo(depthReduction.sampler, depthReduction.view, VK_IMAGE_LAYOUT_DEPTH_STENCIL_READ_ONLY_OPTIMAL);
+			for (auto& descriptorSet : depthReduction.descriptorSets) {
+				descriptorCache->update(descriptorSet->handle, { vks::initializers::writeDescriptorSet(descriptorSet->handle, VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER, 0, &sceneDepthDescriptor) });
+			}
+		}
+		// The scene copy needs to match the size of the swap chain
+		if (sceneCopyRefraction.supported) {
+			sceneCopyRefraction.opaqueRenderPass->setDimensions(width, height);
+			sceneCopyRefraction.waterRenderPass->setDimensions(width, height);
+			createSceneCopyTargets();
+			for (auto& sets : descriptorSets) {
+				descriptorCache->update(sets.waterplaneSceneCopy->handle, {
+					vks::initializers::writeDescriptorSet(sets.waterplaneSceneCopy->handle, VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER, 1, &sceneCopyRefraction.colorDescriptor),
+					vks::initializers::writeDescriptorSet(sets.waterplaneSceneCopy->handle, VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER, 6, &sceneCopyRefraction.depthDescriptor),
+				});
+			}
+		}
+		// The swap chain may have more images than before, which need their own uniform buffers, descriptor sets and queries
+		// Those of images no longer in use are kept, so no descriptor set (which may be shared through the cache) refers to a destroyed buffer
+		if (swapChain.imageCount > uniformBuffers.size()) {
+			prepareUniformBuffers();
+			setupImageDescriptorSets();
+			createWaterOcclusionQueries();
+			const bool statisticsEnabled = gpuProfiler->statisticsEnabled;
+			delete gpuProfiler;
+			gpuProfiler = new GpuProfiler(vulkanDevice, swapChain.imageCount, enabledFeatures.pipelineStatisticsQuery == VK_TRUE);
+			gpuProfiler->statisticsEnabled = statisticsEnabled;
+		}
+		// The command buffers are recorded by the base class afterwards
+	}
+
+	virtual void applyBenchmarkKeyframe(const vks::BenchmarkScenario::Keyframe& keyframe, float timestep)
+	{
+		VulkanExampleBase::applyBenchmarkKeyframe(keyframe, timestep);
+		// The light direction points from the light towards the scene
+		lightPos = glm::vec4(-keyframe.lightDir, 0.0f);
+		scriptedLight = true;
+	}
+
+	virtual void getEnabledFeatures()
+	{
+		// Optional for the GPU profiler
+		enabledFeatures.pipelineStatisticsQuery = deviceFeatures.pipelineStatisticsQuery;
+		// Multiview is core since Vulkan 1.1, older devices fall back to one render pass per cascade
+		if (deviceProperties.apiVersion >= VK_API_VERSION_1_1) {
+			cascadeMultiview.features.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_MULTIVIEW_FEATURES;
+			VkPhysicalDeviceFeatures2 features2{};
+			features2.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_FEATURES_2;
+			features2.pNext = &cascadeMultiview.features;
+			vkGetPhysicalDeviceFeatures2(physicalDevice, &features2);
+			cascadeMultiview.supported = (cascadeMultiview.features.multiview == VK_TRUE);
+		}
+		if (cascadeMultiview.supported) {
+			// Only enable what's actually used
+			cascadeMultiview.features.multiviewGeometryShader = VK_FALSE;
+			cascadeMultiview.features.multiviewTessellationShader = VK_FALSE;
+			cascadeMultiview.features.pNext = nullptr;
+			deviceCreatepNextChain = &cascadeMultiview.features;
+		}
+		// Descriptor indexing is only checked for if the bindless path has been requested
+		// Indexing the texture array with push constants requires dynamic indexing of sampled image arrays
+		if (bindless.enabled && (deviceProperties.apiVersion >= VK_API_VERSION_1_1) && deviceFeatures.shaderSampledImageArrayDynamicIndexing) {
+			uint32_t extCount = 0;
+			vkEnumerateDeviceExtensionProperties(physicalDevice, nullptr, &extCount, nullptr);
+			std::vector<VkExtensionProperties> extensions(extCount);
+			vkEnumerateDeviceExtensionProperties(physicalDevice, nullptr, &extCount, extensions.data());
+			for (auto& extension : extensions) {
+				if (strcmp(extension.extensionName, VK_EXT_DESCRIPTOR_INDEXING_EXTENSION_NAME) == 0) {
+					bindless.features.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_DESCRIPTOR_INDEXING_FEATURES_EXT;
+					VkPhysicalDeviceFeatures2 features2{};
+					features2.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_FEATURES_2;
+					features2.pNext = &bindless.features;
+					vkGetPhysicalDeviceFeatures2(physicalDevice, &features2);
+					bindless.supported = (bindless.features.runtimeDescriptorArray == VK_TRUE) && (bindless.features.descriptorBindingVariableDescriptorCount == VK_TRUE);
+					break;
+				}
+			}
+		}
+		if (bindless.supported) {
+			// Only enable what's actually used
+			bindless.features = {};
+			bindless.features.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_DESCRIPTOR_INDEXING_FEATURES_EXT;
+			bindless.features.runtimeDescriptorArray = VK_TRUE;
+			bindless.features.descriptorBindingVariableDescriptorCount = VK_TRUE;
+			bindless.features.pNext = deviceCreatepNextChain;
+			deviceCreatepNextChain = &bindless.features;
+			enabledFeatures.shaderSampledImageArrayDynamicIndexing = VK_TRUE;
+			enabledDeviceExtensions.push_back(VK_EXT_DESCRIPTOR_INDEXING_EXTENSION_NAME);
+		} else {
+			bindless.enabled = false;
+		}
+	}
+
 	void prepare()
 	{
+		CPU_PROFILE_SCOPE("Prepare");
+		// The depth reduction samples the scene's depth buffer, which needs to be supported by its format
+		VkFormatProperties formatProperties;
+		vkGetPhysicalDeviceFormatProperties(physicalDevice, depthFormat, &formatProperties);
+		depthReduction.supported = (formatProperties.optimalTilingFeatures & VK_FORMAT_FEATURE_SAMPLED_IMAGE_BIT) != 0;
+		if (depthReduction.supported) {
+			depthStencil.usage |= VK_IMAGE_USAGE_SAMPLED_BIT;
+		} else {
+			depthReduction.enabled = false;
+		}
 		VulkanExampleBase::prepare();
-		loadAssets();
-		generateTerrain();
+		gpuProfiler = new GpuProfiler(vulkanDevice, swapChain.imageCount, enabledFeatures.pipelineStatisticsQuery == VK_TRUE);
+		// The scene copy refraction copies from the swap chain images and depth buffer, and samples a copy of the latter
+		sceneCopyRefraction.supported = ((formatProperties.optimalTilingFeatures & VK_FORMAT_FEATURE_SAMPLED_IMAGE_BIT) != 0) && ((swapChain.imageUsage & VK_IMAGE_USAGE_TRANSFER_SRC_BIT) != 0);
+		if (!sceneCopyRefraction.supported) {
+			sceneCopyRefraction.enabled = false;
+		}
 		prepareOffscreen();
+		if (sceneCopyRefraction.supported) {
+			prepareSceneCopyRefraction();
+		}
 		prepareCSM();
-		prepareUniformBuffers();
 		setupDescriptorSetLayout();
+		// The height map is generated later, but the terrain pipelines already need its grid parameters
+		heightMap = new vks::HeightMap(vulkanDevice, queue);
+		// Pipelines are compiled on worker threads while the assets are loaded
 		preparePipelines();
-		setupDescriptorPool();
+		loadAssets();
+		generateTerrain();
+		prepareUniformBuffers();
+		setupDescriptorCache();
 		setupDescriptorSet();
+		prepareMultiThreading();
+		waitForPipelines();
 		buildCommandBuffers();
 		prepared = true;
 	}
@@ -1225,19 +2899,12 @@ public:
 	{
 		if (!prepared)
 			return;
-		draw();
 		if (!paused || camera.updated)
 		{
 			updateCascades();
-			updateUniformBuffers();
-			updateUniformBufferOffscreen();
 		}
-	}
-
-	virtual void viewChanged()
-	{
-		updateUniformBuffers();
-		updateUniformBufferOffscreen();
+		scheduleCascades();
+		draw();
 	}
 
 	virtual void OnUpdateUIOverlay(vks::UIOverlay *overlay)
@@ -1260,7 +2927,6 @@ public:
 			}
 			if (overlay->sliderFloat("Split lambda", &cascadeSplitLambda, 0.1f, 1.0f)) {
 				updateCascades();
-				updateUniformBuffers();
 			}
 		}
 		if (overlay->header("Terrain layers")) {
@@ -1269,6 +2935,113 @@ public:
 					updateTerrain = true;
 				}
 			}
+		}
+		if (overlay->header("Performance")) {
+			if (overlay->checkBox("Multi threaded recording", &multiThreading.enabled)) {
+				buildCommandBuffers();
+			}
+			if (overlay->checkBox("Terrain culling and LOD", &terrainCulling.enabled)) {
+				buildCommandBuffers();
+			}
+			if (terrainCulling.enabled) {
+				for (uint32_t i = 0; i < SHADOW_MAP_CASCADE_COUNT; i++) {
+					const vks::HeightMap::CullingStatistics& statistics = terrainCulling.casterStatistics[i];
+					overlay->text("Cascade %d casters: %d drawn, %d culled", i, statistics.drawnNodes, statistics.culledNodes);
+				}
+			}
+			if (settings.dynamicCommandBuffers) {
+				if (overlay->checkBox("Cascade scheduling", &cascadeScheduler.enabled)) {
+					// Cached cascades may not have been padded for lagging behind
+					invalidateCascades();
+				}
+				overlay->text("Cascades redrawn: %d / %d (%.2f avg)", cascadeScheduler.redrawCount, SHADOW_MAP_CASCADE_COUNT, (cascadeScheduler.frame > 0) ? (float)cascadeScheduler.totalRedrawCount / (float)cascadeScheduler.frame : 0.0f);
+			}
+			if (settings.dynamicCommandBuffers) {
+				overlay->checkBox("Skip hidden water", &waterVisibility.enabled);
+				if (waterVisibility.enabled) {
+					overlay->checkBox("Water occlusion queries", &waterVisibility.occlusionQueries);
+					overlay->text("Water passes %s, %d frames skipped", waterVisibility.visible ? "rendered" : "skipped", waterVisibility.skippedFrames);
+				}
+			}
+			// The dynamic scale changes every frame, so it requires dynamic command buffers
+			if (settings.dynamicCommandBuffers && gpuProfiler->supported) {
+				overlay->comboBox("Water resolution", &waterResolution.mode, { "Fixed", "Dynamic" });
+			}
+			if ((waterResolution.mode == WaterResolution::modeFixed) || !settings.dynamicCommandBuffers) {
+				if (overlay->sliderFloat("Water resolution scale", &waterResolution.fixedScale, waterResolution.minScale, 1.0f)) {
+					waterResolution.scale = waterResolution.fixedScale;
+					buildCommandBuffers();
+				}
+			} else {
+				overlay->sliderFloat("Water GPU budget (ms)", &waterResolution.budget, 0.1f, 10.0f);
+			}
+			if (gpuProfiler->supported) {
+				overlay->text("Water passes: %.2f ms at %d%%", waterResolution.gpuTime, (int)(waterResolution.scale * 100.0f));
+			}
+			if (sceneCopyRefraction.supported) {
+				if (overlay->checkBox("Refraction from scene copy", &sceneCopyRefraction.enabled)) {
+					if (sceneCopyRefraction.enabled) {
+						createPipelineOnDemand(sceneCopyRefraction.pipeline);
+					}
+					buildCommandBuffers();
+				}
+			}
+			if (bindless.pipelines.mirror) {
+				if (overlay->checkBox("Bindless textures", &bindless.enabled)) {
+					buildCommandBuffers();
+				}
+				if (bindless.enabled) {
+					overlay->text("Global texture array: %d textures", (int)bindless.textures.size());
+				}
+			}
+			if (depthReduction.supported) {
+				if (overlay->checkBox("Sample distribution shadows", &depthReduction.enabled)) {
+					if (depthReduction.enabled) {
+						createPipelineOnDemand(depthReduction.pipeline);
+					}
+					depthReduction.valid = false;
+					buildCommandBuffers();
+					updateCascades();
+				}
+				if (depthReduction.enabled && depthReduction.valid) {
+					overlay->text("Visible depth range: %.2f - %.2f", depthReduction.range.x, depthReduction.range.y);
+				}
+			}
+			if (cascadeMultiview.supported) {
+				if (overlay->checkBox("Single pass cascades (multiview)", &cascadeMultiview.enabled)) {
+					buildCommandBuffers();
+				}
+			}
+			if (gpuProfiler->supported) {
+				for (auto& result : gpuProfiler->getResults()) {
+					overlay->text("%s: %.2f ms", result.name.c_str(), result.gpuTime);
+					if (result.hasStatistics) {
+						overlay->text("  %.1fk primitives, %.1fk vertices, %.1fk fragments", (float)result.statistics[GpuProfiler::statisticInputAssemblyPrimitives] / 1000.0f, (float)result.statistics[GpuProfiler::statisticVertexShaderInvocations] / 1000.0f, (float)result.statistics[GpuProfiler::statisticFragmentShaderInvocations] / 1000.0f);
+					}
+				}
+				if (gpuProfiler->statisticsSupported) {
+					if (overlay->checkBox("Pipeline statistics", &gpuProfiler->statisticsEnabled)) {
+						buildCommandBuffers();
+					}
+				}
+			}
+			overlay->text("Terrain mesh generation: %.2f ms", heightMap->generationTime);
+			if (overlay->button("Regenerate terrain mesh")) {
+				// The current buffers are destroyed by the regeneration
+				VK_CHECK_RESULT(vkDeviceWaitIdle(device));
+				heightMap->generate(terrainPatchSize, terrainScale, vks::HeightMap::topologyTriangles, terrainVertexFormat);
+				buildCommandBuffers();
+			}
+			overlay->text("Descriptor sets: %d for %d requests, %d pools", descriptorCache->getSetCount(), descriptorCache->getRequestCount(), descriptorCache->getPoolCount());
+			const std::vector<vks::HeapStatistics> heapStatistics = vulkanDevice->memoryAllocator->getHeapStatistics();
+			for (size_t i = 0; i < heapStatistics.size(); i++) {
+				const vks::HeapStatistics& heap = heapStatistics[i];
+				if (heap.blockCount == 0) {
+					continue;
+				}
+				overlay->text("Heap %d%s: %d blocks, %d allocations", (int)i, (heap.flags & VK_MEMORY_HEAP_DEVICE_LOCAL_BIT) ? " (device)" : "", heap.blockCount, heap.allocationCount);
+				overlay->text("%.1f / %.1f MiB used", (float)heap.allocationBytes / (1024.0f * 1024.0f), (float)heap.blockBytes / (1024.0f * 1024.0f));
+			}
 		}
 			//if (overlay->sliderInt("Skysphere", &skysphereIndex, 0, skyspheres.size() - 1)) {
 		//	buildCommandBuffers();
@@ -0,0 +1,74 @@
+/*
+* Checks the benchmark's baseline comparison against synthetic frame times
+*
+* Copyright (C) by Sascha Willems - www.saschawillems.de
+*
+* This code is licensed under the MIT license (MIT) (http://opensource.org/licenses/MIT)
+*/
+
+#include <cstdint>
+#include <cstdlib>
+#include <cstdio>
+#include <cmath>
+#include <random>
+#include <vector>
+#include <string>
+#include <iostream>
+#include "vulkan/vulkan.h"
+#include "benchmark.hpp"
+
+const std::string baselineFilename = "benchmark_regression_baseline.json";
+
+// Normally distributed times around the given mean, generated with Box-Muller from the raw engine output so they're the same on every standard library
+std::vector<double> getTimes(uint32_t seed, size_t count, double mean, double stdDev)
+{
+	std::mt19937 rng(seed);
+	std::vector<double> times(count);
+	for (auto& time : times) {
+		const double u1 = ((double)rng() + 1.0) / 4294967297.0;
+		const double u2 = (double)rng() / 4294967296.0;
+		time = std::max(mean + stdDev * std::sqrt(-2.0 * std::log(u1)) * std::cos(2.0 * M_PI * u2), 0.1);
+	}
+	return times;
+}
+
+bool check(const std::string& name, const std::vector<double>& times, bool expectPass)
+{
+	vks::Benchmark benchmark;
+	benchmark.baselineFilename = baselineFilename;
+	benchmark.frameTimes = times;
+	benchmark.frameCount = static_cast<uint32_t>(times.size());
+	const bool passed = benchmark.compareToBaseline();
+	if (passed != expectPass) {
+		std::cerr << name << ": expected " << (expectPass ? "no regression" : "a regression") << std::endl;
+		return false;
+	}
+	return true;
+}
+
+int main()
+{
+	// A 4 ms workload with a little noise, as measured on a fast GPU
+	const size_t frameCount = 2000;
+	vks::Benchmark baseline;
+	baseline.frameTimes = getTimes(1, frameCount, 4.0, 0.2);
+	baseline.frameCount = static_cast<uint32_t>(frameCount);
+	baseline.saveJson(baselineFilename);
+
+	bool passed = true;
+	// Another run of the same workload
+	passed &= check("unchanged", getTimes(2, frameCount, 4.0, 0.2), true);
+	// 10% slower, which stays within a single millisecond for most frames
+	passed &= check("10% slower", getTimes(3, frameCount, 4.4, 0.2), false);
+	// Same average, but 3% of the frames take 20% longer, which only moves the tail
+	std::vector<double> tail = getTimes(4, frameCount, 4.0, 0.2);
+	for (size_t i = 0; i < tail.size(); i += 33) {
+		tail[i] = 4.0 * 1.2 + std::abs(tail[i] - 4.0);
+	}
+	passed &= check("slower tail", tail, false);
+	// Faster runs never count as a regression
+	passed &= check("10% faster", getTimes(5, frameCount, 3.6, 0.2), true);
+
+	std::remove(baselineFilename.c_str());
+	return passed ? EXIT_SUCCESS : EXIT_FAILURE;
+}